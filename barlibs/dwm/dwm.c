@@ -17,7 +17,7 @@
  * along with luastatus.  If not, see <https://www.gnu.org/licenses/>.
  */
 
-#include "include/barlib_v1.h"
+#include "include/barlib_v2.h"
 #include "include/sayf_macros.h"
 
 #include <xcb/xcb.h>
@@ -31,6 +31,7 @@
 #include "libls/cstring_utils.h"
 #include "libls/string_.h"
 #include "libls/vector.h"
+#include "libls/usdt.h"
 
 typedef struct {
     size_t nwidgets;
@@ -40,6 +41,9 @@ typedef struct {
     // Temporary buffer for secondary buffering, to avoid unneeded redraws.
     LSString tmpbuf;
 
+    // Whether /bufs/ have changed since the last redraw.
+    bool dirty;
+
     // Buffer for the content of the widgets joined by /sep/.
     LSString joined;
 
@@ -96,6 +100,8 @@ static bool redraw(LuastatusBarlibData *bd)
     LSString *bufs = p->bufs;
     const char *sep = p->sep;
 
+    LS_USDT1(luastatus, redraw__start, n);
+
     LS_VECTOR_CLEAR(*joined);
     for (size_t i = 0; i < n; ++i) {
         if (bufs[i].size) {
@@ -122,8 +128,10 @@ static bool redraw(LuastatusBarlibData *bd)
     if (err) {
         LS_FATALF(bd, "XCB error %d occured", err->error_code);
         free(err);
+        LS_USDT1(luastatus, redraw__done, false);
         return false;
     }
+    LS_USDT1(luastatus, redraw__done, true);
     return true;
 }
 
@@ -134,6 +142,7 @@ static int init(LuastatusBarlibData *bd, const char *const *opts, size_t nwidget
         .nwidgets = nwidgets,
         .bufs = LS_XNEW(LSString, nwidgets),
         .tmpbuf = LS_VECTOR_NEW(),
+        .dirty = false,
         .joined = LS_VECTOR_NEW_RESERVE(char, 1024),
         .sep = NULL,
         .conn = NULL,
@@ -222,14 +231,13 @@ static int set(LuastatusBarlibData *bd, lua_State *L, size_t widget_idx)
 
     if (!ls_string_eq(*buf, p->bufs[widget_idx])) {
         ls_string_swap(buf, &p->bufs[widget_idx]);
-        if (!redraw(bd)) {
-            return LUASTATUS_ERR;
-        }
+        p->dirty = true;
     }
     return LUASTATUS_OK;
 
 invalid_data:
     LS_VECTOR_CLEAR(p->bufs[widget_idx]);
+    p->dirty = true;
     return LUASTATUS_NONFATAL_ERR;
 }
 
@@ -237,15 +245,26 @@ static int set_error(LuastatusBarlibData *bd, size_t widget_idx)
 {
     Priv *p = bd->priv;
     ls_string_assign_s(&p->bufs[widget_idx], "(Error)");
-    if (!redraw(bd)) {
-        return LUASTATUS_ERR;
+    p->dirty = true;
+    return LUASTATUS_OK;
+}
+
+static int flush(LuastatusBarlibData *bd)
+{
+    Priv *p = bd->priv;
+    if (p->dirty) {
+        if (!redraw(bd)) {
+            return LUASTATUS_ERR;
+        }
+        p->dirty = false;
     }
     return LUASTATUS_OK;
 }
 
-LuastatusBarlibIface luastatus_barlib_iface_v1 = {
+LuastatusBarlibIface luastatus_barlib_iface_v2 = {
     .init = init,
     .set = set,
     .set_error = set_error,
+    .flush = flush,
     .destroy = destroy,
 };
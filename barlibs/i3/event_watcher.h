@@ -20,7 +20,7 @@
 #ifndef event_watcher_h_
 #define event_watcher_h_
 
-#include "include/barlib_data_v1.h"
+#include "include/barlib_data_v2.h"
 
 int event_watcher(LuastatusBarlibData *bd, LuastatusBarlibEWFuncs funcs);
 
@@ -21,27 +21,166 @@
 
 #include <math.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
 
-void append_json_escaped_s(LSString *s, const char *zts)
+#include "libls/fmt_num.h"
+
+#if defined(__AVX2__)
+#   include <immintrin.h>
+#endif
+#if defined(__SSE2__)
+#   include <emmintrin.h>
+#endif
+
+static inline bool needs_escaping(unsigned char c)
 {
-    static const char *HEX_CHARS = "0123456789ABCDEF";
+    return c < 32 || c == '\\' || c == '"';
+}
 
-    ls_string_append_c(s, '"');
-    size_t prev = 0;
-    size_t i;
-    for (i = 0; ; ++i) {
-        unsigned char c = zts[i];
-        if (c == '\0')
+#if defined(__GNUC__) && defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#   define HAVE_SWAR 1
+#else
+#   define HAVE_SWAR 0
+#endif
+
+#if HAVE_SWAR
+// Returns a mask with the high bit of each byte of /x/ that needs escaping set (and maybe some
+// more bits of higher bytes; the lowest set bit is always exact).
+static inline uint64_t swar_check(uint64_t x)
+{
+    const uint64_t ONES = 0x0101010101010101;
+    const uint64_t HIGHS = 0x8080808080808080;
+    uint64_t q = x ^ (ONES * '"');
+    uint64_t b = x ^ (ONES * '\\');
+    // /(v - ONES * n) & ~v/ has the high bit of the lowest byte of /v/ that is less than /n/ set.
+    return (((x - ONES * 32) & ~x) | ((q - ONES) & ~q) | ((b - ONES) & ~b)) & HIGHS;
+}
+#endif
+
+// Returns the index of the first byte in /buf[i..nbuf)/ that needs escaping, or /nbuf/ if there is
+// none.
+//
+// With AVX2 and/or SSE2 available at compile time, 32 and/or 16 bytes are checked at once;
+// otherwise, 8 bytes are checked at once with /swar_check()/, if possible. As most strings contain
+// nothing to escape, this is where most of the time is spent.
+static size_t skip_clean(const char *buf, size_t i, size_t nbuf)
+{
+#if defined(__AVX2__)
+    {
+        const __m256i quote = _mm256_set1_epi8('"');
+        const __m256i bslash = _mm256_set1_epi8('\\');
+        const __m256i ctl_max = _mm256_set1_epi8(31);
+        for (; nbuf - i >= 32; i += 32) {
+            __m256i v = _mm256_loadu_si256((const __m256i *) (buf + i));
+            __m256i m = _mm256_or_si256(
+                _mm256_or_si256(_mm256_cmpeq_epi8(v, quote), _mm256_cmpeq_epi8(v, bslash)),
+                // /v <= 31/ (unsigned) if and only if /min(v, 31) == v/.
+                _mm256_cmpeq_epi8(_mm256_min_epu8(v, ctl_max), v));
+            unsigned mask = _mm256_movemask_epi8(m);
+            if (mask) {
+                return i + __builtin_ctz(mask);
+            }
+        }
+    }
+#endif
+#if defined(__SSE2__)
+    {
+        const __m128i quote = _mm_set1_epi8('"');
+        const __m128i bslash = _mm_set1_epi8('\\');
+        const __m128i ctl_max = _mm_set1_epi8(31);
+#       define CHECK16(P_) \
+            _mm_movemask_epi8(_mm_or_si128( \
+                _mm_or_si128(_mm_cmpeq_epi8(P_, quote), _mm_cmpeq_epi8(P_, bslash)), \
+                _mm_cmpeq_epi8(_mm_min_epu8(P_, ctl_max), P_)))
+
+        for (; nbuf - i >= 16; i += 16) {
+            __m128i v = _mm_loadu_si128((const __m128i *) (buf + i));
+            unsigned mask = CHECK16(v);
+            if (mask) {
+                return i + __builtin_ctz(mask);
+            }
+        }
+        // If the string is long enough, check the tail with a load of its last 16 bytes, which
+        // overlaps with what has already been checked.
+        if (i != nbuf && nbuf >= 16) {
+            size_t start = nbuf - 16;
+            __m128i v = _mm_loadu_si128((const __m128i *) (buf + start));
+            unsigned mask = (unsigned) CHECK16(v) >> (i - start);
+            return mask ? i + __builtin_ctz(mask) : nbuf;
+        }
+#       undef CHECK16
+    }
+#endif
+#if HAVE_SWAR
+    for (; nbuf - i >= 8; i += 8) {
+        uint64_t x;
+        memcpy(&x, buf + i, 8);
+        uint64_t mask = swar_check(x);
+        if (mask) {
+            return i + __builtin_ctzll(mask) / 8;
+        }
+    }
+#endif
+    for (; i < nbuf; ++i) {
+        if (needs_escaping(buf[i])) {
             break;
+        }
+    }
+    return i;
+}
 
-        if (c < 32 || c == '\\' || c == '"' || c == '/') {
-            ls_string_append_b(s, zts + prev, i - prev);
+// Appends the escape sequence for /c/, for which /needs_escaping()/ returns /true/.
+static void append_escape(LSString *s, unsigned char c)
+{
+    static const char *HEX_CHARS = "0123456789ABCDEF";
+
+    char short_esc;
+    switch (c) {
+    case '"':  short_esc = '"';  break;
+    case '\\': short_esc = '\\'; break;
+    case '\b': short_esc = 'b';  break;
+    case '\f': short_esc = 'f';  break;
+    case '\n': short_esc = 'n';  break;
+    case '\r': short_esc = 'r';  break;
+    case '\t': short_esc = 't';  break;
+    default:
+        {
             char buf[] = {'\\', 'u', '0', '0', HEX_CHARS[c / 16], HEX_CHARS[c % 16]};
             ls_string_append_b(s, buf, sizeof(buf));
-            prev = i + 1;
         }
+        return;
+    }
+    char buf[] = {'\\', short_esc};
+    ls_string_append_b(s, buf, sizeof(buf));
+}
+
+void append_json_escaped_b(LSString *s, const char *buf, size_t nbuf)
+{
+    size_t i = skip_clean(buf, 0, nbuf);
+    if (i == nbuf) {
+        // The common case of nothing to escape.
+        LS_VECTOR_ENSURE(*s, s->size + nbuf + 2);
+        char *dst = s->data + s->size;
+        dst[0] = '"';
+        // see DOCS/c_notes/empty-ranges-and-c-stdlib.md
+        if (nbuf) {
+            memcpy(dst + 1, buf, nbuf);
+        }
+        dst[nbuf + 1] = '"';
+        s->size += nbuf + 2;
+        return;
+    }
+
+    ls_string_append_c(s, '"');
+    size_t prev = 0;
+    for (; i != nbuf; i = skip_clean(buf, i + 1, nbuf)) {
+        ls_string_append_b(s, buf + prev, i - prev);
+        append_escape(s, buf[i]);
+        prev = i + 1;
     }
-    ls_string_append_b(s, zts + prev, i - prev);
+    ls_string_append_b(s, buf + prev, nbuf - prev);
     ls_string_append_c(s, '"');
 }
 
@@ -49,5 +188,6 @@ bool append_json_number(LSString *s, double value)
 {
     if (!isfinite(value))
         return false;
-    return ls_string_append_f(s, "%.20g", value);
+    ls_string_append_double(s, value);
+    return true;
 }
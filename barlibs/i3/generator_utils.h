@@ -21,10 +21,12 @@
 #define generator_utils_h_
 
 #include <stdbool.h>
+#include <stddef.h>
 
 #include "libls/string_.h"
 
-void append_json_escaped_s(LSString *s, const char *zts);
+// Appends /nbuf/ bytes at /buf/ (which may contain NUL bytes) to /s/ as a JSON string literal.
+void append_json_escaped_b(LSString *s, const char *buf, size_t nbuf);
 
 bool append_json_number(LSString *s, double value);
 
@@ -20,13 +20,15 @@
 #include <string.h>
 #include <stdbool.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <errno.h>
 #include <unistd.h>
+#include <signal.h>
 #include <lua.h>
 #include <lauxlib.h>
 
-#include "include/barlib_v1.h"
+#include "include/barlib_v2.h"
 #include "include/sayf_macros.h"
 
 #include "libls/string_.h"
@@ -36,21 +38,82 @@
 #include "libls/cstring_utils.h"
 #include "libls/io_utils.h"
 #include "libls/osdep.h"
+#include "libls/usdt.h"
+#include "libls/writer.h"
+#include "libls/fmt_num.h"
 
 #include "priv.h"
 #include "generator_utils.h"
 #include "event_watcher.h"
+#include "key_cache.h"
+
+// With the /pause_when_hidden/ option, i3bar is told to send us these (real-time) signals instead
+// of /SIGSTOP/ and /SIGCONT/; their handlers report them to /pause_bd/. There is only one barlib
+// instance, so these are global.
+static LuastatusBarlibData *pause_bd = NULL;
+static int pause_stop_sig = -1;
+static int pause_cont_sig = -1;
+
+static void pause_signal_handler(int sig)
+{
+    pause_bd->set_paused(pause_bd->userdata, sig == pause_stop_sig);
+}
+
+// Claims a free real-time signal (see DOCS/WRITING_BARLIB_OR_PLUGIN.md) and installs
+// /pause_signal_handler()/ for it. Returns the signal number, or /-1/ on failure.
+static int claim_pause_signal(LuastatusBarlibData *bd)
+{
+    for (int i = 0; SIGRTMIN + i <= SIGRTMAX; ++i) {
+        char key[64];
+        snprintf(key, sizeof(key), "flag:signal_handled:SIGRTMIN+%d", i);
+        void **flag = bd->map_get(bd->userdata, key);
+        if (*flag) {
+            continue;
+        }
+        struct sigaction sa = {.sa_flags = SA_RESTART, .sa_handler = pause_signal_handler};
+        sigemptyset(&sa.sa_mask);
+        if (sigaction(SIGRTMIN + i, &sa, NULL) < 0) {
+            LS_FATALF(bd, "sigaction: SIGRTMIN+%d: %s", i, ls_strerror_onstack(errno));
+            return -1;
+        }
+        *flag = &pause_bd;
+        return SIGRTMIN + i;
+    }
+    LS_FATALF(bd, "no free real-time signals to pause on");
+    return -1;
+}
+
+static void release_pause_signals(void)
+{
+    struct sigaction sa = {.sa_handler = SIG_IGN};
+    sigemptyset(&sa.sa_mask);
+    if (pause_stop_sig >= 0) {
+        sigaction(pause_stop_sig, &sa, NULL);
+        pause_stop_sig = -1;
+    }
+    if (pause_cont_sig >= 0) {
+        sigaction(pause_cont_sig, &sa, NULL);
+        pause_cont_sig = -1;
+    }
+}
 
 static void destroy(LuastatusBarlibData *bd)
 {
     Priv *p = bd->priv;
+    release_pause_signals();
     for (size_t i = 0; i < p->nwidgets; ++i)
         LS_VECTOR_FREE(p->bufs[i]);
     free(p->bufs);
     LS_VECTOR_FREE(p->tmpbuf);
+    key_cache_destroy(&p->key_cache);
     close(p->in_fd);
-    if (p->out)
-        fclose(p->out);
+    if (p->writer) {
+        LS_VERBOSEF(bd, "dropped %ju frame(s)", (uintmax_t) ls_writer_dropped(p->writer));
+        ls_writer_destroy(p->writer);
+    }
+    LS_VECTOR_FREE(p->iov);
+    if (p->out_fd >= 0)
+        close(p->out_fd);
     free(p);
 }
 
@@ -61,19 +124,24 @@ static int init(LuastatusBarlibData *bd, const char *const *opts, size_t nwidget
         .nwidgets = nwidgets,
         .bufs = LS_XNEW(LSString, nwidgets),
         .tmpbuf = LS_VECTOR_NEW(),
+        .dirty = false,
         .in_fd = -1,
-        .out = NULL,
+        .out_fd = -1,
+        .writer = NULL,
+        .iov = LS_VECTOR_NEW(),
         .noclickev = false,
         .noseps = false,
     };
     for (size_t i = 0; i < nwidgets; ++i) {
         LS_VECTOR_INIT_RESERVE(p->bufs[i], 1024);
     }
+    key_cache_init(&p->key_cache);
 
     // All the options may be passed multiple times!
     int in_fd = -1;
     int out_fd = -1;
     bool allow_stopping = false;
+    bool pause_when_hidden = false;
     for (const char *const *s = opts; *s; ++s) {
         const char *v;
         if ((v = ls_strfollow(*s, "in_fd="))) {
@@ -92,6 +160,8 @@ static int init(LuastatusBarlibData *bd, const char *const *opts, size_t nwidget
             p->noseps = true;
         } else if (strcmp(*s, "allow_stopping") == 0) {
             allow_stopping = true;
+        } else if (strcmp(*s, "pause_when_hidden") == 0) {
+            pause_when_hidden = true;
         } else {
             LS_FATALF(bd, "unknown option '%s'", *s);
             goto error;
@@ -108,13 +178,14 @@ static int init(LuastatusBarlibData *bd, const char *const *opts, size_t nwidget
         LS_FATALF(bd, "out_fd is not specified or less than 3");
         goto error;
     }
+    if (allow_stopping && pause_when_hidden) {
+        LS_FATALF(bd, "allow_stopping and pause_when_hidden are mutually exclusive");
+        goto error;
+    }
 
     // assign
     p->in_fd = in_fd;
-    if (!(p->out = fdopen(out_fd, "w"))) {
-        LS_FATALF(bd, "can't fdopen %d: %s", out_fd, ls_strerror_onstack(errno));
-        goto error;
-    }
+    p->out_fd = out_fd;
 
     // make CLOEXEC
     if (ls_make_cloexec(in_fd) < 0) {
@@ -126,14 +197,38 @@ static int init(LuastatusBarlibData *bd, const char *const *opts, size_t nwidget
         goto error;
     }
 
+    // claim the signals to pause on
+    if (pause_when_hidden) {
+        pause_bd = bd;
+        if ((pause_stop_sig = claim_pause_signal(bd)) < 0) {
+            goto error;
+        }
+        if ((pause_cont_sig = claim_pause_signal(bd)) < 0) {
+            goto error;
+        }
+    }
+
+    // start writing
+    if (!(p->writer = ls_writer_new(out_fd))) {
+        LS_FATALF(bd, "can't start writing to fd %d: %s", out_fd, ls_strerror_onstack(errno));
+        goto error;
+    }
+
     // print header
-    fprintf(p->out, "{\"version\":1,\"click_events\":%s", p->noclickev ? "false" : "true");
-    if (!allow_stopping) {
-        fprintf(p->out, ",\"stop_signal\":0,\"cont_signal\":0");
+    LSString header = LS_VECTOR_NEW();
+    LSString *out = &header;
+    ls_string_append_f(out, "{\"version\":1,\"click_events\":%s",
+                       p->noclickev ? "false" : "true");
+    if (pause_when_hidden) {
+        ls_string_append_f(out, ",\"stop_signal\":%d,\"cont_signal\":%d",
+                           pause_stop_sig, pause_cont_sig);
+    } else if (!allow_stopping) {
+        ls_string_append_s(out, ",\"stop_signal\":0,\"cont_signal\":0");
     }
-    fprintf(p->out, "}\n[\n");
-    fflush(p->out);
-    if (ferror(p->out)) {
+    ls_string_append_s(out, "}\n[\n");
+    int r = ls_writer_push(p->writer, out->data, out->size);
+    LS_VECTOR_FREE(header);
+    if (r < 0) {
         LS_FATALF(bd, "write error: %s", ls_strerror_onstack(errno));
         goto error;
     }
@@ -149,27 +244,33 @@ static bool redraw(LuastatusBarlibData *bd)
 {
     Priv *p = bd->priv;
 
-    FILE *out = p->out;
+    LSIovecs *out = &p->iov;
     size_t n = p->nwidgets;
     LSString *bufs = p->bufs;
 
-    putc_unlocked('[', out);
+    LS_USDT1(luastatus, redraw__start, n);
+
+    // The line is described as a list of pointers into /bufs/ and string literals, and only gets
+    // copied once, into the writer's pending frame.
+    LS_VECTOR_CLEAR(*out);
+    ls_iovecs_append(out, "[", 1);
     bool first = true;
     for (size_t i = 0; i < n; ++i) {
         if (bufs[i].size) {
             if (!first) {
-                putc_unlocked(',', out);
+                ls_iovecs_append(out, ",", 1);
             }
-            fwrite(bufs[i].data, 1, bufs[i].size, out);
+            ls_iovecs_append(out, bufs[i].data, bufs[i].size);
             first = false;
         }
     }
-    fputs("],\n", out);
-    fflush(out);
-    if (ferror(out)) {
+    ls_iovecs_append(out, "],\n", 3);
+    if (ls_writer_push_framev(p->writer, out->data, out->size) < 0) {
         LS_FATALF(bd, "write error: %s", ls_strerror_onstack(errno));
+        LS_USDT1(luastatus, redraw__done, false);
         return false;
     }
+    LS_USDT1(luastatus, redraw__done, true);
     return true;
 }
 
@@ -222,7 +323,10 @@ static bool append_segment(LuastatusBarlibData *bd, lua_State *L, size_t widget_
     if (s->size) {
         ls_string_append_c(s, ',');
     }
-    ls_string_append_f(s, "{\"name\":\"%zu\"", widget_idx);
+    char idx_buf[LS_FMT_NUM_BUFSZ];
+    ls_string_append_s(s, "{\"name\":\"");
+    ls_string_append_b(s, idx_buf, ls_fmt_int64(idx_buf, widget_idx));
+    ls_string_append_c(s, '"');
 
     bool has_separator_key = false;
     // L: ? table
@@ -233,21 +337,24 @@ static bool append_segment(LuastatusBarlibData *bd, lua_State *L, size_t widget_
             LS_ERRF(bd, "segment key: expected string, found %s", luaL_typename(L, -2));
             return false;
         }
-        const char *key = lua_tostring(L, -2);
+        size_t nkey;
+        const char *key = lua_tolstring(L, -2, &nkey);
+        const KeyCacheEntry *ke = key_cache_get(&p->key_cache, key, nkey);
 
-        if (strcmp(key, "name") == 0) {
+        switch (ke->kind) {
+        case KEY_KIND_NAME:
             LS_WARNF(bd, "segment: ignoring 'name', it is set automatically; use 'instance' "
                          "instead");
             goto next_entry;
-        }
-
-        if (strcmp(key, "separator") == 0) {
+        case KEY_KIND_SEPARATOR:
             has_separator_key = true;
+            break;
+        case KEY_KIND_REGULAR:
+            break;
         }
 
         ls_string_append_c(s, ',');
-        append_json_escaped_s(s, key);
-        ls_string_append_c(s, ':');
+        ls_string_append_b(s, ke->json.data, ke->json.size);
 
         switch (lua_type(L, -1)) {
         case LUA_TNUMBER:
@@ -261,8 +368,9 @@ static bool append_segment(LuastatusBarlibData *bd, lua_State *L, size_t widget_
             break;
         case LUA_TSTRING:
             {
-                const char *val = lua_tostring(L, -1);
-                append_json_escaped_s(s, val);
+                size_t nval;
+                const char *val = lua_tolstring(L, -1, &nval);
+                append_json_escaped_b(s, val, nval);
             }
             break;
         case LUA_TBOOLEAN:
@@ -348,14 +456,13 @@ static int set(LuastatusBarlibData *bd, lua_State *L, size_t widget_idx)
 
     if (!ls_string_eq(p->tmpbuf, p->bufs[widget_idx])) {
         ls_string_swap(&p->tmpbuf, &p->bufs[widget_idx]);
-        if (!redraw(bd)) {
-            return LUASTATUS_ERR;
-        }
+        p->dirty = true;
     }
     return LUASTATUS_OK;
 
 invalid_data:
     LS_VECTOR_CLEAR(p->bufs[widget_idx]);
+    p->dirty = true;
     return LUASTATUS_NONFATAL_ERR;
 }
 
@@ -371,17 +478,28 @@ static int set_error(LuastatusBarlibData *bd, size_t widget_idx)
     }
     ls_string_append_c(s, '}');
 
-    if (!redraw(bd)) {
-        return LUASTATUS_ERR;
+    p->dirty = true;
+    return LUASTATUS_OK;
+}
+
+static int flush(LuastatusBarlibData *bd)
+{
+    Priv *p = bd->priv;
+    if (p->dirty) {
+        if (!redraw(bd)) {
+            return LUASTATUS_ERR;
+        }
+        p->dirty = false;
     }
     return LUASTATUS_OK;
 }
 
-LuastatusBarlibIface luastatus_barlib_iface_v1 = {
+LuastatusBarlibIface luastatus_barlib_iface_v2 = {
     .init = init,
     .register_funcs = register_funcs,
     .set = set,
     .set_error = set_error,
     .event_watcher = event_watcher,
+    .flush = flush,
     .destroy = destroy,
 };
@@ -0,0 +1,117 @@
+/*
+ * Copyright (C) 2015-2020  luastatus developers
+ *
+ * This file is part of luastatus.
+ *
+ * luastatus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * luastatus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with luastatus.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "key_cache.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libls/alloc_utils.h"
+#include "libls/string_.h"
+#include "libls/vector.h"
+
+#include "generator_utils.h"
+
+// The number of slots; a power of two.
+#define KEY_CACHE_NSLOTS 512
+
+// The maximum number of keys cached; kept at half the number of slots so that probe sequences stay
+// short.
+#define KEY_CACHE_MAX (KEY_CACHE_NSLOTS / 2)
+
+// FNV-1a.
+static uint32_t hash_key(const char *key, size_t nkey)
+{
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < nkey; ++i) {
+        h ^= (unsigned char) key[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static KeyKind classify(const char *key, size_t nkey)
+{
+    if (nkey == 4 && memcmp(key, "name", 4) == 0) {
+        return KEY_KIND_NAME;
+    }
+    if (nkey == 9 && memcmp(key, "separator", 9) == 0) {
+        return KEY_KIND_SEPARATOR;
+    }
+    return KEY_KIND_REGULAR;
+}
+
+// Fills /e/ for key /key/ of /nkey/ bytes.
+static void fill_entry(KeyCacheEntry *e, const char *key, size_t nkey, uint32_t hash)
+{
+    e->used = true;
+    ls_string_assign_b(&e->key, key, nkey);
+    e->hash = hash;
+    e->kind = classify(key, nkey);
+    LS_VECTOR_CLEAR(e->json);
+    append_json_escaped_b(&e->json, key, nkey);
+    ls_string_append_c(&e->json, ':');
+}
+
+void key_cache_init(KeyCache *c)
+{
+    *c = (KeyCache) {
+        .slots = LS_XNEW0(KeyCacheEntry, KEY_CACHE_NSLOTS),
+        .nentries = 0,
+        .scratch = {.used = false, .key = LS_VECTOR_NEW(), .json = LS_VECTOR_NEW()},
+    };
+}
+
+const KeyCacheEntry *key_cache_get(KeyCache *c, const char *key, size_t nkey)
+{
+    uint32_t hash = hash_key(key, nkey);
+    for (size_t i = hash & (KEY_CACHE_NSLOTS - 1); ; i = (i + 1) & (KEY_CACHE_NSLOTS - 1)) {
+        KeyCacheEntry *e = &c->slots[i];
+        if (!e->used) {
+            if (c->nentries == KEY_CACHE_MAX) {
+                break;
+            }
+            fill_entry(e, key, nkey, hash);
+            ++c->nentries;
+            return e;
+        }
+        if (e->hash == hash && e->key.size == nkey) {
+            // see DOCS/c_notes/empty-ranges-and-c-stdlib.md
+            if (!nkey || memcmp(e->key.data, key, nkey) == 0) {
+                return e;
+            }
+        }
+    }
+    // The cache is full.
+    fill_entry(&c->scratch, key, nkey, hash);
+    return &c->scratch;
+}
+
+void key_cache_destroy(KeyCache *c)
+{
+    for (size_t i = 0; i < KEY_CACHE_NSLOTS; ++i) {
+        LS_VECTOR_FREE(c->slots[i].key);
+        LS_VECTOR_FREE(c->slots[i].json);
+    }
+    free(c->slots);
+    LS_VECTOR_FREE(c->scratch.key);
+    LS_VECTOR_FREE(c->scratch.json);
+}
@@ -0,0 +1,72 @@
+/*
+ * Copyright (C) 2015-2020  luastatus developers
+ *
+ * This file is part of luastatus.
+ *
+ * luastatus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * luastatus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with luastatus.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef key_cache_h_
+#define key_cache_h_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "libls/string_.h"
+
+typedef enum {
+    KEY_KIND_REGULAR,
+    KEY_KIND_NAME,      // "name", which is set automatically
+    KEY_KIND_SEPARATOR, // "separator", which /no_separators/ should not override
+} KeyKind;
+
+typedef struct {
+    // Whether this slot is taken.
+    bool used;
+
+    LSString key;
+    uint32_t hash;
+
+    KeyKind kind;
+
+    // The key escaped as a JSON string, followed by a colon.
+    LSString json;
+} KeyCacheEntry;
+
+// A cache of keys of segment tables, so that the ones that repeat on every /set()/ (e.g.
+// "full_text" or "color") are escaped and classified once.
+//
+// Keys are looked up by contents, not by Lua string pointers: those differ between widgets, and
+// may be reused once a string is collected. After a few hundred distinct keys have been cached, new
+// ones are processed anew each time.
+//
+// Not thread-safe; calls to /set()/ are serialized anyway.
+typedef struct {
+    KeyCacheEntry *slots;
+    size_t nentries;
+
+    // Used for keys that do not fit in the cache.
+    KeyCacheEntry scratch;
+} KeyCache;
+
+void key_cache_init(KeyCache *c);
+
+// Returns the entry for key /key/ of /nkey/ bytes (which may contain NUL bytes). The entry is valid
+// until the next call to /key_cache_get()/ or /key_cache_destroy()/.
+const KeyCacheEntry *key_cache_get(KeyCache *c, const char *key, size_t nkey);
+
+void key_cache_destroy(KeyCache *c);
+
+#endif
@@ -20,11 +20,13 @@
 #ifndef priv_h_
 #define priv_h_
 
-#include <stdio.h>
 #include <stdbool.h>
 #include <stddef.h>
 
 #include "libls/string_.h"
+#include "libls/writer.h"
+
+#include "key_cache.h"
 
 typedef struct {
     size_t nwidgets;
@@ -34,11 +36,23 @@ typedef struct {
     // Temporary buffer for secondary buffering, to avoid unneeded redraws.
     LSString tmpbuf;
 
+    // Whether /bufs/ have changed since the last redraw.
+    bool dirty;
+
+    // Escaped and classified keys of segment tables, shared by all the widgets.
+    KeyCache key_cache;
+
     // Input file descriptor.
     int in_fd;
 
-    // /fdopen/'ed output file descritor.
-    FILE *out;
+    // Output file descriptor.
+    int out_fd;
+
+    // Writer of lines of output to /out_fd/.
+    LSWriter *writer;
+
+    // Pieces of the next line of output (see /redraw()/).
+    LSIovecs iov;
 
     bool noclickev;
 
@@ -21,12 +21,15 @@
 #include <sys/types.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <lua.h>
 #include <lauxlib.h>
 #include <errno.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <unistd.h>
 
-#include "include/barlib_v1.h"
+#include "include/barlib_v2.h"
 #include "include/sayf_macros.h"
 
 #include "libls/string_.h"
@@ -35,6 +38,8 @@
 #include "libls/parse_int.h"
 #include "libls/io_utils.h"
 #include "libls/alloc_utils.h"
+#include "libls/writer.h"
+#include "libls/usdt.h"
 
 #include "markup_utils.h"
 
@@ -46,13 +51,22 @@ typedef struct {
     // Temporary buffer for secondary buffering, to avoid unneeded redraws.
     LSString tmpbuf;
 
+    // Whether /bufs/ have changed since the last redraw.
+    bool dirty;
+
     char *sep;
 
     // /fdopen/'ed input file descriptor.
     FILE *in;
 
-    // /fdopen/'ed output file descriptor.
-    FILE *out;
+    // Output file descriptor.
+    int out_fd;
+
+    // Writer of lines of output to /out_fd/.
+    LSWriter *writer;
+
+    // Pieces of the next line of output (see /redraw()/).
+    LSIovecs iov;
 } Priv;
 
 static void destroy(LuastatusBarlibData *bd)
@@ -65,8 +79,13 @@ static void destroy(LuastatusBarlibData *bd)
     free(p->sep);
     if (p->in)
         fclose(p->in);
-    if (p->out)
-        fclose(p->out);
+    if (p->writer) {
+        LS_VERBOSEF(bd, "dropped %ju frame(s)", (uintmax_t) ls_writer_dropped(p->writer));
+        ls_writer_destroy(p->writer);
+    }
+    LS_VECTOR_FREE(p->iov);
+    if (p->out_fd >= 0)
+        close(p->out_fd);
     free(p);
 }
 
@@ -77,9 +96,12 @@ static int init(LuastatusBarlibData *bd, const char *const *opts, size_t nwidget
         .nwidgets = nwidgets,
         .bufs = LS_XNEW(LSString, nwidgets),
         .tmpbuf = LS_VECTOR_NEW(),
+        .dirty = false,
         .sep = NULL,
         .in = NULL,
-        .out = NULL,
+        .out_fd = -1,
+        .writer = NULL,
+        .iov = LS_VECTOR_NEW(),
     };
     for (size_t i = 0; i < nwidgets; ++i) {
         LS_VECTOR_INIT_RESERVE(p->bufs[i], 512);
@@ -126,10 +148,7 @@ static int init(LuastatusBarlibData *bd, const char *const *opts, size_t nwidget
         LS_FATALF(bd, "can't fdopen %d: %s", in_fd, ls_strerror_onstack(errno));
         goto error;
     }
-    if (!(p->out = fdopen(out_fd, "w"))) {
-        LS_FATALF(bd, "can't fdopen %d: %s", out_fd, ls_strerror_onstack(errno));
-        goto error;
-    }
+    p->out_fd = out_fd;
 
     // make CLOEXEC
     if (ls_make_cloexec(in_fd) < 0) {
@@ -141,6 +160,12 @@ static int init(LuastatusBarlibData *bd, const char *const *opts, size_t nwidget
         goto error;
     }
 
+    // start writing
+    if (!(p->writer = ls_writer_new(out_fd))) {
+        LS_FATALF(bd, "can't start writing to fd %d: %s", out_fd, ls_strerror_onstack(errno));
+        goto error;
+    }
+
     return LUASTATUS_OK;
 
 error:
@@ -169,27 +194,34 @@ static void register_funcs(LuastatusBarlibData *bd, lua_State *L)
 static bool redraw(LuastatusBarlibData *bd)
 {
     Priv *p = bd->priv;
-    FILE *out = p->out;
+    LSIovecs *out = &p->iov;
     size_t n = p->nwidgets;
     LSString *bufs = p->bufs;
     const char *sep = p->sep;
+    size_t nsep = strlen(sep);
 
+    LS_USDT1(luastatus, redraw__start, n);
+
+    // The line is described as a list of pointers into /bufs/ and /sep/, and only gets copied once,
+    // into the writer's pending frame.
+    LS_VECTOR_CLEAR(*out);
     bool first = true;
     for (size_t i = 0; i < n; ++i) {
         if (bufs[i].size) {
             if (!first) {
-                fputs(sep, out);
+                ls_iovecs_append(out, sep, nsep);
             }
-            fwrite(bufs[i].data, 1, bufs[i].size, out);
+            ls_iovecs_append(out, bufs[i].data, bufs[i].size);
             first = false;
         }
     }
-    putc_unlocked('\n', out);
-    fflush(out);
-    if (ferror(out)) {
+    ls_iovecs_append(out, "\n", 1);
+    if (ls_writer_push_framev(p->writer, out->data, out->size) < 0) {
         LS_FATALF(bd, "write error: %s", ls_strerror_onstack(errno));
+        LS_USDT1(luastatus, redraw__done, false);
         return false;
     }
+    LS_USDT1(luastatus, redraw__done, true);
     return true;
 }
 
@@ -244,14 +276,13 @@ static int set(LuastatusBarlibData *bd, lua_State *L, size_t widget_idx)
 
     if (!ls_string_eq(*buf, p->bufs[widget_idx])) {
         ls_string_swap(buf, &p->bufs[widget_idx]);
-        if (!redraw(bd)) {
-            return LUASTATUS_ERR;
-        }
+        p->dirty = true;
     }
     return LUASTATUS_OK;
 
 invalid_data:
     LS_VECTOR_CLEAR(p->bufs[widget_idx]);
+    p->dirty = true;
     return LUASTATUS_NONFATAL_ERR;
 }
 
@@ -259,8 +290,18 @@ static int set_error(LuastatusBarlibData *bd, size_t widget_idx)
 {
     Priv *p = bd->priv;
     ls_string_assign_s(&p->bufs[widget_idx], "%{B#f00}%{F#fff}(Error)%{B-}%{F-}");
-    if (!redraw(bd)) {
-        return LUASTATUS_ERR;
+    p->dirty = true;
+    return LUASTATUS_OK;
+}
+
+static int flush(LuastatusBarlibData *bd)
+{
+    Priv *p = bd->priv;
+    if (p->dirty) {
+        if (!redraw(bd)) {
+            return LUASTATUS_ERR;
+        }
+        p->dirty = false;
     }
     return LUASTATUS_OK;
 }
@@ -298,11 +339,12 @@ static int event_watcher(LuastatusBarlibData *bd, LuastatusBarlibEWFuncs funcs)
     return LUASTATUS_ERR;
 }
 
-LuastatusBarlibIface luastatus_barlib_iface_v1 = {
+LuastatusBarlibIface luastatus_barlib_iface_v2 = {
     .init = init,
     .register_funcs = register_funcs,
     .set = set,
     .set_error = set_error,
     .event_watcher = event_watcher,
+    .flush = flush,
     .destroy = destroy,
 };
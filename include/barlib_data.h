@@ -22,6 +22,7 @@
 
 #include <lua.h>
 #include <stddef.h>
+#include <stdbool.h>
 
 #include "common.h"
 
@@ -48,6 +49,14 @@ typedef struct {
 
     // See DOCS/design/map_get.md.
     void ** (*map_get)(void *userdata, const char *key);
+
+    // Pauses (if /paused/ is true) or resumes (if /paused/ is false) the widgets, e.g. when the bar
+    // becomes invisible or visible again. While paused, the widgets do not do any work they can
+    // avoid doing (see /LuastatusPluginIface_v2/'s /pause()/ in plugin_data.h).
+    //
+    // May be called from any thread at any time after /init()/ has been entered; is
+    // async-signal-safe.
+    void (*set_paused)(void *userdata, bool paused);
 } LuastatusBarlibData_v1;
 
 typedef struct {
@@ -103,6 +112,11 @@ typedef struct {
     //
     // It is guaranteed that /L/'s stack has at least 15 free slots.
     //
+    // If the data is equal (tables being compared by contents) to the data of the last successful
+    // call for this widget, with no /set_error()/ call in between, luastatus does not call this
+    // function at all, unless the barlib sets the value behind the
+    // /"flag:barlib_wants:unchanged_sets"/ key of /map_get()/ to a non-null pointer in /init()/.
+    //
     // It must return:
     //
     //     /LUASTATUS_OK/ on success.
@@ -157,4 +171,47 @@ typedef struct {
     void (*destroy)(LuastatusBarlibData_v1 *bd);
 } LuastatusBarlibIface_v1;
 
+// The second revision of the barlib interface.
+//
+// The difference from the first one is that /set()/ and /set_error()/ should only update the
+// barlib's internal state, and not redraw anything; luastatus calls /flush()/ once it wants the bar
+// to be redrawn. This allows luastatus to coalesce updates of multiple widgets that happen within a
+// short time window into a single redraw (see the /-F/ option).
+//
+// The /LuastatusBarlibData_v1/ and /LuastatusBarlibEWFuncs_v1/ structures are used as is.
+
+typedef struct {
+    // The same as in /LuastatusBarlibIface_v1/.
+    int (*init)(LuastatusBarlibData_v1 *bd, const char *const *opts, size_t nwidgets);
+
+    // The same as in /LuastatusBarlibIface_v1/.
+    void (*register_funcs)(LuastatusBarlibData_v1 *bd, lua_State *L);
+
+    // The same as in /LuastatusBarlibIface_v1/, except that it should not redraw anything.
+    int (*set)(LuastatusBarlibData_v1 *bd, lua_State *L, size_t widget_idx);
+
+    // The same as in /LuastatusBarlibIface_v1/, except that it should not redraw anything.
+    int (*set_error)(LuastatusBarlibData_v1 *bd, size_t widget_idx);
+
+    // The same as in /LuastatusBarlibIface_v1/.
+    int (*event_watcher)(LuastatusBarlibData_v1 *bd, LuastatusBarlibEWFuncs_v1 funcs);
+
+    // This function should redraw the bar so that it reflects all the changes made by /set()/ and
+    // /set_error()/ since the last call to /flush()/. It may skip redrawing if nothing has actually
+    // changed.
+    //
+    // Calls to /flush()/ are serialized with calls to /set()/ and /set_error()/.
+    //
+    // It must return:
+    //
+    //     /LUASTATUS_OK/ on success;
+    //
+    //     /LUASTATUS_ERR/ on a fatal error, e.g. if the connection to the display has been lost.
+    //
+    int (*flush)(LuastatusBarlibData_v1 *bd);
+
+    // The same as in /LuastatusBarlibIface_v1/.
+    void (*destroy)(LuastatusBarlibData_v1 *bd);
+} LuastatusBarlibIface_v2;
+
 #endif
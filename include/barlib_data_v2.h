@@ -0,0 +1,30 @@
+/*
+ * Copyright (C) 2015-2020  luastatus developers
+ *
+ * This file is part of luastatus.
+ *
+ * luastatus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * luastatus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with luastatus.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef luastatus_include_barlib_data_v2_h_
+#define luastatus_include_barlib_data_v2_h_
+
+#include "barlib_data.h"
+
+#define LuastatusBarlibIface   LuastatusBarlibIface_v2
+#define LuastatusBarlibSayf    LuastatusBarlibSayf_v1
+#define LuastatusBarlibData    LuastatusBarlibData_v1
+#define LuastatusBarlibEWFuncs LuastatusBarlibEWFuncs_v1
+
+#endif
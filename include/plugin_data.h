@@ -77,6 +77,9 @@ typedef struct {
     //
     // It is guaranteed that /L/'s stack has at least 15 free slots.
     //
+    // Note that this function may be called concurrently for different widgets (see
+    // DOCS/design/map_get.md on how to synchronize).
+    //
     // It should return:
     //
     //     /LUASTATUS_OK/ on success.
@@ -125,4 +128,90 @@ typedef struct {
     void (*destroy)(LuastatusPluginData_v1 *pd);
 } LuastatusPluginIface_v1;
 
+// The second revision of the plugin interface.
+//
+// Instead of running its own event loop in a dedicated thread, a plugin implementing this
+// interface registers file descriptors and a timeout with luastatus' event loop, which invokes the
+// plugin's callbacks from a small pool of threads shared by all such widgets. Callbacks of the same
+// widget never run concurrently.
+//
+// None of the callbacks should block, as this would delay other widgets' updates.
+//
+// The /LuastatusPluginData_v1/ structure is used as is.
+
+typedef struct {
+    // The same as in /LuastatusPluginRunFuncs_v1/.
+    lua_State *(*call_begin) (void *userdata);
+    void       (*call_end)   (void *userdata);
+    void       (*call_cancel)(void *userdata);
+
+    // Starts watching file descriptor /fd/ for events /events/ (a mask of /POLLIN/, /POLLOUT/ and
+    // /POLLPRI/); once /fd/ becomes ready, /on_fd()/ gets called. If /fd/ is already being watched,
+    // its event mask is replaced. /fd/ should be non-blocking.
+    //
+    // Returns /0/ on success, or /-1/ on failure (and sets /errno/).
+    int (*watch_fd)(void *userdata, int fd, int events);
+
+    // Stops watching file descriptor /fd/. This must be done before /fd/ is closed.
+    //
+    // Returns /0/ on success, or /-1/ if /fd/ is not being watched (and sets /errno/).
+    int (*unwatch_fd)(void *userdata, int fd);
+
+    // Arms the widget's timer so that /on_timeout()/ gets called in /tmo/ seconds; the previous
+    // timeout, if any, is replaced. A negative /tmo/ disarms the timer.
+    void (*set_timeout)(void *userdata, double tmo);
+} LuastatusPluginReactorFuncs_v2;
+
+typedef struct {
+    // The same as in /LuastatusPluginIface_v1/.
+    int (*init)(LuastatusPluginData_v1 *pd, lua_State *L);
+
+    // The same as in /LuastatusPluginIface_v1/.
+    void (*register_funcs)(LuastatusPluginData_v1 *pd, lua_State *L);
+
+    // This function is called once, after all the widgets and the barlib have been initialized, in
+    // place of /LuastatusPluginIface_v1/'s /run()/. It should register the file descriptors and/or
+    // the timeout the widget is interested in with /funcs/, and may also update the widget (see
+    // the description of /LuastatusPluginIface_v1/'s /run()/ on how this is done).
+    //
+    // This function, as well as /on_fd()/ and /on_timeout()/, should return:
+    //
+    //     /LUASTATUS_OK/ if the widget should continue running;
+    //
+    //     /LUASTATUS_ERR/ on an unrecoverable failure (this is what returning from
+    //     /LuastatusPluginIface_v1/'s /run()/ means).
+    //
+    int (*start)(LuastatusPluginData_v1 *pd, LuastatusPluginReactorFuncs_v2 funcs);
+
+    // This function is called when a file descriptor /fd/ registered with /funcs.watch_fd()/ is
+    // ready; /revents/ is a mask of /POLL*/ flags.
+    //
+    // It may be called spuriously, so /fd/ should be non-blocking.
+    //
+    // May be /NULL/ if the plugin never watches any file descriptors.
+    int (*on_fd)(LuastatusPluginData_v1 *pd, LuastatusPluginReactorFuncs_v2 funcs, int fd,
+                 int revents);
+
+    // This function is called when the timeout set with /funcs.set_timeout()/ expires.
+    //
+    // May be /NULL/ if the plugin never sets a timeout.
+    int (*on_timeout)(LuastatusPluginData_v1 *pd, LuastatusPluginReactorFuncs_v2 funcs);
+
+    // These functions are called when the widgets get paused (for example, when the bar is hidden)
+    // and resumed, correspondingly. While paused, the widget's timeout expires silently, and calls
+    // made with /funcs.call_begin()/ are deferred until resumption (only the latest one is then
+    // actually passed to /cb/); on resumption, /on_timeout()/ is called once if the timeout has
+    // expired in the meantime, after /resume()/. A plugin that, for example, keeps a connection
+    // that it polls over may want to do something about it in these functions.
+    //
+    // They return values the same way /on_timeout()/ does.
+    //
+    // Either may be /NULL/.
+    int (*pause)(LuastatusPluginData_v1 *pd, LuastatusPluginReactorFuncs_v2 funcs);
+    int (*resume)(LuastatusPluginData_v1 *pd, LuastatusPluginReactorFuncs_v2 funcs);
+
+    // The same as in /LuastatusPluginIface_v1/.
+    void (*destroy)(LuastatusPluginData_v1 *pd);
+} LuastatusPluginIface_v2;
+
 #endif
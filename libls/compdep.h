@@ -34,10 +34,12 @@
 #   define LS_ATTR_UNUSED           __attribute__((unused))
 #   define LS_ATTR_PRINTF(N_, M_)   __attribute__((format(printf, N_, M_)))
 #   define LS_ATTR_NORETURN         __attribute__((noreturn))
+#   define LS_ATTR_WEAK             __attribute__((weak))
 #else
 #   define LS_ATTR_UNUSED           /*nothing*/
 #   define LS_ATTR_PRINTF(N_, M_)   /*nothing*/
 #   define LS_ATTR_NORETURN         /*nothing*/
+#   define LS_ATTR_WEAK             /*nothing*/
 #endif
 
 #if LS_GCC_VERSION >= 40500 || LS_CLANG_HAS_BUILTIN(__builtin_unreachable)
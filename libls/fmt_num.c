@@ -0,0 +1,329 @@
+/*
+ * Copyright (C) 2015-2020  luastatus developers
+ *
+ * This file is part of luastatus.
+ *
+ * luastatus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * luastatus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with luastatus.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "fmt_num.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+static const uint32_t POW10[] = {
+    1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000,
+};
+
+// Writes the decimal digits of /v/ into /buf/. Returns the number of digits written.
+static size_t fmt_uint64(char *buf, uint64_t v)
+{
+    char tmp[20];
+    size_t n = 0;
+    do {
+        tmp[n++] = '0' + v % 10;
+        v /= 10;
+    } while (v);
+    for (size_t i = 0; i < n; ++i) {
+        buf[i] = tmp[n - 1 - i];
+    }
+    return n;
+}
+
+size_t ls_fmt_int64(char *buf, int64_t v)
+{
+    if (v < 0) {
+        buf[0] = '-';
+        // Negate in unsigned arithmetic, so that /INT64_MIN/ is handled correctly.
+        return 1 + fmt_uint64(buf + 1, -(uint64_t) v);
+    }
+    return fmt_uint64(buf, v);
+}
+
+// What follows is an implementation of Grisu2, closely following the one by Milo Yip (as found in
+// RapidJSON).
+
+// A "do-it-yourself floating-point" number /f * 2^e/.
+typedef struct {
+    uint64_t f;
+    int e;
+} DiyFp;
+
+#define DP_SIGNIFICAND_SIZE 52
+#define DP_EXPONENT_BIAS (0x3FF + DP_SIGNIFICAND_SIZE)
+#define DP_MIN_EXPONENT (-DP_EXPONENT_BIAS)
+#define DP_EXPONENT_MASK ((uint64_t) 0x7FF0000000000000)
+#define DP_SIGNIFICAND_MASK ((uint64_t) 0x000FFFFFFFFFFFFF)
+#define DP_HIDDEN_BIT ((uint64_t) 0x0010000000000000)
+
+static DiyFp diyfp_from_double(double d)
+{
+    uint64_t u;
+    memcpy(&u, &d, sizeof(u));
+    int biased_e = (u & DP_EXPONENT_MASK) >> DP_SIGNIFICAND_SIZE;
+    uint64_t significand = u & DP_SIGNIFICAND_MASK;
+    if (biased_e) {
+        return (DiyFp) {significand + DP_HIDDEN_BIT, biased_e - DP_EXPONENT_BIAS};
+    } else {
+        return (DiyFp) {significand, DP_MIN_EXPONENT + 1};
+    }
+}
+
+// Returns the upper 64 bits of the 128-bit product, rounded.
+static DiyFp diyfp_mul(DiyFp x, DiyFp y)
+{
+    const uint64_t M32 = 0xFFFFFFFF;
+    uint64_t a = x.f >> 32, b = x.f & M32;
+    uint64_t c = y.f >> 32, d = y.f & M32;
+    uint64_t ac = a * c, bc = b * c, ad = a * d, bd = b * d;
+    uint64_t tmp = (bd >> 32) + (ad & M32) + (bc & M32);
+    tmp += (uint64_t) 1 << 31; // round
+    return (DiyFp) {ac + (ad >> 32) + (bc >> 32) + (tmp >> 32), x.e + y.e + 64};
+}
+
+static DiyFp diyfp_normalize(DiyFp x)
+{
+    while (!(x.f & ((uint64_t) 1 << 63))) {
+        x.f <<= 1;
+        --x.e;
+    }
+    return x;
+}
+
+// Computes the boundaries /*m/ and /*p/ of the interval of reals that round to /v/, normalized to
+// the same exponent.
+static void diyfp_boundaries(DiyFp v, DiyFp *m, DiyFp *p)
+{
+    DiyFp pl = {(v.f << 1) + 1, v.e - 1};
+    while (!(pl.f & (DP_HIDDEN_BIT << 1))) {
+        pl.f <<= 1;
+        --pl.e;
+    }
+    pl.f <<= 64 - DP_SIGNIFICAND_SIZE - 2;
+    pl.e -= 64 - DP_SIGNIFICAND_SIZE - 2;
+
+    // The lower boundary is closer if /v/ is a power of two (except for the smallest normal one).
+    DiyFp mi = v.f == DP_HIDDEN_BIT
+        ? (DiyFp) {(v.f << 2) - 1, v.e - 2}
+        : (DiyFp) {(v.f << 1) - 1, v.e - 1};
+    mi.f <<= mi.e - pl.e;
+    mi.e = pl.e;
+
+    *m = mi;
+    *p = pl;
+}
+
+// Normalized 10^k for k = -348, -340, ..., 340.
+static const uint64_t CACHED_POWERS_F[] = {
+    0xfa8fd5a0081c0288, 0xbaaee17fa23ebf76, 0x8b16fb203055ac76,
+    0xcf42894a5dce35ea, 0x9a6bb0aa55653b2d, 0xe61acf033d1a45df,
+    0xab70fe17c79ac6ca, 0xff77b1fcbebcdc4f, 0xbe5691ef416bd60c,
+    0x8dd01fad907ffc3c, 0xd3515c2831559a83, 0x9d71ac8fada6c9b5,
+    0xea9c227723ee8bcb, 0xaecc49914078536d, 0x823c12795db6ce57,
+    0xc21094364dfb5637, 0x9096ea6f3848984f, 0xd77485cb25823ac7,
+    0xa086cfcd97bf97f4, 0xef340a98172aace5, 0xb23867fb2a35b28e,
+    0x84c8d4dfd2c63f3b, 0xc5dd44271ad3cdba, 0x936b9fcebb25c996,
+    0xdbac6c247d62a584, 0xa3ab66580d5fdaf6, 0xf3e2f893dec3f126,
+    0xb5b5ada8aaff80b8, 0x87625f056c7c4a8b, 0xc9bcff6034c13053,
+    0x964e858c91ba2655, 0xdff9772470297ebd, 0xa6dfbd9fb8e5b88f,
+    0xf8a95fcf88747d94, 0xb94470938fa89bcf, 0x8a08f0f8bf0f156b,
+    0xcdb02555653131b6, 0x993fe2c6d07b7fac, 0xe45c10c42a2b3b06,
+    0xaa242499697392d3, 0xfd87b5f28300ca0e, 0xbce5086492111aeb,
+    0x8cbccc096f5088cc, 0xd1b71758e219652c, 0x9c40000000000000,
+    0xe8d4a51000000000, 0xad78ebc5ac620000, 0x813f3978f8940984,
+    0xc097ce7bc90715b3, 0x8f7e32ce7bea5c70, 0xd5d238a4abe98068,
+    0x9f4f2726179a2245, 0xed63a231d4c4fb27, 0xb0de65388cc8ada8,
+    0x83c7088e1aab65db, 0xc45d1df942711d9a, 0x924d692ca61be758,
+    0xda01ee641a708dea, 0xa26da3999aef774a, 0xf209787bb47d6b85,
+    0xb454e4a179dd1877, 0x865b86925b9bc5c2, 0xc83553c5c8965d3d,
+    0x952ab45cfa97a0b3, 0xde469fbd99a05fe3, 0xa59bc234db398c25,
+    0xf6c69a72a3989f5c, 0xb7dcbf5354e9bece, 0x88fcf317f22241e2,
+    0xcc20ce9bd35c78a5, 0x98165af37b2153df, 0xe2a0b5dc971f303a,
+    0xa8d9d1535ce3b396, 0xfb9b7cd9a4a7443c, 0xbb764c4ca7a44410,
+    0x8bab8eefb6409c1a, 0xd01fef10a657842c, 0x9b10a4e5e9913129,
+    0xe7109bfba19c0c9d, 0xac2820d9623bf429, 0x80444b5e7aa7cf85,
+    0xbf21e44003acdd2d, 0x8e679c2f5e44ff8f, 0xd433179d9c8cb841,
+    0x9e19db92b4e31ba9, 0xeb96bf6ebadf77d9, 0xaf87023b9bf0ee6b,
+};
+static const int16_t CACHED_POWERS_E[] = {
+    -1220, -1193, -1166, -1140, -1113, -1087, -1060, -1034, -1007, -980,
+    -954, -927, -901, -874, -847, -821, -794, -768, -741, -715,
+    -688, -661, -635, -608, -582, -555, -529, -502, -475, -449,
+    -422, -396, -369, -343, -316, -289, -263, -236, -210, -183,
+    -157, -130, -103, -77, -50, -24, 3, 30, 56, 83,
+    109, 136, 162, 189, 216, 242, 269, 295, 322, 348,
+    375, 402, 428, 455, 481, 508, 534, 561, 588, 614,
+    641, 667, 694, 720, 747, 774, 800, 827, 853, 880,
+    907, 933, 960, 986, 1013, 1039, 1066,
+};
+
+// Returns a cached power /c/ of ten such that /c * 2^e/ has its binary exponent in a range suitable
+// for /digit_gen()/, and stores minus its decimal exponent into /*k/.
+static DiyFp get_cached_power(int e, int *k)
+{
+    double dk = (-61 - e) * 0.30102999566398114 + 347; // dk must be positive, so can do ceiling
+    int ik = dk;
+    if (dk - ik > 0.0) {
+        ++ik;
+    }
+    unsigned index = (ik >> 3) + 1;
+    *k = -(-348 + (int) (index << 3));
+    return (DiyFp) {CACHED_POWERS_F[index], CACHED_POWERS_E[index]};
+}
+
+static void grisu_round(char *buf, size_t len, uint64_t delta, uint64_t rest, uint64_t ten_kappa,
+                        uint64_t wp_w)
+{
+    while (rest < wp_w && delta - rest >= ten_kappa &&
+           (rest + ten_kappa < wp_w || wp_w - rest > rest + ten_kappa - wp_w))
+    {
+        --buf[len - 1];
+        rest += ten_kappa;
+    }
+}
+
+static int count_decimal_digits32(uint32_t n)
+{
+    int r = 1;
+    while (r < 10 && n >= POW10[r]) {
+        ++r;
+    }
+    return r;
+}
+
+static size_t digit_gen(DiyFp w, DiyFp mp, uint64_t delta, char *buf, int *k)
+{
+    DiyFp one = {(uint64_t) 1 << -mp.e, mp.e};
+    uint64_t wp_w = mp.f - w.f;
+    uint32_t p1 = mp.f >> -one.e;
+    uint64_t p2 = mp.f & (one.f - 1);
+    int kappa = count_decimal_digits32(p1);
+    size_t len = 0;
+
+    while (kappa > 0) {
+        uint32_t d = p1 / POW10[kappa - 1];
+        p1 %= POW10[kappa - 1];
+        if (d || len) {
+            buf[len++] = '0' + d;
+        }
+        --kappa;
+        uint64_t tmp = ((uint64_t) p1 << -one.e) + p2;
+        if (tmp <= delta) {
+            *k += kappa;
+            grisu_round(buf, len, delta, tmp, (uint64_t) POW10[kappa] << -one.e, wp_w);
+            return len;
+        }
+    }
+
+    for (;;) {
+        p2 *= 10;
+        delta *= 10;
+        char d = p2 >> -one.e;
+        if (d || len) {
+            buf[len++] = '0' + d;
+        }
+        p2 &= one.f - 1;
+        --kappa;
+        if (p2 < delta) {
+            *k += kappa;
+            int index = -kappa;
+            grisu_round(buf, len, delta, p2, one.f, wp_w * (index < 10 ? POW10[index] : 0));
+            return len;
+        }
+    }
+}
+
+// Writes the digits of positive finite /v/ into /buf/ so that /v = digits * 10^(*k)/. Returns the
+// number of digits written (at most 17).
+static size_t grisu2(double v, char *buf, int *k)
+{
+    DiyFp dv = diyfp_from_double(v);
+    DiyFp w_m, w_p;
+    diyfp_boundaries(dv, &w_m, &w_p);
+
+    DiyFp c_mk = get_cached_power(w_p.e, k);
+    DiyFp w = diyfp_mul(diyfp_normalize(dv), c_mk);
+    DiyFp wp = diyfp_mul(w_p, c_mk);
+    DiyFp wm = diyfp_mul(w_m, c_mk);
+    ++wm.f;
+    --wp.f;
+    return digit_gen(w, wp, wp.f - wm.f, buf, k);
+}
+
+static size_t write_exponent(char *buf, int e)
+{
+    size_t n = 0;
+    buf[n++] = 'e';
+    buf[n++] = e < 0 ? '-' : '+';
+    return n + fmt_uint64(buf + n, e < 0 ? -e : e);
+}
+
+// Lays out /len/ digits at the beginning of /buf/, which represent /digits * 10^k/, the way
+// JavaScript does. Returns the resulting length.
+static size_t prettify(char *buf, size_t len, int k)
+{
+    int n = len;
+    int kk = n + k; // 10^(kk-1) <= v < 10^kk
+
+    if (k >= 0 && kk <= 21) {
+        // 1234e7 -> 12340000000
+        memset(buf + n, '0', k);
+        return kk;
+    }
+    if (kk > 0 && kk <= 21) {
+        // 1234e-2 -> 12.34
+        memmove(buf + kk + 1, buf + kk, n - kk);
+        buf[kk] = '.';
+        return n + 1;
+    }
+    if (kk > -6 && kk <= 0) {
+        // 1234e-6 -> 0.001234
+        int offset = 2 - kk;
+        memmove(buf + offset, buf, n);
+        buf[0] = '0';
+        buf[1] = '.';
+        memset(buf + 2, '0', offset - 2);
+        return n + offset;
+    }
+    if (n == 1) {
+        // 1e30
+        return 1 + write_exponent(buf + 1, kk - 1);
+    }
+    // 1234e30 -> 1.234e+33
+    memmove(buf + 2, buf + 1, n - 1);
+    buf[1] = '.';
+    return n + 1 + write_exponent(buf + n + 1, kk - 1);
+}
+
+size_t ls_fmt_double(char *buf, double v)
+{
+    // Integers that are exactly representable take the fast path; this also covers zero.
+    if (v > -9007199254740992.0 && v < 9007199254740992.0) {
+        int64_t i = v;
+        if (i == v) {
+            return ls_fmt_int64(buf, i);
+        }
+    }
+
+    size_t nsign = 0;
+    if (v < 0) {
+        buf[nsign++] = '-';
+        v = -v;
+    }
+    int k;
+    size_t len = grisu2(v, buf + nsign, &k);
+    return nsign + prettify(buf + nsign, len, k);
+}
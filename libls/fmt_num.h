@@ -0,0 +1,57 @@
+/*
+ * Copyright (C) 2015-2020  luastatus developers
+ *
+ * This file is part of luastatus.
+ *
+ * luastatus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * luastatus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with luastatus.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef ls_fmt_num_h_
+#define ls_fmt_num_h_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "string_.h"
+#include "compdep.h"
+
+// Size of a buffer that is enough for any output of /ls_fmt_int64()/ or /ls_fmt_double()/.
+#define LS_FMT_NUM_BUFSZ 32
+
+// Writes the decimal representation of /v/ into /buf/, which must be at least /LS_FMT_NUM_BUFSZ/
+// bytes long, without a terminating NUL. Returns the number of bytes written.
+size_t ls_fmt_int64(char *buf, int64_t v);
+
+// Writes the shortest (in almost all cases; see below) representation of finite /v/ that reads
+// back as exactly /v/ into /buf/, which must be at least /LS_FMT_NUM_BUFSZ/ bytes long, without a
+// terminating NUL. Returns the number of bytes written.
+//
+// Integral values below 2^53 in magnitude are written as integers, without a decimal point or an
+// exponent. Otherwise, the format is that of JavaScript's /Number.prototype.toString()/, e.g.
+// /0.1/, /1.5e-7/ or /1e+21/; it is valid in JSON.
+//
+// The digits are generated with the Grisu2 algorithm (Florian Loitsch, "Printing Floating-Point
+// Numbers Quickly and Accurately with Integers", 2010), which produces the shortest
+// representation for about 99.9% of the values, and a correct, one digit longer, one for the
+// rest.
+size_t ls_fmt_double(char *buf, double v);
+
+// Appends the output of /ls_fmt_double()/ for /v/ to /s/.
+LS_INHEADER void ls_string_append_double(LSString *s, double v)
+{
+    LS_VECTOR_ENSURE(*s, s->size + LS_FMT_NUM_BUFSZ);
+    s->size += ls_fmt_double(s->data + s->size, v);
+}
+
+#endif
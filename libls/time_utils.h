@@ -21,6 +21,7 @@
 #define ls_time_utils_h_
 
 #include <time.h>
+#include <limits.h>
 #include <sys/time.h>
 #include <errno.h>
 
@@ -0,0 +1,57 @@
+/*
+ * Copyright (C) 2015-2020  luastatus developers
+ *
+ * This file is part of luastatus.
+ *
+ * luastatus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * luastatus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with luastatus.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef ls_usdt_h_
+#define ls_usdt_h_
+
+// User-level statically defined tracepoints (USDT), that is, probes that tools like bpftrace, perf
+// or systemtap can attach to at run time.
+//
+// They are only compiled in if luastatus is built with /-DWITH_USDT=ON/, which defines
+// /LS_WITH_USDT/ to /1/. An unattached probe costs a single /nop/ instruction plus whatever it takes
+// to compute its arguments, so probes should only be passed values that are at hand anyway.
+//
+// /Provider_/ and /Name_/ are bare identifiers; a double underscore in /Name_/ shows up as a dash
+// in the tools (e.g. /cb__start/ becomes /cb-start/ for systemtap; bpftrace keeps it as is).
+//
+// When the probes are not compiled in, the arguments are still evaluated (and then discarded), so
+// that variables only used in probes do not trigger warnings.
+
+#if LS_WITH_USDT
+#   include <sys/sdt.h>
+#   define LS_USDT0(Provider_, Name_) \
+        DTRACE_PROBE(Provider_, Name_)
+#   define LS_USDT1(Provider_, Name_, A1_) \
+        DTRACE_PROBE1(Provider_, Name_, A1_)
+#   define LS_USDT2(Provider_, Name_, A1_, A2_) \
+        DTRACE_PROBE2(Provider_, Name_, A1_, A2_)
+#   define LS_USDT3(Provider_, Name_, A1_, A2_, A3_) \
+        DTRACE_PROBE3(Provider_, Name_, A1_, A2_, A3_)
+#else
+#   define LS_USDT0(Provider_, Name_) \
+        do { } while (0)
+#   define LS_USDT1(Provider_, Name_, A1_) \
+        do { (void) (A1_); } while (0)
+#   define LS_USDT2(Provider_, Name_, A1_, A2_) \
+        do { (void) (A1_); (void) (A2_); } while (0)
+#   define LS_USDT3(Provider_, Name_, A1_, A2_, A3_) \
+        do { (void) (A1_); (void) (A2_); (void) (A3_); } while (0)
+#endif
+
+#endif
@@ -0,0 +1,247 @@
+/*
+ * Copyright (C) 2015-2020  luastatus developers
+ *
+ * This file is part of luastatus.
+ *
+ * luastatus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * luastatus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with luastatus.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "writer.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/uio.h>
+
+#include "alloc_utils.h"
+#include "string_.h"
+#include "vector.h"
+#include "panic.h"
+#include "usdt.h"
+
+struct LSWriter {
+    int fd;
+
+    // The original file status flags of /fd/, to be restored on destruction.
+    int fd_flags;
+
+    pthread_mutex_t mtx;
+
+    // Signalled when /pending/ gets data or /quit/ gets set.
+    pthread_cond_t cond;
+
+    // The data to be written next; the writer thread takes all of it at once. If /has_frame/ is
+    // set, everything past the first /nkept/ bytes is the pending frame.
+    LSString pending;
+    size_t nkept;
+    bool has_frame;
+
+    // /errno/ of the write that has failed, or /0/ if none has.
+    int error;
+
+    bool quit;
+
+    uint64_t dropped;
+
+    pthread_t thread;
+};
+
+// Writes the whole /buf/ to non-blocking /fd/, waiting for it to become writable as needed.
+// Returns /0/ on success, or the /errno/ of the failed call.
+static int write_all(int fd, const char *buf, size_t nbuf)
+{
+    while (nbuf) {
+        ssize_t w = write(fd, buf, nbuf);
+        if (w < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                return errno;
+            }
+            struct pollfd pfd = {.fd = fd, .events = POLLOUT};
+            if (poll(&pfd, 1, -1) < 0 && errno != EINTR) {
+                return errno;
+            }
+            // If /pfd.revents/ has /POLLERR/, the next /write()/ reports the error.
+            continue;
+        }
+        buf += w;
+        nbuf -= w;
+    }
+    return 0;
+}
+
+static void *writer_thread(void *arg)
+{
+    LSWriter *w = arg;
+    LSString cur = LS_VECTOR_NEW();
+
+    LS_PTH_CHECK(pthread_mutex_lock(&w->mtx));
+    while (true) {
+        while (!w->pending.size && !w->quit) {
+            LS_PTH_CHECK(pthread_cond_wait(&w->cond, &w->mtx));
+        }
+        if (!w->pending.size) {
+            break;
+        }
+        LSString tmp = cur;
+        cur = w->pending;
+        w->pending = tmp;
+        LS_VECTOR_CLEAR(w->pending);
+        w->nkept = 0;
+        w->has_frame = false;
+
+        LS_PTH_CHECK(pthread_mutex_unlock(&w->mtx));
+        int r = write_all(w->fd, cur.data, cur.size);
+        LS_PTH_CHECK(pthread_mutex_lock(&w->mtx));
+
+        if (r) {
+            w->error = r;
+            break;
+        }
+    }
+    LS_PTH_CHECK(pthread_mutex_unlock(&w->mtx));
+
+    LS_VECTOR_FREE(cur);
+    return NULL;
+}
+
+LSWriter *ls_writer_new(int fd)
+{
+    int fd_flags = fcntl(fd, F_GETFL);
+    if (fd_flags < 0 || fcntl(fd, F_SETFL, fd_flags | O_NONBLOCK) < 0) {
+        return NULL;
+    }
+
+    LSWriter *w = LS_XNEW(LSWriter, 1);
+    *w = (LSWriter) {
+        .fd = fd,
+        .fd_flags = fd_flags,
+        .pending = LS_VECTOR_NEW(),
+        .nkept = 0,
+        .has_frame = false,
+        .error = 0,
+        .quit = false,
+        .dropped = 0,
+    };
+    LS_PTH_CHECK(pthread_mutex_init(&w->mtx, NULL));
+    LS_PTH_CHECK(pthread_cond_init(&w->cond, NULL));
+
+    int r = pthread_create(&w->thread, NULL, writer_thread, w);
+    if (r) {
+        LS_PTH_CHECK(pthread_cond_destroy(&w->cond));
+        LS_PTH_CHECK(pthread_mutex_destroy(&w->mtx));
+        free(w);
+        fcntl(fd, F_SETFL, fd_flags);
+        errno = r;
+        return NULL;
+    }
+    return w;
+}
+
+// Must be called with /w->mtx/ locked. If a previous write has failed, sets /errno/ and returns
+// /false/.
+static bool check_error(LSWriter *w)
+{
+    if (w->error) {
+        errno = w->error;
+        return false;
+    }
+    return true;
+}
+
+int ls_writer_push(LSWriter *w, const char *buf, size_t nbuf)
+{
+    int ret = -1;
+    LS_PTH_CHECK(pthread_mutex_lock(&w->mtx));
+    if (!check_error(w)) {
+        goto done;
+    }
+    ls_string_append_b(&w->pending, buf, nbuf);
+    // A pending frame, if any, is now followed by data that must be written, so it can no longer be
+    // dropped.
+    w->nkept = w->pending.size;
+    w->has_frame = false;
+    LS_PTH_CHECK(pthread_cond_signal(&w->cond));
+    ret = 0;
+done:
+    LS_PTH_CHECK(pthread_mutex_unlock(&w->mtx));
+    return ret;
+}
+
+int ls_writer_push_framev(LSWriter *w, const struct iovec *iov, size_t niov)
+{
+    size_t nframe = 0;
+    for (size_t i = 0; i < niov; ++i) {
+        nframe += iov[i].iov_len;
+    }
+
+    int ret = -1;
+    LS_PTH_CHECK(pthread_mutex_lock(&w->mtx));
+    if (!check_error(w)) {
+        goto done;
+    }
+    if (w->has_frame) {
+        w->pending.size = w->nkept;
+        ++w->dropped;
+        LS_USDT1(luastatus, frame__dropped, w->dropped);
+    }
+    LS_VECTOR_ENSURE(w->pending, w->pending.size + nframe);
+    for (size_t i = 0; i < niov; ++i) {
+        // see DOCS/c_notes/empty-ranges-and-c-stdlib.md
+        if (iov[i].iov_len) {
+            memcpy(w->pending.data + w->pending.size, iov[i].iov_base, iov[i].iov_len);
+            w->pending.size += iov[i].iov_len;
+        }
+    }
+    w->has_frame = true;
+    LS_PTH_CHECK(pthread_cond_signal(&w->cond));
+    ret = 0;
+done:
+    LS_PTH_CHECK(pthread_mutex_unlock(&w->mtx));
+    return ret;
+}
+
+uint64_t ls_writer_dropped(LSWriter *w)
+{
+    LS_PTH_CHECK(pthread_mutex_lock(&w->mtx));
+    uint64_t r = w->dropped;
+    LS_PTH_CHECK(pthread_mutex_unlock(&w->mtx));
+    return r;
+}
+
+void ls_writer_destroy(LSWriter *w)
+{
+    LS_PTH_CHECK(pthread_mutex_lock(&w->mtx));
+    w->quit = true;
+    LS_PTH_CHECK(pthread_cond_signal(&w->cond));
+    LS_PTH_CHECK(pthread_mutex_unlock(&w->mtx));
+
+    LS_PTH_CHECK(pthread_join(w->thread, NULL));
+
+    fcntl(w->fd, F_SETFL, w->fd_flags);
+
+    LS_PTH_CHECK(pthread_cond_destroy(&w->cond));
+    LS_PTH_CHECK(pthread_mutex_destroy(&w->mtx));
+    LS_VECTOR_FREE(w->pending);
+    free(w);
+}
@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2015-2020  luastatus developers
+ *
+ * This file is part of luastatus.
+ *
+ * luastatus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * luastatus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with luastatus.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef ls_writer_h_
+#define ls_writer_h_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/uio.h>
+
+#include "vector.h"
+#include "compdep.h"
+
+// A writer of frames (such as whole lines of a bar's output) to a file descriptor that never blocks
+// its callers.
+//
+// The file descriptor is made non-blocking, and the actual writing is done by a dedicated thread.
+// Only the newest complete frame is kept pending: if a new frame is pushed while the previous one
+// is still waiting for the thread to pick it up (that is, the consumer is slow), the previous one is
+// dropped. A frame that the thread has started writing is always written in full.
+typedef struct LSWriter LSWriter;
+
+// A list of buffers to be passed to /ls_writer_push_framev()/.
+typedef LS_VECTOR_OF(struct iovec) LSIovecs;
+
+LS_INHEADER void ls_iovecs_append(LSIovecs *v, const void *buf, size_t nbuf)
+{
+    // /struct iovec/ is also used for /readv()/, so its /iov_base/ is not const-qualified.
+    struct iovec iov = {.iov_base = (void *) buf, .iov_len = nbuf};
+    LS_VECTOR_PUSH(*v, iov);
+}
+
+// Makes /fd/ non-blocking and spawns the writer thread.
+//
+// On success, a new writer is returned. On failure, /NULL/ is returned and /errno/ is set.
+LSWriter *ls_writer_new(int fd);
+
+// Appends /nbuf/ bytes at /buf/ to the pending data. Unlike frames, this data is never dropped; it
+// is meant for things like headers.
+//
+// On success, /0/ is returned. If a previous write has failed, /-1/ is returned and /errno/ is set
+// to the error of that write.
+int ls_writer_push(LSWriter *w, const char *buf, size_t nbuf);
+
+// Makes the concatenation of /niov/ buffers described by /iov/ the pending frame, dropping the
+// previous pending frame, if any.
+//
+// The buffers are gathered straight into the pending data, so the caller does not have to assemble
+// the frame first, and may reuse the buffers as soon as this function returns.
+//
+// Returns the same way /ls_writer_push()/ does.
+int ls_writer_push_framev(LSWriter *w, const struct iovec *iov, size_t niov);
+
+// Returns the number of frames dropped so far.
+uint64_t ls_writer_dropped(LSWriter *w);
+
+// Waits until all the pending data has been written (or a write has failed), joins the writer
+// thread, restores the original file status flags of the file descriptor, and destroys /w/.
+//
+// The file descriptor is not closed.
+void ls_writer_destroy(LSWriter *w);
+
+#endif
@@ -0,0 +1,12 @@
+#ifndef builtins_h_
+#define builtins_h_
+
+// Plugins and barlibs linked into the luastatus binary (see /BUILTIN_PLUGINS/ in CMakeLists.txt),
+// as /X_(name, id)/ entries, where /name/ is the name a widget or the /-b/ option refers to it by,
+// and /id/ is the C identifier of its target name.
+
+#define LUASTATUS_BUILTIN_PLUGINS(X_) @LUASTATUS_BUILTIN_PLUGINS_LIST@
+
+#define LUASTATUS_BUILTIN_BARLIBS(X_) @LUASTATUS_BUILTIN_BARLIBS_LIST@
+
+#endif
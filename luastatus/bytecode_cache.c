@@ -0,0 +1,400 @@
+/*
+ * Copyright (C) 2015-2020  luastatus developers
+ *
+ * This file is part of luastatus.
+ *
+ * luastatus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * luastatus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with luastatus.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "bytecode_cache.h"
+
+#include <lua.h>
+#include <lauxlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "libls/alloc_utils.h"
+#include "libls/string_.h"
+#include "libls/vector.h"
+#include "libls/getenv_r.h"
+#include "libls/cstring_utils.h"
+
+#define MAGIC "LSBC"
+
+// Bump this whenever the layout of /Header/ changes.
+#define FORMAT_VERSION 1
+
+typedef struct {
+    char magic[4];
+    uint32_t format_version;
+    // /LUA_RELEASE/, zero-padded.
+    char lua_release[32];
+    uint32_t sizeof_lua_number;
+    uint32_t sizeof_size_t;
+    uint64_t src_size;
+    int64_t src_mtime_sec;
+    int64_t src_mtime_nsec;
+    uint64_t src_hash;
+    uint64_t code_size;
+    uint64_t code_hash;
+} Header;
+
+// /NULL/ if the cache is disabled.
+static char *cache_dir = NULL;
+
+static BytecodeCacheWarnFunc *warn_func = NULL;
+
+static void warnf(const char *fmt, ...)
+{
+    char buf[1024];
+    va_list vl;
+    va_start(vl, fmt);
+    vsnprintf(buf, sizeof(buf), fmt, vl);
+    va_end(vl);
+    warn_func(buf);
+}
+
+// Whether /st/ describes a file owned by us and not writable by anyone else: cache entries are
+// loaded as bytecode, which Lua does not verify, so anyone able to write them could run arbitrary
+// code in luastatus.
+static bool is_trusted(const struct stat *st)
+{
+    return st->st_uid == geteuid() && !(st->st_mode & (S_IWGRP | S_IWOTH));
+}
+
+// 64-bit FNV-1a.
+static uint64_t hash_update(uint64_t h, const char *buf, size_t nbuf)
+{
+    for (size_t i = 0; i < nbuf; ++i) {
+        h ^= (unsigned char) buf[i];
+        h *= UINT64_C(1099511628211);
+    }
+    return h;
+}
+
+#define HASH_INIT UINT64_C(14695981039346656037)
+
+static void fill_lua_release(char *dst, size_t ndst)
+{
+    memset(dst, 0, ndst);
+    strncpy(dst, LUA_RELEASE, ndst - 1);
+}
+
+// Creates directory /path/ unless it exists.
+static bool ensure_dir(const char *path)
+{
+    return mkdir(path, 0700) >= 0 || errno == EEXIST;
+}
+
+bool bytecode_cache_init(BytecodeCacheWarnFunc *warn, char *errbuf, size_t nerrbuf)
+{
+    warn_func = warn;
+
+    LSString path = LS_VECTOR_NEW();
+
+    const char *xdg = ls_getenv_r("XDG_CACHE_HOME");
+    if (xdg && xdg[0] == '/') {
+        ls_string_assign_s(&path, xdg);
+    } else {
+        const char *home = ls_getenv_r("HOME");
+        if (!home || !home[0]) {
+            snprintf(errbuf, nerrbuf, "neither XDG_CACHE_HOME nor HOME is set");
+            goto error;
+        }
+        ls_string_assign_f(&path, "%s/.cache", home);
+        if (!ensure_dir(path.data)) {
+            goto error_errno;
+        }
+    }
+    ls_string_append_s(&path, "/luastatus");
+    ls_string_append_c(&path, '\0');
+    if (!ensure_dir(path.data)) {
+        goto error_errno;
+    }
+
+    struct stat st;
+    if (lstat(path.data, &st) < 0) {
+        goto error_errno;
+    }
+    if (!S_ISDIR(st.st_mode)) {
+        snprintf(errbuf, nerrbuf, "%s: not a directory", path.data);
+        goto error;
+    }
+    if (!is_trusted(&st)) {
+        snprintf(errbuf, nerrbuf, "%s: not owned by the current user, or writable by others",
+                 path.data);
+        goto error;
+    }
+
+    cache_dir = path.data;
+    return true;
+
+error_errno:
+    {
+        int saved_errno = errno;
+        char buf[256];
+        snprintf(errbuf, nerrbuf, "%s: %s",
+                 path.data, ls_strerror_r(saved_errno, buf, sizeof(buf)));
+    }
+error:
+    LS_VECTOR_FREE(path);
+    return false;
+}
+
+// Reads the whole contents of file descriptor /fd/ into /buf/ (which gets cleared first).
+static bool read_all(int fd, LSString *buf)
+{
+    LS_VECTOR_CLEAR(*buf);
+    while (1) {
+        LS_VECTOR_ENSURE(*buf, buf->size + 4096);
+        ssize_t r = read(fd, buf->data + buf->size, buf->capacity - buf->size);
+        if (r < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        } else if (r == 0) {
+            return true;
+        }
+        buf->size += r;
+    }
+}
+
+static bool write_all(int fd, const char *buf, size_t nbuf)
+{
+    while (nbuf) {
+        ssize_t w = write(fd, buf, nbuf);
+        if (w < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        buf += w;
+        nbuf -= w;
+    }
+    return true;
+}
+
+// Reads the source file /filename/ into /src/ and fills in the /src_*/ fields of /h/.
+static bool read_source(const char *filename, LSString *src, Header *h)
+{
+    int fd = open(filename, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) || !read_all(fd, src)) {
+        close(fd);
+        return false;
+    }
+    close(fd);
+
+    memset(h, 0, sizeof(*h));
+    memcpy(h->magic, MAGIC, 4);
+    h->format_version = FORMAT_VERSION;
+    fill_lua_release(h->lua_release, sizeof(h->lua_release));
+    h->sizeof_lua_number = sizeof(lua_Number);
+    h->sizeof_size_t = sizeof(size_t);
+    h->src_size = src->size;
+    h->src_mtime_sec = st.st_mtim.tv_sec;
+    h->src_mtime_nsec = st.st_mtim.tv_nsec;
+    h->src_hash = hash_update(HASH_INIT, src->data, src->size);
+    return true;
+}
+
+typedef enum {
+    ENTRY_OK,
+    ENTRY_STALE,     // missing, unreadable or out of date; to be overwritten
+    ENTRY_UNTRUSTED, // must be neither used nor overwritten
+} EntryStatus;
+
+// Reads the compiled chunk from the cache entry at /path/ into /code/, if the entry's header
+// matches /h/ (whose /code_*/ fields are ignored).
+static EntryStatus read_entry(const char *path, const Header *h, LSString *code)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC | O_NOFOLLOW | O_NONBLOCK);
+    if (fd < 0) {
+        if (errno == ENOENT) {
+            return ENTRY_STALE;
+        }
+        warnf("cannot open '%s': %s", path, ls_strerror_onstack(errno));
+        return ENTRY_UNTRUSTED;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        warnf("cannot stat '%s': %s", path, ls_strerror_onstack(errno));
+        close(fd);
+        return ENTRY_UNTRUSTED;
+    }
+    if (!S_ISREG(st.st_mode) || !is_trusted(&st)) {
+        warnf("'%s' is not a regular file owned by the current user and not writable by others; "
+              "not using it", path);
+        close(fd);
+        return ENTRY_UNTRUSTED;
+    }
+    bool ok = read_all(fd, code);
+    close(fd);
+    if (!ok || code->size < sizeof(Header)) {
+        return ENTRY_STALE;
+    }
+
+    Header eh;
+    memcpy(&eh, code->data, sizeof(Header));
+    if (memcmp(eh.magic, h->magic, 4) != 0 ||
+        eh.format_version != h->format_version ||
+        memcmp(eh.lua_release, h->lua_release, sizeof(h->lua_release)) != 0 ||
+        eh.sizeof_lua_number != h->sizeof_lua_number ||
+        eh.sizeof_size_t != h->sizeof_size_t ||
+        eh.src_size != h->src_size ||
+        eh.src_mtime_sec != h->src_mtime_sec ||
+        eh.src_mtime_nsec != h->src_mtime_nsec ||
+        eh.src_hash != h->src_hash ||
+        eh.code_size != code->size - sizeof(Header))
+    {
+        return ENTRY_STALE;
+    }
+    const char *data = code->data + sizeof(Header);
+    size_t ndata = code->size - sizeof(Header);
+    if (hash_update(HASH_INIT, data, ndata) != eh.code_hash) {
+        return ENTRY_STALE;
+    }
+    memmove(code->data, data, ndata);
+    code->size = ndata;
+    return ENTRY_OK;
+}
+
+// Atomically writes a cache entry with header /h/ and compiled chunk /code/ to /path/.
+static void write_entry(const char *path, Header *h, const LSString *code)
+{
+    h->code_size = code->size;
+    h->code_hash = hash_update(HASH_INIT, code->data, code->size);
+
+    LSString tmp = ls_string_newz_from_f("%s/.tmp.XXXXXX", cache_dir);
+    int fd = mkstemp(tmp.data);
+    if (fd < 0) {
+        goto done;
+    }
+    bool ok = write_all(fd, (const char *) h, sizeof(Header)) &&
+              write_all(fd, code->data, code->size);
+    if (close(fd) < 0) {
+        ok = false;
+    }
+    if (!ok || rename(tmp.data, path) < 0) {
+        unlink(tmp.data);
+    }
+done:
+    LS_VECTOR_FREE(tmp);
+}
+
+static int dump_writer(lua_State *L, const void *p, size_t sz, void *ud)
+{
+    (void) L;
+    ls_string_append_b(ud, p, sz);
+    return 0;
+}
+
+// Like /luaL_loadfile()/, skips the first line of /src/ if it starts with '#' (but keeps the
+// newline, so that line numbers are not affected).
+static void skip_shebang(const char **src, size_t *nsrc)
+{
+    if (*nsrc && (*src)[0] == '#') {
+        const char *nl = memchr(*src, '\n', *nsrc);
+        size_t skip = nl ? (size_t) (nl - *src) : *nsrc;
+        *src += skip;
+        *nsrc -= skip;
+    }
+}
+
+int bytecode_cache_loadfile(lua_State *L, const char *filename)
+{
+    if (!cache_dir) {
+        return luaL_loadfile(L, filename);
+    }
+
+    int r;
+    LSString src = LS_VECTOR_NEW();
+    LSString code = LS_VECTOR_NEW();
+    LSString chunkname = ls_string_newz_from_f("@%s", filename);
+    LSString path = LS_VECTOR_NEW();
+    Header h;
+
+    if (!read_source(filename, &src, &h)) {
+        // Let /luaL_loadfile()/ report the error.
+        r = luaL_loadfile(L, filename);
+        goto done;
+    }
+
+    // The entry's name does not depend on the contents of the source file, so that a changed file
+    // overwrites its previous entry instead of leaving it behind; the header tells if the entry is
+    // up to date.
+    uint64_t key = hash_update(HASH_INIT, filename, strlen(filename) + 1);
+    key = hash_update(key, h.lua_release, sizeof(h.lua_release));
+    path = ls_string_newz_from_f("%s/%016llx.luac", cache_dir, (unsigned long long) key);
+
+    switch (read_entry(path.data, &h, &code)) {
+    case ENTRY_OK:
+        if (luaL_loadbuffer(L, code.data, code.size, chunkname.data) == 0) {
+            r = 0;
+            goto done;
+        }
+        // Should not normally happen; recompile and overwrite the entry.
+        lua_pop(L, 1);
+        break;
+    case ENTRY_STALE:
+        break;
+    case ENTRY_UNTRUSTED:
+        r = luaL_loadfile(L, filename);
+        goto done;
+    }
+
+    const char *s = src.data;
+    size_t ns = src.size;
+    skip_shebang(&s, &ns);
+    r = luaL_loadbuffer(L, s, ns, chunkname.data);
+    if (r != 0) {
+        goto done;
+    }
+
+    LS_VECTOR_CLEAR(code);
+#if LUA_VERSION_NUM >= 503
+    int dr = lua_dump(L, dump_writer, &code, 0);
+#else
+    int dr = lua_dump(L, dump_writer, &code);
+#endif
+    if (dr == 0) {
+        write_entry(path.data, &h, &code);
+    }
+
+done:
+    LS_VECTOR_FREE(src);
+    LS_VECTOR_FREE(code);
+    LS_VECTOR_FREE(chunkname);
+    LS_VECTOR_FREE(path);
+    return r;
+}
+
+void bytecode_cache_destroy(void)
+{
+    free(cache_dir);
+    cache_dir = NULL;
+}
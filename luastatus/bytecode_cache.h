@@ -0,0 +1,61 @@
+/*
+ * Copyright (C) 2015-2020  luastatus developers
+ *
+ * This file is part of luastatus.
+ *
+ * luastatus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * luastatus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with luastatus.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef bytecode_cache_h_
+#define bytecode_cache_h_
+
+#include <lua.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+// A persistent cache of compiled Lua chunks (as produced by /lua_dump()/), so that widget files and
+// derived plugins do not have to be parsed on each start.
+//
+// Each cache entry is a file in the cache directory, named after a hash of the source file's path
+// and of the Lua version, and beginning with a header that records the size, modification time and
+// hash of the source file, the Lua version, and a hash of the compiled chunk. An entry is only used
+// if all of these match; otherwise, it is overwritten. Entries are written atomically (to a
+// temporary file, which is then renamed), so concurrent writers do not corrupt each other.
+//
+// As Lua does not verify bytecode, the cache directory and the entries must be owned by the current
+// user and not writable by anyone else, and must not be symbolic links; otherwise, they are not
+// used.
+
+typedef void BytecodeCacheWarnFunc(const char *msg);
+
+// Sets up the cache directory: /$XDG_CACHE_HOME/luastatus/, or /$HOME/.cache/luastatus/ if
+// /XDG_CACHE_HOME/ is not set, creating it if needed.
+//
+// /warn/ is called (from any thread) to report cache entries that are not used for not being
+// trusted.
+//
+// On success, /true/ is returned. On failure, /false/ is returned and an error message is written
+// into /errbuf/ of size /nerrbuf/; the cache then stays disabled, and /bytecode_cache_loadfile()/
+// behaves like /luaL_loadfile()/.
+//
+// Must be called before any other thread calls /bytecode_cache_loadfile()/.
+bool bytecode_cache_init(BytecodeCacheWarnFunc *warn, char *errbuf, size_t nerrbuf);
+
+// A drop-in replacement for /luaL_loadfile(L, filename)/ that consults the cache and, on a miss,
+// stores the compiled chunk into it. Thread-safe, as long as different threads use different /L/.
+int bytecode_cache_loadfile(lua_State *L, const char *filename);
+
+void bytecode_cache_destroy(void);
+
+#endif
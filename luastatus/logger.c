@@ -0,0 +1,309 @@
+/*
+ * Copyright (C) 2015-2020  luastatus developers
+ *
+ * This file is part of luastatus.
+ *
+ * luastatus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * luastatus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with luastatus.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "logger.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdarg.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <time.h>
+
+#include "include/common.h"
+
+#include "libls/alloc_utils.h"
+#include "libls/string_.h"
+#include "libls/vector.h"
+#include "libls/panic.h"
+
+// Must be a power of two.
+#define NSLOTS 512
+
+#define MAX_SUBSYSTEM 256
+#define MAX_MESSAGE 1024
+
+// A slot of the queue. This is the bounded queue of Dmitry Vyukov: /seq/ of a slot at position
+// /pos/ (modulo /NSLOTS/) is /pos/ if it is free for a producer to write, and /pos + 1/ if it has
+// been written and is ready for the consumer.
+typedef struct {
+    size_t seq;
+
+    const char *level_name;
+    struct timespec ts;
+    size_t ndropped;
+    bool has_subsystem;
+    char subsystem[MAX_SUBSYSTEM];
+    char message[MAX_MESSAGE];
+} Slot;
+
+static struct {
+    Slot *slots;
+
+    // Position the next producer will write to. Only accessed atomically.
+    size_t enqueue_pos;
+
+    // Position the consumer will read from next. Guarded by /drain_mtx/.
+    size_t dequeue_pos;
+
+    // The number of messages dropped because the queue was full. Only accessed atomically.
+    size_t nfull_dropped;
+
+    // Held by whoever drains the queue, as there must be only one consumer at a time.
+    pthread_mutex_t drain_mtx;
+
+    // A buffer the drained messages are formatted into, so that they are written with a single
+    // call. Guarded by /drain_mtx/.
+    LSString buf;
+
+    sem_t wakeup;
+    bool quit;
+    bool timestamps;
+    bool running;
+    pthread_t thread;
+} logger = {.running = false, .drain_mtx = PTHREAD_MUTEX_INITIALIZER};
+
+static void format_record(LSString *buf, const char *level_name, const struct timespec *ts,
+                          const char *subsystem, const char *message, size_t ndropped)
+{
+    ls_string_append_s(buf, "luastatus: ");
+    if (logger.timestamps) {
+        ls_string_append_f(buf, "[%lld.%06ld] ", (long long) ts->tv_sec, ts->tv_nsec / 1000);
+    }
+    if (subsystem) {
+        ls_string_append_f(buf, "(%s) ", subsystem);
+    }
+    ls_string_append_f(buf, "%s: %s\n", level_name, message);
+    if (ndropped) {
+        ls_string_append_s(buf, "luastatus: ");
+        if (subsystem) {
+            ls_string_append_f(buf, "(%s) ", subsystem);
+        }
+        ls_string_append_f(buf, "warning: %zu message(s) dropped due to rate limiting\n", ndropped);
+    }
+}
+
+static void write_buf(LSString *buf)
+{
+    if (buf->size) {
+        fwrite(buf->data, 1, buf->size, stderr);
+        LS_VECTOR_CLEAR(*buf);
+    }
+}
+
+// Must be called with /logger.drain_mtx/ locked.
+static void drain(void)
+{
+    while (1) {
+        Slot *slot = &logger.slots[logger.dequeue_pos & (NSLOTS - 1)];
+        size_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+        if (seq != logger.dequeue_pos + 1) {
+            break;
+        }
+        format_record(&logger.buf, slot->level_name, &slot->ts,
+                      slot->has_subsystem ? slot->subsystem : NULL, slot->message,
+                      slot->ndropped);
+        __atomic_store_n(&slot->seq, logger.dequeue_pos + NSLOTS, __ATOMIC_RELEASE);
+        ++logger.dequeue_pos;
+    }
+    size_t nfull_dropped = __atomic_exchange_n(&logger.nfull_dropped, 0, __ATOMIC_RELAXED);
+    if (nfull_dropped) {
+        ls_string_append_f(&logger.buf,
+                           "luastatus: warning: %zu message(s) dropped as the log queue was full\n",
+                           nfull_dropped);
+    }
+    write_buf(&logger.buf);
+}
+
+static void *logger_thread(void *arg)
+{
+    (void) arg;
+    while (1) {
+        while (sem_wait(&logger.wakeup) < 0) {
+            // EINTR
+        }
+        bool quit = __atomic_load_n(&logger.quit, __ATOMIC_SEQ_CST);
+        LS_PTH_CHECK(pthread_mutex_lock(&logger.drain_mtx));
+        drain();
+        LS_PTH_CHECK(pthread_mutex_unlock(&logger.drain_mtx));
+        if (quit) {
+            break;
+        }
+    }
+    return NULL;
+}
+
+void logger_start(bool timestamps)
+{
+    logger.slots = LS_XNEW(Slot, NSLOTS);
+    for (size_t i = 0; i < NSLOTS; ++i) {
+        logger.slots[i].seq = i;
+    }
+    logger.enqueue_pos = 0;
+    logger.dequeue_pos = 0;
+    logger.nfull_dropped = 0;
+    LS_VECTOR_INIT(logger.buf);
+    logger.quit = false;
+    logger.timestamps = timestamps;
+    if (sem_init(&logger.wakeup, 0, 0) < 0) {
+        LS_PANIC("sem_init() failed");
+    }
+    LS_PTH_CHECK(pthread_create(&logger.thread, NULL, logger_thread, NULL));
+    __atomic_store_n(&logger.running, true, __ATOMIC_SEQ_CST);
+}
+
+// Returns /true/ if a message from a source with rate-limiting state /rate/ may be logged; if so,
+// also sets /*ndropped/ to the number of messages dropped before it.
+static bool rate_check(LoggerRate *rate, size_t *ndropped)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    long window = now.tv_sec;
+    if (__atomic_load_n(&rate->window, __ATOMIC_RELAXED) != window) {
+        __atomic_store_n(&rate->window, window, __ATOMIC_RELAXED);
+        __atomic_store_n(&rate->count, 0, __ATOMIC_RELAXED);
+    }
+    if (__atomic_fetch_add(&rate->count, 1, __ATOMIC_RELAXED) >= LOGGER_RATE_LIMIT) {
+        __atomic_add_fetch(&rate->ndropped, 1, __ATOMIC_RELAXED);
+        return false;
+    }
+    *ndropped = __atomic_exchange_n(&rate->ndropped, 0, __ATOMIC_RELAXED);
+    return true;
+}
+
+static void fill_texts(char *subsystem_buf, bool *has_subsystem, char *message_buf,
+                       const char *subsystem, const char *fmt, va_list vl)
+{
+    if (vsnprintf(message_buf, MAX_MESSAGE, fmt, vl) < 0) {
+        message_buf[0] = '\0';
+    }
+    *has_subsystem = !!subsystem;
+    if (subsystem) {
+        size_t n = strlen(subsystem);
+        if (n >= MAX_SUBSYSTEM) {
+            n = MAX_SUBSYSTEM - 1;
+        }
+        memcpy(subsystem_buf, subsystem, n);
+        subsystem_buf[n] = '\0';
+    }
+}
+
+static void log_sync(const char *level_name, const char *subsystem, size_t ndropped,
+                     const char *fmt, va_list vl)
+{
+    char subsystem_buf[MAX_SUBSYSTEM];
+    char message_buf[MAX_MESSAGE];
+    bool has_subsystem;
+    fill_texts(subsystem_buf, &has_subsystem, message_buf, subsystem, fmt, vl);
+
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+
+    LSString buf = LS_VECTOR_NEW();
+    format_record(&buf, level_name, &ts, has_subsystem ? subsystem_buf : NULL, message_buf,
+                  ndropped);
+    write_buf(&buf);
+    LS_VECTOR_FREE(buf);
+}
+
+void logger_log(int level, const char *level_name, const char *subsystem, LoggerRate *rate,
+                const char *fmt, va_list vl)
+{
+    size_t ndropped = 0;
+    if (rate && level > LUASTATUS_LOG_WARN && !rate_check(rate, &ndropped)) {
+        return;
+    }
+
+    if (!__atomic_load_n(&logger.running, __ATOMIC_SEQ_CST)) {
+        log_sync(level_name, subsystem, ndropped, fmt, vl);
+        return;
+    }
+    if (level == LUASTATUS_LOG_FATAL) {
+        LS_PTH_CHECK(pthread_mutex_lock(&logger.drain_mtx));
+        drain();
+        log_sync(level_name, subsystem, ndropped, fmt, vl);
+        LS_PTH_CHECK(pthread_mutex_unlock(&logger.drain_mtx));
+        return;
+    }
+
+    size_t pos = __atomic_load_n(&logger.enqueue_pos, __ATOMIC_RELAXED);
+    Slot *slot;
+    while (1) {
+        slot = &logger.slots[pos & (NSLOTS - 1)];
+        size_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+        intptr_t diff = (intptr_t) seq - (intptr_t) pos;
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&logger.enqueue_pos, &pos, pos + 1, true,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            {
+                break;
+            }
+        } else if (diff < 0) {
+            // The queue is full.
+            __atomic_add_fetch(&logger.nfull_dropped, 1 + ndropped, __ATOMIC_RELAXED);
+            return;
+        } else {
+            pos = __atomic_load_n(&logger.enqueue_pos, __ATOMIC_RELAXED);
+        }
+    }
+
+    slot->level_name = level_name;
+    clock_gettime(CLOCK_REALTIME, &slot->ts);
+    slot->ndropped = ndropped;
+    fill_texts(slot->subsystem, &slot->has_subsystem, slot->message, subsystem, fmt, vl);
+    __atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+
+    if (sem_post(&logger.wakeup) < 0) {
+        LS_PANIC("sem_post() failed");
+    }
+}
+
+void logger_flush(void)
+{
+    if (!__atomic_load_n(&logger.running, __ATOMIC_SEQ_CST)) {
+        return;
+    }
+    LS_PTH_CHECK(pthread_mutex_lock(&logger.drain_mtx));
+    drain();
+    LS_PTH_CHECK(pthread_mutex_unlock(&logger.drain_mtx));
+}
+
+void logger_stop(void)
+{
+    if (!logger.running) {
+        return;
+    }
+    __atomic_store_n(&logger.quit, true, __ATOMIC_SEQ_CST);
+    if (sem_post(&logger.wakeup) < 0) {
+        LS_PANIC("sem_post() failed");
+    }
+    LS_PTH_CHECK(pthread_join(logger.thread, NULL));
+    __atomic_store_n(&logger.running, false, __ATOMIC_SEQ_CST);
+
+    // Messages might have been queued after the logger thread's last drain.
+    drain();
+
+    if (sem_destroy(&logger.wakeup) < 0) {
+        LS_PANIC("sem_destroy() failed");
+    }
+    LS_VECTOR_FREE(logger.buf);
+    free(logger.slots);
+}
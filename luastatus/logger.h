@@ -0,0 +1,76 @@
+/*
+ * Copyright (C) 2015-2020  luastatus developers
+ *
+ * This file is part of luastatus.
+ *
+ * luastatus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * luastatus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with luastatus.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef logger_h_
+#define logger_h_
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+// An asynchronous logger: threads that log messages format them into records of a bounded
+// lock-free multi-producer queue, which are then written out by a dedicated logger thread; so
+// logging threads never wait for each other or for stderr.
+//
+// If the queue is full, the message is dropped; the number of such messages is reported once there
+// is room again.
+//
+// Messages of /LUASTATUS_LOG_FATAL/ level are written synchronously (after all the queued ones), as
+// the process is likely to terminate right after.
+//
+// Before /logger_start()/ and after /logger_stop()/, all messages are written synchronously.
+
+// The maximum number of messages a rate-limited source may log per second; the rest are dropped,
+// and their number is reported along with the next message that gets through. Messages of level
+// /LUASTATUS_LOG_WARN/ and more severe are never rate-limited.
+#define LOGGER_RATE_LIMIT 100
+
+// Rate-limiting state of a source of messages; should be zero-initialized. Its fields are only
+// accessed atomically, so a source may log from several threads at once (although the limit is
+// then approximate).
+typedef struct {
+    // The second (of /CLOCK_MONOTONIC/) the current window has started at.
+    long window;
+
+    // The number of messages logged within the current window.
+    unsigned count;
+
+    // The number of messages dropped since the last one that got through.
+    size_t ndropped;
+} LoggerRate;
+
+// Spawns the logger thread. If /timestamps/ is true, each message is prefixed with the time it was
+// logged at.
+void logger_start(bool timestamps);
+
+// Logs a message with level /level/ (whose name is /level_name/, which must be a string literal or
+// otherwise outlive the logger) from /subsystem/ (may be /NULL/), formatted with /fmt/ and /vl/.
+//
+// If /rate/ is not /NULL/, the message is subject to rate-limiting with /rate/ as the state.
+void logger_log(int level, const char *level_name, const char *subsystem, LoggerRate *rate,
+                const char *fmt, va_list vl);
+
+// Synchronously writes out all the queued messages.
+void logger_flush(void);
+
+// Writes out all the queued messages and joins the logger thread, if it is running. Must not be
+// called while other threads may log.
+void logger_stop(void);
+
+#endif
@@ -0,0 +1,205 @@
+/*
+ * Copyright (C) 2015-2020  luastatus developers
+ *
+ * This file is part of luastatus.
+ *
+ * luastatus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * luastatus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with luastatus.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "lua_alloc.h"
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_SMALL_SIZE (LUA_ALLOC_NCLASSES * LUA_ALLOC_GRANULARITY)
+
+#define CHUNK_SIZE 16384
+
+// The chunk header occupies the first /LUA_ALLOC_GRANULARITY/ bytes of a chunk, so that blocks keep
+// the alignment of /malloc()/'ed memory.
+typedef union Chunk {
+    union Chunk *next;
+    char pad_[LUA_ALLOC_GRANULARITY];
+} Chunk;
+
+typedef struct FreeBlock {
+    struct FreeBlock *next;
+} FreeBlock;
+
+static inline size_t size_class(size_t n)
+{
+    return (n - 1) / LUA_ALLOC_GRANULARITY;
+}
+
+static inline size_t class_size(size_t cls)
+{
+    return (cls + 1) * LUA_ALLOC_GRANULARITY;
+}
+
+void lua_alloc_init(LuaAlloc *a)
+{
+    *a = (LuaAlloc) {
+        .in_use = 0,
+        .peak = 0,
+        .limit = 0,
+        .limit_hit = false,
+        .bump_cur = NULL,
+        .bump_end = NULL,
+        .chunks = NULL,
+    };
+    for (size_t i = 0; i < LUA_ALLOC_NCLASSES; ++i) {
+        a->free_lists[i] = NULL;
+    }
+}
+
+static void *small_acquire(LuaAlloc *a, size_t cls)
+{
+    FreeBlock *b = a->free_lists[cls];
+    if (b) {
+        a->free_lists[cls] = b->next;
+        return b;
+    }
+    size_t n = class_size(cls);
+    if ((size_t) (a->bump_end - a->bump_cur) < n) {
+        // The rest of the current chunk, if any, is wasted; it is less than /MAX_SMALL_SIZE/ bytes.
+        Chunk *c = malloc(CHUNK_SIZE);
+        if (!c) {
+            return NULL;
+        }
+        c->next = a->chunks;
+        a->chunks = c;
+        a->bump_cur = (char *) c + sizeof(Chunk);
+        a->bump_end = (char *) c + CHUNK_SIZE;
+    }
+    void *r = a->bump_cur;
+    a->bump_cur += n;
+    return r;
+}
+
+static inline void small_release(LuaAlloc *a, void *ptr, size_t cls)
+{
+    FreeBlock *b = ptr;
+    b->next = a->free_lists[cls];
+    a->free_lists[cls] = b;
+}
+
+// Large blocks are never allocated with less than this number of bytes, so that one can always be
+// turned into a chunk that holds a single small block (see /shrink_fallback()/).
+#define MIN_LARGE_ALLOC (MAX_SMALL_SIZE + sizeof(Chunk))
+
+static inline size_t large_alloc_size(size_t n)
+{
+    return n < MIN_LARGE_ALLOC ? MIN_LARGE_ALLOC : n;
+}
+
+static inline void *acquire(LuaAlloc *a, size_t n)
+{
+    return n <= MAX_SMALL_SIZE ? small_acquire(a, size_class(n)) : malloc(large_alloc_size(n));
+}
+
+static inline void release(LuaAlloc *a, void *ptr, size_t n)
+{
+    if (n <= MAX_SMALL_SIZE) {
+        small_release(a, ptr, size_class(n));
+    } else {
+        free(ptr);
+    }
+}
+
+// Lua (before 5.4) assumes that shrinking a block never fails, so this is called to shrink block
+// /ptr/ of /osize/ bytes to /nsize/ bytes when there is no memory to move it to.
+static void *shrink_fallback(LuaAlloc *a, void *ptr, size_t osize, size_t nsize)
+{
+    if (osize <= MAX_SMALL_SIZE) {
+        // /ptr/ will be released into the free list of a smaller class; it is big enough for it.
+        return ptr;
+    }
+    // /ptr/ has at least /MIN_LARGE_ALLOC/ bytes; turn it into a chunk with a single block.
+    Chunk *c = ptr;
+    char *r = (char *) c + sizeof(Chunk);
+    memmove(r, ptr, nsize);
+    c->next = a->chunks;
+    a->chunks = c;
+    return r;
+}
+
+static void *do_realloc(LuaAlloc *a, void *ptr, size_t osize, size_t nsize)
+{
+    if (!ptr) {
+        return acquire(a, nsize);
+    }
+    if (osize <= MAX_SMALL_SIZE && nsize <= MAX_SMALL_SIZE) {
+        if (size_class(osize) == size_class(nsize)) {
+            return ptr;
+        }
+    } else if (osize > MAX_SMALL_SIZE && nsize > MAX_SMALL_SIZE) {
+        void *r = realloc(ptr, large_alloc_size(nsize));
+        if (!r && nsize < osize) {
+            return ptr;
+        }
+        return r;
+    }
+    void *r = acquire(a, nsize);
+    if (!r) {
+        return nsize < osize ? shrink_fallback(a, ptr, osize, nsize) : NULL;
+    }
+    memcpy(r, ptr, osize < nsize ? osize : nsize);
+    release(a, ptr, osize);
+    return r;
+}
+
+void *lua_alloc_func(void *ud, void *ptr, size_t osize, size_t nsize)
+{
+    LuaAlloc *a = ud;
+
+    // If /ptr/ is /NULL/, /osize/ is not a size, but encodes the type of the object being
+    // allocated (in Lua 5.2+).
+    if (!ptr) {
+        osize = 0;
+    }
+
+    if (!nsize) {
+        if (ptr) {
+            release(a, ptr, osize);
+            a->in_use -= osize;
+        }
+        return NULL;
+    }
+
+    if (a->limit && nsize > osize && a->in_use + (nsize - osize) > a->limit) {
+        a->limit_hit = true;
+        return NULL;
+    }
+
+    void *r = do_realloc(a, ptr, osize, nsize);
+    if (!r) {
+        return NULL;
+    }
+    a->in_use = a->in_use - osize + nsize;
+    if (a->peak < a->in_use) {
+        a->peak = a->in_use;
+    }
+    return r;
+}
+
+void lua_alloc_destroy(LuaAlloc *a)
+{
+    for (Chunk *c = a->chunks; c;) {
+        Chunk *next = c->next;
+        free(c);
+        c = next;
+    }
+    a->chunks = NULL;
+}
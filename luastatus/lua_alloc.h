@@ -0,0 +1,72 @@
+/*
+ * Copyright (C) 2015-2020  luastatus developers
+ *
+ * This file is part of luastatus.
+ *
+ * luastatus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * luastatus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with luastatus.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef lua_alloc_h_
+#define lua_alloc_h_
+
+#include <stddef.h>
+#include <stdbool.h>
+
+// A Lua allocator (see /lua_Alloc/) that keeps track of the amount of memory used by a Lua state,
+// optionally enforces a limit on it, and serves small allocations from per-size-class pools.
+//
+// Lua allocates and frees lots of small objects (strings, tables, closures) on each call; these
+// are carved out of large chunks, and freed ones are kept in per-class free lists for reuse.
+// Chunks are only returned to the system by /lua_alloc_destroy()/. Larger allocations go directly
+// to /malloc()/ and friends.
+//
+// An instance is not thread-safe; this is fine, as a Lua state must not be used by more than one
+// thread at a time anyway.
+
+// Allocations of at most /LUA_ALLOC_NCLASSES * LUA_ALLOC_GRANULARITY/ bytes are served from pools.
+#define LUA_ALLOC_GRANULARITY 16
+#define LUA_ALLOC_NCLASSES    16
+
+typedef struct {
+    // The number of bytes currently allocated by the Lua state.
+    size_t in_use;
+
+    // The maximum value of /in_use/ ever observed.
+    size_t peak;
+
+    // The limit on /in_use/; zero means no limit. May be changed at any time.
+    size_t limit;
+
+    // Whether an allocation has failed because of /limit/ since this flag was last cleared.
+    bool limit_hit;
+
+    // Heads of per-class free lists.
+    void *free_lists[LUA_ALLOC_NCLASSES];
+
+    // Unused space of the last allocated chunk.
+    char *bump_cur;
+    char *bump_end;
+
+    // List of allocated chunks.
+    void *chunks;
+} LuaAlloc;
+
+void lua_alloc_init(LuaAlloc *a);
+
+// The allocation function; /ud/ must be a pointer to an initialized /LuaAlloc/.
+void *lua_alloc_func(void *ud, void *ptr, size_t osize, size_t nsize);
+
+// Frees all the memory held by /a/. The Lua state using it must have been closed before.
+void lua_alloc_destroy(LuaAlloc *a);
+
+#endif
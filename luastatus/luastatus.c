@@ -23,13 +23,21 @@
 #include <lualib.h>
 #include <stdarg.h>
 #include <stdio.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
 #include <signal.h>
 #include <pthread.h>
+#include <semaphore.h>
 #include <dlfcn.h>
 #include <unistd.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <fcntl.h>
+#include <poll.h>
 
 #include "include/barlib_data.h"
 #include "include/plugin_data.h"
@@ -37,13 +45,26 @@
 
 #include "libls/alloc_utils.h"
 #include "libls/compdep.h"
+#include "libls/cstring_utils.h"
 #include "libls/getenv_r.h"
 #include "libls/vector.h"
 #include "libls/string_.h"
 #include "libls/algo.h"
 #include "libls/panic.h"
+#include "libls/parse_int.h"
+#include "libls/osdep.h"
+#include "libls/io_utils.h"
+#include "libls/usdt.h"
 
 #include "config.generated.h"
+#include "builtins.generated.h"
+#include "reactor.h"
+#include "lua_alloc.h"
+#include "snapshot.h"
+#include "bytecode_cache.h"
+#include "logger.h"
+#include "stats.h"
+#include "profiler.h"
 
 // Logging macros.
 #define FATALF(...)    sayf(LUASTATUS_LOG_FATAL,    __VA_ARGS__)
@@ -54,52 +75,136 @@
 #define DEBUGF(...)    sayf(LUASTATUS_LOG_DEBUG,    __VA_ARGS__)
 #define TRACEF(...)    sayf(LUASTATUS_LOG_TRACE,    __VA_ARGS__)
 
+// Like /TRACEF()/, but the message is attributed to widget /W_/ for the purposes of rate-limiting.
+#define WTRACEF(W_, ...) wsayf((W_), LUASTATUS_LOG_TRACE, __VA_ARGS__)
+
 // These ones are implemented as macros so that /LS_PTH_CHECK()/ calls receive the correct line
 // they are called at.
-#define LOCK_B()   LS_PTH_CHECK(pthread_mutex_lock(&barlib.set_mtx))
-#define UNLOCK_B() LS_PTH_CHECK(pthread_mutex_unlock(&barlib.set_mtx))
-
-#define LOCK_L(W_)   LS_PTH_CHECK(pthread_mutex_lock(&(W_)->L_mtx))
-#define UNLOCK_L(W_) LS_PTH_CHECK(pthread_mutex_unlock(&(W_)->L_mtx))
+#define LOCK_L(W_)   LS_PTH_CHECK(pthread_mutex_lock(&(W_)->interp->mtx))
+#define UNLOCK_L(W_) LS_PTH_CHECK(pthread_mutex_unlock(&(W_)->interp->mtx))
 
 #define LOCK_E(W_)   LS_PTH_CHECK(pthread_mutex_lock(widget_event_L_mtx(W_)))
 #define UNLOCK_E(W_) LS_PTH_CHECK(pthread_mutex_unlock(widget_event_L_mtx(W_)))
 
+// A loaded plugin .so file; shared by all the widgets using it (see /plugin_registry/).
+typedef struct {
+    // The built-in plugin this module is, or /NULL/ if it has been loaded from a file.
+    const struct BuiltinPlugin *builtin;
+
+    // If not built-in, the device and inode numbers of the file; these identify it no matter which
+    // path (with symbolic links, "..", etc.) it has been loaded by.
+    dev_t dev;
+    ino_t ino;
+
+    // The number of widgets using this module.
+    size_t refcount;
+
+    // A handle returned from /dlopen/ for the file, or /NULL/ if built-in.
+    void *dlhandle;
+
+    // The revision of the plugin interface this plugin implements: either /1/ or /2/.
+    int iface_rev;
+
+    // The interface loaded from the file: /iface.v1/ if /iface_rev/ is /1/, and /iface.v2/ if
+    // /iface_rev/ is /2/.
+    union {
+        LuastatusPluginIface_v1 v1;
+        LuastatusPluginIface_v2 v2;
+    } iface;
+} PluginModule;
+
 typedef struct {
-    // The interface loaded from this plugin's .so file.
-    LuastatusPluginIface_v1 iface;
+    // The module this plugin is loaded from.
+    PluginModule *mod;
 
     // An allocated zero-terminated string with plugin name, as specified in widget's
     // /widget.plugin/ string.
     char *name;
-
-    // A handle returned from /dlopen/ for this plugin's .so file.
-    void *dlhandle;
 } Plugin;
 
+// A Lua interpreter instance that runs widgets' code: either a widget's own one, or, in
+// shared-interpreter mode, one of the shared ones (see /shared/).
+typedef struct {
+    // The Lua interpreter instance. Its stack always contains /l_error_handler/ at the bottom.
+    lua_State *L;
+
+    // A mutex guarding /L/.
+    pthread_mutex_t mtx;
+
+    // The allocator of /L/; also keeps track of how much memory /L/ uses, and enforces
+    // /widget.memory_limit/.
+    LuaAlloc alloc;
+
+    // Whether /L/ actually uses /alloc/ (see /xnew_lua_state()/).
+    bool alloc_used;
+
+    // The size of /L/'s heap, in KiB, right after the last completed garbage collection cycle (see
+    // /interp_gc_step()/). Guarded by /mtx/.
+    int gc_baseline_kb;
+
+    // The widget whose /widget.cb/ or /widget.event/ is being called in /L/, or /NULL/ (see
+    // /interp_enter()/). Guarded by /mtx/.
+    struct Widget *cur;
+
+    // The time (as returned by /stats_now()/) the profiler has taken its last sample in /L/ at, or
+    // /cur/ has been entered at, whichever is later. Guarded by /mtx/.
+    uint64_t prof_last;
+
+    // The time (as returned by /stats_now()/) at which the call being made in /L/ is to be aborted
+    // (see /widget_do_call()/), or /0/. Guarded by /mtx/.
+    uint64_t deadline;
+
+    // Whether /interp_hook()/ has aborted the current call because of /deadline/. Guarded by /mtx/.
+    bool deadline_hit;
+
+    // Whether /interp_hook()/ is installed on /L/. Guarded by /mtx/.
+    bool hooked;
+} Interp;
+
+// The maximum number of events queued for a single widget (see /evq/); further events are dropped.
+#define EVQ_CAPACITY 64
+
+typedef struct {
+    // The event object, as pushed by the barlib's event watcher.
+    Snapshot *s;
+
+    // If this is a scroll event (see /event_scroll_button()/), its button; /0/ otherwise.
+    int scroll_button;
+
+    // The number of events coalesced into this one.
+    unsigned count;
+} QueuedEvent;
+
+// A bounded queue of events on a widget waiting to be passed to its /widget.event/. Guarded by
+// /evq.mtx/.
+typedef struct {
+    // A ring buffer of /size/ events starting at /head/.
+    QueuedEvent entries[EVQ_CAPACITY];
+    size_t head;
+    size_t size;
+
+    // Whether the widget is in /evq.ready/ or one of its events is being handled by an event
+    // worker.
+    bool scheduled;
+
+    // The number of events dropped because the queue was full.
+    uint64_t ndropped;
+} EventQueue;
+
 // If any step of widget's initialization fails, the widget is not removed from the /widgets/
 // buffer, but is, instead, unloaded and becomes *stillborn*; barlib's /set_error()/ is called on
-// it, and a separate "runner" thread simply does not get spawned for it.
+// it, and it is simply not run, neither in a separate "runner" thread nor in a reactor.
 //
-// However, barlib's /event_watcher()/ may still report events on such a widget.
-// Possible solutions to this are:
-//   1. Allow the event watcher's /call_begin/ function (/ew_call_begin/) to return /NULL/ to tell
-//      the event watcher that we are not interested in this event, and that it should be skipped.
-//      Complicates the API and event watcher's logic.
-//   2. Initialize each stillborn widget's /L/ with an empty Lua state, and provide it to the event
-//      watcher each time it generates an event on this widget.
-//   3. If there is at least one stillborn widget, initialize the *separate state* (see below), and
-//      provide /sepstate.L/ to the event watcher. A slight benefit over the second variant is that
-//      only one extra initialized Lua state is required.
-//
-// We choose the third one, and thus require stillborn widgets to have:
-//   1. /sepstate_event/ field set to /true/ so that /ew_call_begin/ and /ew_call_end/ functions
-//      would operate on /sepstate/'s Lua state and mutex guarding it, instead of widget's ones
-//      (which are not initialized in the case of a stillborn widget);
-//   2. /lref_event/ field set to /LUA_REFNIL/ so that /ew_call_end/ function would simply discard
-//      the object generated by barlib's event watcher.
-
-typedef struct {
+// However, barlib's /event_watcher()/ may still report events on such a widget. The event watcher
+// always pushes event objects onto the staging state (see /evq/), so nothing has to be done for it;
+// we only require stillborn widgets to have:
+//   1. /lref_event/ field set to /LUA_REFNIL/ so that /ew_call_end/ function would simply discard
+//      the object generated by barlib's event watcher;
+//   2. /sepstate_event/ field set to /true/, so that nothing would attempt to operate on the
+//      widget's Lua interpreter instance (which is not initialized in the case of a stillborn
+//      widget).
+
+typedef struct Widget {
     // Normal: an initialized plugin.
     // Stillborn: undefined.
     Plugin plugin;
@@ -108,13 +213,27 @@ typedef struct {
     // Stillborn: undefined.
     LuastatusPluginData_v1 data;
 
-    // Normal: this widget's Lua interpreter instance.
+    // Normal: this widget's Lua interpreter instance (the same as /interp->L/).
     // Stillborn: /NULL/ (used to check if the widget is stillborn).
     lua_State *L;
 
-    // Normal: a mutex guarding /L/.
+    // Normal: the interpreter this widget runs in: either /&own_interp/, or one of the shared
+    // ones. Its /mtx/ is referred to as "/L_mtx/".
     // Stillborn: undefined.
-    pthread_mutex_t L_mtx;
+    Interp *interp;
+
+    // Normal: unless in shared-interpreter mode, this widget's own interpreter.
+    // Stillborn: undefined.
+    Interp own_interp;
+
+    // Normal: in shared-interpreter mode, Lua reference (in /L/'s registry) to the environment
+    // table this widget's file is run with; /LUA_NOREF/ otherwise.
+    // Stillborn: undefined.
+    int lref_env;
+
+    // Whether the thread initializing this widget holds /map.mtx/ (see /map_get()/). Only
+    // meaningful during initialization.
+    bool map_locked;
 
     // Normal: Lua reference (in /L/'s registry) to this widget's /widget.cb/ function.
     // Stillborn: undefined.
@@ -123,21 +242,119 @@ typedef struct {
     // Normal:
     //   if /sepstate_event/ is false, Lua reference (in /L/'s registry) to this widget's
     //     /widget.event/ function (is /LUA_REFNIL/ if the latter is /nil/);
-    //   if /sepstate_event/ is true, Lua reference (in /sepstate.L/'s registry) to the compiled
+    //   if /sepstate_event/ is true, Lua reference (in /sepstate->L/'s registry) to the compiled
     //      /widget.event/ function of this widget.
     // Stillborn: /LUA_REFNIL/.
     int lref_event;
 
-    // Normal: whether /lref_event/ is a reference in /sepstate.L/'s registry, as opposed to
+    // Normal: whether /lref_event/ is a reference in /sepstate->L/'s registry, as opposed to
     // /L/'s one.
     // Stillborn: /true/.
     bool sepstate_event;
 
+    // Normal: if /sepstate_event/ is true, the separate state /widget.event/ is compiled in.
+    // Stillborn: /NULL/.
+    struct SepState *sepstate;
+
+    // Normal and stillborn: the queue of events on this widget (allocated).
+    EventQueue *evq;
+
     // Normal: an allocated zero-terminated string with widget's file name.
     // Stillborn: undefined.
     char *filename;
+
+    // Normal: whether the widget wants to be run in a reactor of its own, as specified in
+    // /widget.dedicated_thread/. Only makes sense if the plugin implements the second revision of
+    // the interface.
+    // Stillborn: undefined.
+    bool dedicated_thread;
+
+    // Normal: whether bursts of scroll events on this widget are coalesced, as specified in
+    // /widget.coalesce_scroll/.
+    // Stillborn: undefined.
+    bool coalesce_scroll;
+
+    // Normal: if the plugin implements the second revision of the interface, the reactor source
+    // this widget is run in (set in /main()/); /NULL/ otherwise.
+    // Stillborn: undefined.
+    ReactorSource *source;
+
+    // Normal: if the plugin implements the second revision of the interface, whether the plugin's
+    // /start()/ has already been called. Only accessed from reactor callbacks of /source/.
+    // Stillborn: undefined.
+    bool started;
+
+    // Normal: a buffer /widget.cb/'s results are serialized into (see /snapshot_serialize()/).
+    // Guarded by /interp->mtx/.
+    // Stillborn: undefined.
+    LSString snapbuf;
+
+    // Normal: an allocated zero-terminated string that identifies this widget in log messages from
+    // its plugin, "<plugin name>@<file name>".
+    // Stillborn: undefined.
+    char *log_who;
+
+    // Normal and stillborn: rate-limiting state of log messages concerning this widget.
+    LoggerRate log_rate;
+
+    // Normal and stillborn: runtime metrics of this widget (allocated).
+    WidgetStats *stats;
+
+    // Normal: if the /-P/ option has been passed, this widget's profile; /NULL/ otherwise.
+    // Stillborn: /NULL/.
+    Profile *profile;
+
+    // Normal: /widget.cb_budget/, in nanoseconds, or /0/ if there is none.
+    // Stillborn: undefined.
+    uint64_t budget_ns;
+
+    // Normal: the number of consecutive calls that have overrun /budget_ns/. Guarded by
+    // /interp->mtx/.
+    // Stillborn: undefined.
+    unsigned budget_strikes;
+
+    // Normal: the time (as returned by /stats_now()/) until which the calls of /widget.cb/ and
+    // /widget.event/ are skipped because of overruns of /budget_ns/, or /0/. Guarded by
+    // /interp->mtx/.
+    // Stillborn: undefined.
+    uint64_t backoff_until;
+
+    // Normal: the minimum interval between two calls of /widget.cb/ made on behalf of the plugin,
+    // in nanoseconds, as specified in /widget.min_interval/ or /widget.max_rate/; or /0/ if there
+    // is none.
+    // Stillborn: undefined.
+    uint64_t min_interval_ns;
+
+    // Normal: the time (as returned by /stats_now()/) the last call of /widget.cb/ started at, or
+    // /0/. Guarded by /interp->mtx/.
+    // Stillborn: undefined.
+    uint64_t last_cb;
+
+    // Normal and stillborn: the payload of the latest plugin call that has been deferred because of
+    // /min_interval_ns/ (see /pacer/), or /NULL/. Guarded by /pacer.mtx/.
+    Snapshot *deferred;
+
+    // Normal: the time (as returned by /stats_now()/) /deferred/ is due at. Guarded by /pacer.mtx/.
+    // Stillborn: undefined.
+    uint64_t deferred_due;
+
+    // Normal and stillborn: the latest update of this widget that has not yet been consumed by the
+    // render thread: either a snapshot of /widget.cb/'s result, /ERROR_SNAPSHOT/, or /NULL/ if
+    // there is none. Only accessed atomically; see /publish()/.
+    Snapshot *slot;
+
+    // Normal and stillborn: whether the last update of this widget has been successfully passed to
+    // barlib's /set()/, and, if so, the structural hash (see /snapshot_hash()/) of it. Only
+    // accessed by the render thread.
+    bool set_hash_valid;
+    uint64_t set_hash;
 } Widget;
 
+static inline bool widget_is_stillborn(Widget *w)
+{
+    return !w->L;
+}
+
 static const char *loglevel_names[] = {
     [LUASTATUS_LOG_FATAL]   = "fatal",
     [LUASTATUS_LOG_ERR]     = "error",
@@ -152,19 +369,154 @@ static const char *loglevel_names[] = {
 static int loglevel = LUASTATUS_LOG_INFO;
 
 static struct {
-    // The interface loaded from this barlib's .so file.
-    LuastatusBarlibIface_v1 iface;
+    // The revision of the barlib interface this barlib implements: either /1/ or /2/.
+    int iface_rev;
+
+    // The interface loaded from this barlib's .so file. If /iface_rev/ is /1/, it is converted from
+    // /LuastatusBarlibIface_v1/, and /iface.flush/ is /NULL/.
+    LuastatusBarlibIface_v2 iface;
 
     // This barlib's data.
     LuastatusBarlibData_v1 data;
 
-    // A mutex guarding calls to /iface.set()/ and /iface.set_error()/.
-    pthread_mutex_t set_mtx;
-
     // A handle returned from /dlopen/ for this barlib's .so file.
     void *dlhandle;
 } barlib;
 
+// All the calls to barlib's /set()/, /set_error()/ and /flush()/ methods are made by a single
+// *render thread*. Widgets do not call the barlib; instead, they *publish* their updates into
+// per-widget slots (see /publish()/), with the latest value winning, and wake the render thread up.
+// The render thread then consumes all the filled slots, re-creating widgets' results in its own
+// Lua state, passes them to the barlib, and, for barlibs implementing the second revision of the
+// interface, calls /flush()/ once.
+//
+// This way, neither a slow barlib nor a stalled output pipe blocks widgets' threads.
+
+// Frame period, in milliseconds, as specified with the /-F/ option.
+//
+// If this is not zero, updates of widgets are coalesced: once woken up, the render thread waits for
+// /frame_period_ms/ milliseconds before consuming the slots, so that all the updates that happen in
+// between are passed to the barlib together (and, if the barlib implements the second revision of
+// the interface, result in a single redraw).
+static unsigned frame_period_ms = 0;
+
+// The directory passed with the /-P/ option, or /NULL/ if widgets are not to be profiled.
+static const char *profile_dir = NULL;
+
+static struct {
+    // The render thread's Lua interpreter instance.
+    lua_State *L;
+
+    // The allocator of /L/.
+    LuaAlloc alloc;
+
+    // Whether any slot may have been filled since the render thread last started consuming them.
+    // Only accessed atomically.
+    bool pending;
+
+    // Whether the render thread should consume the slots one last time and terminate. Only accessed
+    // atomically.
+    bool quit;
+
+    // Whether updates structurally equal to the ones last passed to the barlib are skipped (see
+    // /render_update()/). Set before the render thread is spawned.
+    bool skip_unchanged;
+
+    // Posted whenever either /pending/ becomes /true/ or /quit/ is set.
+    sem_t wakeup;
+
+    // Whether the render thread has been spawned and not yet joined. Only accessed by the main
+    // thread.
+    bool running;
+
+    pthread_t thread;
+} render = {.L = NULL, .running = false};
+
+// Events reported by the barlib's event watcher are not handled on its thread, so that a slow
+// /widget.event/ does not stall it. Instead, /ew_call_begin()/ hands out the *staging state*
+// /evq.L/, and /ew_call_end()/ serializes the event object pushed onto it into a snapshot and
+// appends that to the widget's bounded /EventQueue/. A few *event workers* then pass the queued
+// events to /widget.event/ functions. Events on a single widget are handled one at a time, in
+// order; the widget is put at the back of /ready/ after each one, so that events on a busy widget
+// do not starve the others.
+//
+// If /widget.coalesce_scroll/ is true, bursts of scroll events are coalesced: a scroll event with
+// the same button as the last event in the widget's queue is merged into it, and /widget.event/ is
+// then passed the event with an additional /count/ field.
+static struct {
+    // The staging state, and its allocator.
+    lua_State *L;
+    LuaAlloc alloc;
+
+    // A mutex guarding /L/ and /buf/; held between /ew_call_begin()/ and /ew_call_end()/.
+    pthread_mutex_t stage_mtx;
+
+    // A buffer event objects are serialized into.
+    LSString buf;
+
+    // A mutex guarding /ready/, /quit/ and the widgets' /EventQueue/s.
+    pthread_mutex_t mtx;
+
+    // Signalled when a widget is added into /ready/, or /quit/ is set; used with /mtx/.
+    pthread_cond_t cond;
+
+    // A ring buffer (of capacity /nwidgets/) of /ready_size/ indices of widgets with queued events
+    // not being handled by any event worker, starting at /ready_head/.
+    size_t *ready;
+    size_t ready_head;
+    size_t ready_size;
+
+    // Whether the event workers should terminate once there are no queued events left.
+    bool quit;
+
+    // The event workers.
+    pthread_t *workers;
+    size_t nworkers;
+
+    // Whether the staging state has been created and the event workers have been spawned and not
+    // yet joined. Only accessed by the main thread.
+    bool running;
+} evq = {.running = false};
+
+// The maximum number of event workers.
+#define EVQ_MAX_WORKERS 4
+
+// The barlib may pause the widgets, e.g. while the bar is hidden (see /set_paused()/). While
+// paused, plugin calls are deferred (see /pacer/), so that only the latest one of each widget gets
+// evaluated on resumption, and the reactors are paused (see reactor.h), so that timeouts of
+// event-loop based plugins do not fire. The *pause thread* applies the requested state.
+static struct {
+    // The state last requested with /set_paused()/. Only accessed atomically.
+    bool requested;
+
+    // Whether the widgets are paused. Only written by the pause thread, with /pacer.mtx/ locked;
+    // only read atomically or with /pacer.mtx/ locked.
+    bool paused;
+
+    // Posted by /set_paused()/, and when /quit/ is set.
+    sem_t wakeup;
+
+    // Whether the pause thread should terminate. Only accessed atomically.
+    bool quit;
+
+    // The reactors to pause.
+    Reactor *const *reactors;
+    size_t nreactors;
+
+    // Whether /wakeup/ has been initialized. Only accessed by the main thread.
+    bool inited;
+
+    // Whether the pause thread has been spawned and not yet joined. Only accessed by the main
+    // thread.
+    bool running;
+
+    pthread_t thread;
+} pausectl = {.requested = false, .paused = false, .inited = false, .running = false};
+
+// A sentinel value of /Widget::slot/ that tells the render thread to call barlib's /set_error()/.
+static Snapshot error_snapshot;
+#define ERROR_SNAPSHOT (&error_snapshot)
+
 // These two are initially (explicitly) set to /NULL/ and /0/ correspondingly, so that the
 // destruction function (/widgets_destroy()/) can be invoked at any time (that is, before or after
 // their initialization with actual values, not in the middle of it).
@@ -173,21 +525,50 @@ static struct {
 static Widget *widgets = NULL;
 static size_t nwidgets = 0;
 
-// This "separate state" thing serves two purposes:
-//   1. If a widget has a /widget.event/ variable of string type, it is compiled in /sepstate.L/ Lua
-//      interpreter instance as a function; a reference to it is stored in that widget's
-//      /lref_event/ field; and the /sepstate_event/ field of that widget is set to /true/.
-//   2. As has been already described above, /sepstate.L/ is provided to barlib's /event_watcher()/
-//      each time it attempts to generate an event on a stillborn widget; the event object is then
-//      simply discarded.
-static struct {
-    // Separate state's Lua interpreter instance. Initially is (explicitly) set to /NULL/, which
-    // indicates that the separate state was not initialized yet.
+// If a widget has a /widget.event/ variable of string type, it is compiled in a "separate state"'s
+// Lua interpreter instance as a function; a reference to it is stored in that widget's
+// /lref_event/ field; the /sepstate_event/ field of that widget is set to /true/, and its
+// /sepstate/ field points to the separate state.
+//
+// There is a pool of /sepstate.n/ separate states (see the /-E/ option); widget with index /i/ is
+// assigned to the one with index /i % sepstate.n/, so that events on widgets assigned to
+// different separate states are handled in parallel. Each separate state is created lazily, once
+// the first widget assigned to it needs it.
+typedef struct SepState {
+    // Separate state's Lua interpreter instance, or /NULL/ if it was not initialized yet.
     lua_State *L;
 
+    // The allocator of /L/.
+    LuaAlloc alloc;
+
     // A mutex guarding /L/.
     pthread_mutex_t L_mtx;
-} sepstate = {.L = NULL};
+} SepState;
+
+static struct {
+    // The number of separate states, as specified with the /-E/ option.
+    size_t n;
+
+    // An allocated array of /n/ separate states, or /NULL/ before /sepstates_init()/ is called.
+    SepState *states;
+
+    // A mutex guarding the lazy initialization of the separate states, as widgets are initialized
+    // concurrently.
+    pthread_mutex_t init_mtx;
+} sepstate = {.n = 1, .states = NULL, .init_mtx = PTHREAD_MUTEX_INITIALIZER};
+
+// In shared-interpreter mode (the /-s/ option), instead of each widget getting a Lua interpreter
+// instance of its own, widgets are distributed among a few shared ones in a round-robin fashion.
+// Each widget file is run with an environment table of its own, whose metatable's /__index/ is the
+// global table, and which has its own /luastatus/ module; so widgets do not see each other's
+// globals, unless they explicitly use /_G/.
+static struct {
+    // The number of shared interpreters; zero if not in shared-interpreter mode.
+    size_t n;
+
+    // Shared interpreters; one whose /L/ is /NULL/ has not been initialized (yet).
+    Interp *interps;
+} shared = {.n = 0, .interps = NULL};
 
 // See DOCS/design/map_get.md
 //
@@ -207,7 +588,62 @@ static struct {
 
     // Whether the map is frozen after all plugins and widgets have been initialized.
     bool frozen;
-} map = {.entries = LS_VECTOR_NEW(), .frozen = false};
+
+    // As widgets are initialized concurrently, a widget's initialization thread locks this mutex on
+    // the first call to /map_get()/, and unlocks it once the plugin's /init()/ has returned (see
+    // /widget_unlock_map()/). This way, plugins can safely do check-then-set on the values.
+    pthread_mutex_t mtx;
+} map = {.entries = LS_VECTOR_NEW(), .frozen = false, .mtx = PTHREAD_MUTEX_INITIALIZER};
+
+// Plugins and barlibs linked into the luastatus binary (see builtins.in.h). Their interface
+// variables are declared weak, as each of them only defines the one of the revision it implements.
+
+typedef struct BuiltinPlugin {
+    const char *name;
+    LuastatusPluginIface_v1 *iface_v1;
+    LuastatusPluginIface_v2 *iface_v2;
+} BuiltinPlugin;
+
+typedef struct {
+    const char *name;
+    LuastatusBarlibIface_v1 *iface_v1;
+    LuastatusBarlibIface_v2 *iface_v2;
+} BuiltinBarlib;
+
+#define DECLARE_BUILTIN_PLUGIN(Name_, Id_) \
+    extern LuastatusPluginIface_v1 luastatus_builtin_##Id_##_iface_v1 LS_ATTR_WEAK; \
+    extern LuastatusPluginIface_v2 luastatus_builtin_##Id_##_iface_v2 LS_ATTR_WEAK;
+#define DECLARE_BUILTIN_BARLIB(Name_, Id_) \
+    extern LuastatusBarlibIface_v1 luastatus_builtin_##Id_##_iface_v1 LS_ATTR_WEAK; \
+    extern LuastatusBarlibIface_v2 luastatus_builtin_##Id_##_iface_v2 LS_ATTR_WEAK;
+#define BUILTIN_ENTRY(Name_, Id_) \
+    {Name_, &luastatus_builtin_##Id_##_iface_v1, &luastatus_builtin_##Id_##_iface_v2},
+
+LUASTATUS_BUILTIN_PLUGINS(DECLARE_BUILTIN_PLUGIN)
+LUASTATUS_BUILTIN_BARLIBS(DECLARE_BUILTIN_BARLIB)
+
+// Both are terminated with an entry with /NULL/ name.
+static const BuiltinPlugin builtin_plugins[] = {
+    LUASTATUS_BUILTIN_PLUGINS(BUILTIN_ENTRY)
+    {NULL, NULL, NULL},
+};
+static const BuiltinBarlib builtin_barlibs[] = {
+    LUASTATUS_BUILTIN_BARLIBS(BUILTIN_ENTRY)
+    {NULL, NULL, NULL},
+};
+
+#undef DECLARE_BUILTIN_PLUGIN
+#undef DECLARE_BUILTIN_BARLIB
+#undef BUILTIN_ENTRY
+
+// The registry of loaded plugin modules, keyed by file identity, so that each plugin .so file is
+// loaded only once, no matter how many widgets use it.
+static struct {
+    LS_VECTOR_OF(PluginModule *) modules;
+
+    // A mutex guarding /modules/, as widgets are initialized (and may fail to) concurrently.
+    pthread_mutex_t mtx;
+} plugin_registry = {.modules = LS_VECTOR_NEW(), .mtx = PTHREAD_MUTEX_INITIALIZER};
 
 // This function exists because /dlerror()/ may return /NULL/ even if /dlsym()/ returned /NULL/.
 static inline const char *safe_dlerror(void)
@@ -232,23 +668,15 @@ static int loglevel_fromstr(const char *str)
 // The generic logging function: generates a log message with level /level/ from a given /subsystem/
 // (either a plugin or a barlib name; or /NULL/, which means the message is from the luastatus
 // program itself) using the format string /fmt/ and variable arguments supplied as /vl/, as if with
-// /vsnprintf(<unspecified>, fmt, vl)/.
-static void common_vsayf(int level, const char *subsystem, const char *fmt, va_list vl)
+// /vsnprintf(<unspecified>, fmt, vl)/. If /rate/ is not /NULL/, the message is rate-limited with it
+// (see logger.h).
+static void common_vsayf(int level, const char *subsystem, LoggerRate *rate, const char *fmt,
+                         va_list vl)
 {
     if (level > loglevel) {
         return;
     }
-
-    char buf[1024];
-    if (vsnprintf(buf, sizeof(buf), fmt, vl) < 0) {
-        buf[0] = '\0';
-    }
-
-    if (subsystem) {
-        fprintf(stderr, "luastatus: (%s) %s: %s\n", subsystem, loglevel_names[level], buf);
-    } else {
-        fprintf(stderr, "luastatus: %s: %s\n", loglevel_names[level], buf);
-    }
+    logger_log(level, loglevel_names[level], subsystem, rate, fmt, vl);
 }
 
 // The "internal" logging function: generates a log message from the luastatus program itself with
@@ -259,7 +687,23 @@ void sayf(int level, const char *fmt, ...)
 {
     va_list vl;
     va_start(vl, fmt);
-    common_vsayf(level, NULL, fmt, vl);
+    common_vsayf(level, NULL, NULL, fmt, vl);
+    va_end(vl);
+}
+
+// Reports a problem with the bytecode cache; see bytecode_cache.h.
+static void bytecode_cache_warn(const char *msg)
+{
+    WARNF("bytecode cache: %s", msg);
+}
+
+// Like /sayf()/, but the message is attributed to widget /w/ for the purposes of rate-limiting.
+static LS_ATTR_PRINTF(3, 4)
+void wsayf(Widget *w, int level, const char *fmt, ...)
+{
+    va_list vl;
+    va_start(vl, fmt);
+    common_vsayf(level, NULL, &w->log_rate, fmt, vl);
     va_end(vl);
 }
 
@@ -272,11 +716,9 @@ static void external_sayf(void *userdata, int level, const char *fmt, ...)
     va_start(vl, fmt);
     if (userdata) {
         Widget *w = userdata;
-        char who[1024];
-        snprintf(who, sizeof(who), "%s@%s", w->plugin.name, w->filename);
-        common_vsayf(level, who, fmt, vl);
+        common_vsayf(level, w->log_who, &w->log_rate, fmt, vl);
     } else {
-        common_vsayf(level, "barlib", fmt, vl);
+        common_vsayf(level, "barlib", NULL, fmt, vl);
     }
     va_end(vl);
 }
@@ -292,6 +734,13 @@ static void **map_get(void *userdata, const char *key)
         abort();
     }
 
+    // /userdata/ is /NULL/ if called by the barlib, which is initialized after all the widgets.
+    Widget *w = userdata;
+    if (w && !w->map_locked) {
+        LS_PTH_CHECK(pthread_mutex_lock(&map.mtx));
+        w->map_locked = true;
+    }
+
     for (size_t i = 0; i < map.entries.size; ++i) {
         MapEntry *e = map.entries.data[i];
         if (strcmp(key, e->key) == 0) {
@@ -317,12 +766,63 @@ static void map_destroy(void)
     LS_VECTOR_FREE(map.entries);
 }
 
+// Sets /barlib.iface/ and /barlib.iface_rev/ from either /iface_v2/ or, if it is /NULL/,
+// /iface_v1/.
+static void barlib_set_iface(const LuastatusBarlibIface_v1 *iface_v1,
+                             const LuastatusBarlibIface_v2 *iface_v2)
+{
+    if (iface_v2) {
+        barlib.iface_rev = 2;
+        barlib.iface = *iface_v2;
+    } else {
+        barlib.iface_rev = 1;
+        barlib.iface = (LuastatusBarlibIface_v2) {
+            .init = iface_v1->init,
+            .register_funcs = iface_v1->register_funcs,
+            .set = iface_v1->set,
+            .set_error = iface_v1->set_error,
+            .event_watcher = iface_v1->event_watcher,
+            .flush = NULL,
+            .destroy = iface_v1->destroy,
+        };
+    }
+}
+
+// Implementation of /LuastatusBarlibData_v1::set_paused/; only wakes the pause thread up, so as to
+// be async-signal-safe.
+static void set_paused(void *userdata, bool paused)
+{
+    (void) userdata;
+    __atomic_store_n(&pausectl.requested, paused, __ATOMIC_SEQ_CST);
+    int saved_errno = errno;
+    sem_post(&pausectl.wakeup);
+    errno = saved_errno;
+}
+
+// Initializes the barlib, whose interface has already been set, with options /opts/ and the
+// number of widgets /nwidgets/ (a global variable).
+static bool barlib_init_loaded(const char *const *opts)
+{
+    barlib.data = (LuastatusBarlibData_v1) {
+        .userdata = NULL,
+        .sayf = external_sayf,
+        .map_get = map_get,
+        .set_paused = set_paused,
+    };
+
+    if (barlib.iface.init(&barlib.data, opts, nwidgets) == LUASTATUS_ERR) {
+        ERRF("barlib's init() failed");
+        return false;
+    }
+    DEBUGF("barlib successfully initialized (interface revision %d)", barlib.iface_rev);
+    return true;
+}
+
 // Loads /barlib/ from a file /filename/ and initializes with options /opts/ and the number of
 // widgets /nwidgets/ (a global variable).
 static bool barlib_init(const char *filename, const char *const *opts)
 {
     barlib.dlhandle = NULL;
-    LS_PTH_CHECK(pthread_mutex_init(&barlib.set_mtx, NULL));
 
     DEBUGF("initializing barlib from file '%s'", filename);
 
@@ -341,67 +841,81 @@ static bool barlib_init(const char *filename, const char *const *opts)
              filename, *p_lua_ver, LUA_VERSION_NUM);
         goto error;
     }
-    LuastatusBarlibIface_v1 *p_iface = dlsym(barlib.dlhandle, "luastatus_barlib_iface_v1");
-    if (!p_iface) {
-        ERRF("dlsym: luastatus_barlib_iface_v1: %s", safe_dlerror());
-        goto error;
+    LuastatusBarlibIface_v2 *p_iface_v2 = dlsym(barlib.dlhandle, "luastatus_barlib_iface_v2");
+    LuastatusBarlibIface_v1 *p_iface = NULL;
+    if (!p_iface_v2) {
+        (void) dlerror(); // clear last error
+        p_iface = dlsym(barlib.dlhandle, "luastatus_barlib_iface_v1");
+        if (!p_iface) {
+            ERRF("dlsym: luastatus_barlib_iface_v1: %s", safe_dlerror());
+            goto error;
+        }
     }
-    barlib.iface = *p_iface;
-    barlib.data = (LuastatusBarlibData_v1) {
-        .userdata = NULL,
-        .sayf = external_sayf,
-        .map_get = map_get,
-    };
+    barlib_set_iface(p_iface, p_iface_v2);
 
-    if (barlib.iface.init(&barlib.data, opts, nwidgets) == LUASTATUS_ERR) {
-        ERRF("barlib's init() failed");
+    if (!barlib_init_loaded(opts)) {
         goto error;
     }
-    DEBUGF("barlib successfully initialized");
     return true;
 
 error:
     if (barlib.dlhandle) {
         dlclose(barlib.dlhandle);
     }
-    LS_PTH_CHECK(pthread_mutex_destroy(&barlib.set_mtx));
     return false;
 }
 
 // The result is same to calling /barlib_init(<filename>, opts)/, where /<filename>/ is the file
-// name guessed for name /name/.
+// name guessed for name /name/; unless there is a built-in barlib named /name/, in which case that
+// one is used.
 static bool barlib_init_by_name(const char *name, const char *const *opts)
 {
     if ((strchr(name, '/'))) {
         return barlib_init(name, opts);
-    } else {
-        LSString filename = ls_string_newz_from_f("%s/barlib-%s.so", LUASTATUS_BARLIBS_DIR, name);
-        bool r = barlib_init(filename.data, opts);
-        LS_VECTOR_FREE(filename);
-        return r;
     }
+    for (const BuiltinBarlib *b = builtin_barlibs; b->name; ++b) {
+        if (strcmp(b->name, name) == 0) {
+            DEBUGF("initializing built-in barlib '%s'", name);
+            if (!b->iface_v1 && !b->iface_v2) {
+                ERRF("built-in barlib '%s' defines no interface", name);
+                return false;
+            }
+            barlib.dlhandle = NULL;
+            barlib_set_iface(b->iface_v1, b->iface_v2);
+            return barlib_init_loaded(opts);
+        }
+    }
+    LSString filename = ls_string_newz_from_f("%s/barlib-%s.so", LUASTATUS_BARLIBS_DIR, name);
+    bool r = barlib_init(filename.data, opts);
+    LS_VECTOR_FREE(filename);
+    return r;
 }
 
 static void barlib_destroy(void)
 {
     barlib.iface.destroy(&barlib.data);
-    dlclose(barlib.dlhandle);
-    LS_PTH_CHECK(pthread_mutex_destroy(&barlib.set_mtx));
+    if (barlib.dlhandle) {
+        dlclose(barlib.dlhandle);
+    }
 }
 
-static bool plugin_load(Plugin *p, const char *filename, const char *name)
+// Loads a new plugin module from file /filename/ with status /st/. On failure, /NULL/ is returned.
+static PluginModule *plugin_module_load(const char *filename, const struct stat *st)
 {
-    p->dlhandle = NULL;
-    p->name = ls_xstrdup(name);
+    PluginModule *mod = LS_XNEW(PluginModule, 1);
+    mod->builtin = NULL;
+    mod->dev = st->st_dev;
+    mod->ino = st->st_ino;
+    mod->refcount = 1;
 
     DEBUGF("loading plugin from file '%s'", filename);
 
     (void) dlerror(); // clear last error
-    if (!(p->dlhandle = dlopen(filename, RTLD_NOW | RTLD_LOCAL))) {
+    if (!(mod->dlhandle = dlopen(filename, RTLD_NOW | RTLD_LOCAL))) {
         ERRF("dlopen: %s: %s", filename, safe_dlerror());
         goto error;
     }
-    int *p_lua_ver = dlsym(p->dlhandle, "LUASTATUS_PLUGIN_LUA_VERSION_NUM");
+    int *p_lua_ver = dlsym(mod->dlhandle, "LUASTATUS_PLUGIN_LUA_VERSION_NUM");
     if (!p_lua_ver) {
         ERRF("dlsym: LUASTATUS_PLUGIN_LUA_VERSION_NUM: %s", safe_dlerror());
         goto error;
@@ -411,49 +925,215 @@ static bool plugin_load(Plugin *p, const char *filename, const char *name)
              filename, *p_lua_ver, LUA_VERSION_NUM);
         goto error;
     }
-    LuastatusPluginIface_v1 *p_iface = dlsym(p->dlhandle, "luastatus_plugin_iface_v1");
-    if (!p_iface) {
-        ERRF("dlsym: luastatus_plugin_iface_v1: %s", safe_dlerror());
-        goto error;
+    LuastatusPluginIface_v2 *p_iface_v2 = dlsym(mod->dlhandle, "luastatus_plugin_iface_v2");
+    if (p_iface_v2) {
+        mod->iface_rev = 2;
+        mod->iface.v2 = *p_iface_v2;
+    } else {
+        (void) dlerror(); // clear last error
+        LuastatusPluginIface_v1 *p_iface = dlsym(mod->dlhandle, "luastatus_plugin_iface_v1");
+        if (!p_iface) {
+            ERRF("dlsym: luastatus_plugin_iface_v1: %s", safe_dlerror());
+            goto error;
+        }
+        mod->iface_rev = 1;
+        mod->iface.v1 = *p_iface;
     }
-    p->iface = *p_iface;
-    DEBUGF("plugin successfully loaded");
-    return true;
+    DEBUGF("plugin successfully loaded (interface revision %d)", mod->iface_rev);
+    return mod;
 
 error:
-    if (p->dlhandle) {
-        dlclose(p->dlhandle);
+    if (mod->dlhandle) {
+        dlclose(mod->dlhandle);
     }
-    free(p->name);
-    return false;
+    free(mod);
+    return NULL;
+}
+
+static bool plugin_load(Plugin *p, const char *filename, const char *name)
+{
+    struct stat st;
+    if (stat(filename, &st) < 0) {
+        char buf[256];
+        ERRF("%s: %s", filename, ls_strerror_r(errno, buf, sizeof(buf)));
+        return false;
+    }
+
+    LS_PTH_CHECK(pthread_mutex_lock(&plugin_registry.mtx));
+
+    PluginModule *mod = NULL;
+    for (size_t i = 0; i < plugin_registry.modules.size; ++i) {
+        PluginModule *m = plugin_registry.modules.data[i];
+        if (!m->builtin && m->dev == st.st_dev && m->ino == st.st_ino) {
+            mod = m;
+            break;
+        }
+    }
+    if (mod) {
+        DEBUGF("plugin from file '%s' is already loaded", filename);
+        ++mod->refcount;
+    } else if ((mod = plugin_module_load(filename, &st))) {
+        LS_VECTOR_PUSH(plugin_registry.modules, mod);
+    }
+
+    LS_PTH_CHECK(pthread_mutex_unlock(&plugin_registry.mtx));
+
+    if (!mod) {
+        return false;
+    }
+    p->mod = mod;
+    p->name = ls_xstrdup(name);
+    return true;
+}
+
+// Like /plugin_load()/, but for built-in plugin /b/.
+static bool plugin_load_builtin(Plugin *p, const BuiltinPlugin *b, const char *name)
+{
+    if (!b->iface_v1 && !b->iface_v2) {
+        ERRF("built-in plugin '%s' defines no interface", b->name);
+        return false;
+    }
+
+    LS_PTH_CHECK(pthread_mutex_lock(&plugin_registry.mtx));
+
+    PluginModule *mod = NULL;
+    for (size_t i = 0; i < plugin_registry.modules.size; ++i) {
+        PluginModule *m = plugin_registry.modules.data[i];
+        if (m->builtin == b) {
+            mod = m;
+            break;
+        }
+    }
+    if (mod) {
+        ++mod->refcount;
+    } else {
+        DEBUGF("using built-in plugin '%s'", b->name);
+        mod = LS_XNEW(PluginModule, 1);
+        mod->builtin = b;
+        mod->refcount = 1;
+        mod->dlhandle = NULL;
+        if (b->iface_v2) {
+            mod->iface_rev = 2;
+            mod->iface.v2 = *b->iface_v2;
+        } else {
+            mod->iface_rev = 1;
+            mod->iface.v1 = *b->iface_v1;
+        }
+        LS_VECTOR_PUSH(plugin_registry.modules, mod);
+    }
+
+    LS_PTH_CHECK(pthread_mutex_unlock(&plugin_registry.mtx));
+
+    p->mod = mod;
+    p->name = ls_xstrdup(name);
+    return true;
 }
 
 static bool plugin_load_by_name(Plugin *p, const char *name)
 {
     if ((strchr(name, '/'))) {
         return plugin_load(p, name, name);
-    } else {
-        LSString filename = ls_string_newz_from_f("%s/plugin-%s.so", LUASTATUS_PLUGINS_DIR, name);
-        bool r = plugin_load(p, filename.data, name);
-        LS_VECTOR_FREE(filename);
-        return r;
     }
+    for (const BuiltinPlugin *b = builtin_plugins; b->name; ++b) {
+        if (strcmp(b->name, name) == 0) {
+            return plugin_load_builtin(p, b, name);
+        }
+    }
+    LSString filename = ls_string_newz_from_f("%s/plugin-%s.so", LUASTATUS_PLUGINS_DIR, name);
+    bool r = plugin_load(p, filename.data, name);
+    LS_VECTOR_FREE(filename);
+    return r;
 }
 
 static void plugin_unload(Plugin *p)
 {
     free(p->name);
-    dlclose(p->dlhandle);
+
+    LS_PTH_CHECK(pthread_mutex_lock(&plugin_registry.mtx));
+    PluginModule *mod = p->mod;
+    if (!--mod->refcount) {
+        for (size_t i = 0; i < plugin_registry.modules.size; ++i) {
+            if (plugin_registry.modules.data[i] == mod) {
+                size_t last = --plugin_registry.modules.size;
+                plugin_registry.modules.data[i] = plugin_registry.modules.data[last];
+                break;
+            }
+        }
+        if (mod->dlhandle) {
+            dlclose(mod->dlhandle);
+        }
+        free(mod);
+    }
+    if (!plugin_registry.modules.size) {
+        // Let us please valgrind.
+        LS_VECTOR_FREE(plugin_registry.modules);
+        LS_VECTOR_INIT(plugin_registry.modules);
+    }
+    LS_PTH_CHECK(pthread_mutex_unlock(&plugin_registry.mtx));
 }
 
-static lua_State *xnew_lua_state(void)
+// The following functions dispatch calls to the functions common to all the revisions of the plugin
+// interface.
+
+static inline int plugin_iface_init(Plugin *p, LuastatusPluginData_v1 *pd, lua_State *L)
 {
-    lua_State *L = luaL_newstate();
-    if (!L) {
-        FATALF("luaL_newstate() failed: out of memory?");
-        abort();
-    }
-    return L;
+    return p->mod->iface_rev == 1 ? p->mod->iface.v1.init(pd, L) : p->mod->iface.v2.init(pd, L);
+}
+
+static inline bool plugin_iface_has_register_funcs(Plugin *p)
+{
+    return p->mod->iface_rev == 1
+        ? !!p->mod->iface.v1.register_funcs
+        : !!p->mod->iface.v2.register_funcs;
+}
+
+static inline void plugin_iface_register_funcs(Plugin *p, LuastatusPluginData_v1 *pd, lua_State *L)
+{
+    if (p->mod->iface_rev == 1) {
+        p->mod->iface.v1.register_funcs(pd, L);
+    } else {
+        p->mod->iface.v2.register_funcs(pd, L);
+    }
+}
+
+static inline void plugin_iface_destroy(Plugin *p, LuastatusPluginData_v1 *pd)
+{
+    if (p->mod->iface_rev == 1) {
+        p->mod->iface.v1.destroy(pd);
+    } else {
+        p->mod->iface.v2.destroy(pd);
+    }
+}
+
+static int l_panic(lua_State *L)
+{
+    FATALF("unprotected error in call to Lua API (%s)", lua_tostring(L, -1));
+    return 0; // Lua calls /abort()/ then
+}
+
+// Creates a new Lua interpreter instance that allocates memory with /alloc/, which is initialized
+// by this function. If /out_alloc_used/ is not /NULL/, writes into it whether /alloc/ is actually
+// used: LuaJIT on some platforms does not support custom allocators, and in this case, the
+// instance uses the default allocator.
+static lua_State *xnew_lua_state(LuaAlloc *alloc, bool *out_alloc_used)
+{
+    lua_alloc_init(alloc);
+    bool alloc_used = true;
+    lua_State *L = lua_newstate(lua_alloc_func, alloc);
+    if (L) {
+        lua_atpanic(L, l_panic);
+    } else {
+        alloc_used = false;
+        L = luaL_newstate();
+    }
+    if (!L) {
+        FATALF("luaL_newstate() failed: out of memory?");
+        abort();
+    }
+    if (out_alloc_used) {
+        *out_alloc_used = alloc_used;
+    }
+    return L;
 }
 
 // Returns a string representation of an error object located at the position /pos/ of /L/'s stack.
@@ -526,6 +1206,7 @@ static inline bool do_lua_call(lua_State *L, int nargs, int nresults)
 static int l_os_exit(lua_State *L)
 {
     int code = luaL_optinteger(L, 1, /*default value*/ EXIT_SUCCESS);
+    logger_flush();
     fflush(NULL);
     _exit(code);
 }
@@ -550,8 +1231,25 @@ static int l_os_setlocale(lua_State *L)
     return 1;
 }
 
-// Implementation of /luastatus.require_plugin()/. Expects a single upvalue: an initially empty
-// table that will be used as a registry of loaded Lua plugins.
+// Sets the environment of the function on top of /L/'s stack to the value at position /idx/ (which
+// must not be a relative one).
+static void set_function_env(lua_State *L, int idx)
+{
+    // L: ? func
+    lua_pushvalue(L, idx); // L: ? func env
+#if LUA_VERSION_NUM >= 502
+    // The environment of a main chunk is its first (and only) upvalue, /_ENV/.
+    if (!lua_setupvalue(L, -2, 1)) {
+        lua_pop(L, 1); // L: ? func
+    }
+#else
+    lua_setfenv(L, -2); // L: ? func
+#endif
+}
+
+// Implementation of /luastatus.require_plugin()/. The upvalues are: a table of already loaded
+// derived plugins, and either the environment table derived plugins should be run with, or /nil/ if
+// with the global one.
 static int l_require_plugin(lua_State *L)
 {
     const char *arg = luaL_checkstring(L, 1);
@@ -566,19 +1264,72 @@ static int l_require_plugin(lua_State *L)
     lua_pop(L, 1); // L: ? table
 
     LSString filename = ls_string_newz_from_f("%s/%s.lua", LUASTATUS_PLUGINS_DIR, arg);
-    int r = luaL_loadfile(L, filename.data);
+    int r = bytecode_cache_loadfile(L, filename.data);
     LS_VECTOR_FREE(filename);
     if (r != 0) {
         return lua_error(L);
     }
 
     // L: ? table chunk
+    if (lua_istable(L, lua_upvalueindex(2))) {
+        set_function_env(L, lua_upvalueindex(2));
+    }
     lua_call(L, 0, 1); // L: ? table result
     lua_pushvalue(L, -1); // L: ? table result result
     lua_setfield(L, -3, arg); // L: ? table result
     return 1;
 }
 
+// Implementation of /luastatus.stats()/: returns a table mapping file names of the widgets to
+// tables with their metrics (see /stats_push()/). Returns an empty table if called while widgets
+// are still being initialized.
+static int l_stats(lua_State *L)
+{
+    lua_newtable(L); // L: table
+    if (!map.frozen) {
+        return 1;
+    }
+    for (size_t i = 0; i < nwidgets; ++i) {
+        Widget *w = &widgets[i];
+        if (widget_is_stillborn(w)) {
+            continue;
+        }
+        stats_push(L, w->stats); // L: table stats
+        lua_setfield(L, -2, w->filename); // L: table
+    }
+    return 1;
+}
+
+// Implementation of /luastatus.paused()/: returns whether the widgets are paused.
+static int l_paused(lua_State *L)
+{
+    lua_pushboolean(L, __atomic_load_n(&pausectl.paused, __ATOMIC_SEQ_CST));
+    return 1;
+}
+
+// Pushes a new /luastatus/ module table, except for the /luastatus.plugin/ and /luastatus.barlib/
+// submodules (created later), onto /L/'s stack. If /env_idx/ is not zero, derived plugins loaded by
+// its /require_plugin()/ function are run with the table at position /env_idx/ as the environment.
+static void push_luastatus_module(lua_State *L, int env_idx)
+{
+    lua_createtable(L, 0, 3); // L: ? table
+
+    lua_newtable(L); // L: ? table table
+    if (env_idx) {
+        lua_pushvalue(L, env_idx); // L: ? table table env
+    } else {
+        lua_pushnil(L); // L: ? table table nil
+    }
+    lua_pushcclosure(L, l_require_plugin, 2); // L: ? table l_require_plugin
+    lua_setfield(L, -2, "require_plugin"); // L: ? table
+
+    lua_pushcfunction(L, l_stats); // L: ? table l_stats
+    lua_setfield(L, -2, "stats"); // L: ? table
+
+    lua_pushcfunction(L, l_paused); // L: ? table l_paused
+    lua_setfield(L, -2, "paused"); // L: ? table
+}
+
 // 1. Replaces some of the functions in the standard library with our thread-safe counterparts.
 // 2. Registers the /luastatus/ module (just creates a global table actually) except for the
 //    /luastatus.plugin/ and /luastatus.barlib/ submodules (created later).
@@ -597,36 +1348,77 @@ static void inject_libs(lua_State *L)
 
     lua_pop(L, 1); // L: ?
 
-    lua_createtable(L, 0, 1); // L: ? table
+    push_luastatus_module(L, 0); // L: ? table
+    lua_setglobal(L, "luastatus"); // L: ?
+}
 
-    lua_newtable(L); // L: ? table table
-    lua_pushcclosure(L, l_require_plugin, 1); // L: ? table l_require_plugin
-    lua_setfield(L, -2, "require_plugin"); // L: ? table
+// Pushes a new environment table for a widget in shared-interpreter mode onto /L/'s stack.
+static void push_widget_env(lua_State *L)
+{
+    lua_newtable(L); // L: ? env
+    int env_idx = lua_gettop(L);
+
+    lua_createtable(L, 0, 1); // L: ? env mt
+#if LUA_VERSION_NUM >= 502
+    lua_pushglobaltable(L); // L: ? env mt _G
+#else
+    lua_pushvalue(L, LUA_GLOBALSINDEX); // L: ? env mt _G
+#endif
+    lua_setfield(L, -2, "__index"); // L: ? env mt
+    lua_setmetatable(L, -2); // L: ? env
 
-    lua_setglobal(L, "luastatus"); // L: ?
+    push_luastatus_module(L, env_idx); // L: ? env table
+    lua_setfield(L, -2, "luastatus"); // L: ? env
+}
+
+// Allocates /sepstate.states/; none of them is initialized yet.
+static void sepstates_init(void)
+{
+    sepstate.states = LS_XNEW(SepState, sepstate.n);
+    for (size_t i = 0; i < sepstate.n; ++i) {
+        sepstate.states[i].L = NULL;
+    }
 }
 
-static void sepstate_maybe_init(void)
+// Returns the separate state assigned to the widget with index /widget_idx/, initializing it if
+// needed.
+static SepState *sepstate_get(size_t widget_idx)
 {
-    if (sepstate.L) {
+    SepState *ss = &sepstate.states[widget_idx % sepstate.n];
+
+    LS_PTH_CHECK(pthread_mutex_lock(&sepstate.init_mtx));
+    if (ss->L) {
         // already initialized
-        return;
+        goto done;
     }
-    sepstate.L = xnew_lua_state();
-    luaL_openlibs(sepstate.L);
-    inject_libs(sepstate.L);
-    lua_pushcfunction(sepstate.L, l_error_handler); // sepstate.L: l_error_handler
-    LS_PTH_CHECK(pthread_mutex_init(&sepstate.L_mtx, NULL));
+    ss->L = xnew_lua_state(&ss->alloc, NULL);
+    luaL_openlibs(ss->L);
+    inject_libs(ss->L);
+    lua_pushcfunction(ss->L, l_error_handler); // ss->L: l_error_handler
+    LS_PTH_CHECK(pthread_mutex_init(&ss->L_mtx, NULL));
+done:
+    LS_PTH_CHECK(pthread_mutex_unlock(&sepstate.init_mtx));
+    return ss;
 }
 
-static void sepstate_maybe_destroy(void)
+static void sepstates_destroy(void)
 {
-    if (!sepstate.L) {
-        // hasn't been initialized
+    if (!sepstate.states) {
+        // haven't been allocated
         return;
     }
-    lua_close(sepstate.L);
-    LS_PTH_CHECK(pthread_mutex_destroy(&sepstate.L_mtx));
+    for (size_t i = 0; i < sepstate.n; ++i) {
+        SepState *ss = &sepstate.states[i];
+        if (!ss->L) {
+            // hasn't been initialized
+            continue;
+        }
+        lua_close(ss->L);
+        lua_alloc_destroy(&ss->alloc);
+        LS_PTH_CHECK(pthread_mutex_destroy(&ss->L_mtx));
+    }
+    free(sepstate.states);
+    sepstate.states = NULL;
 }
 
 // Inspects the 'plugin' field of /w/'s /widget/ table; the /widget/ table is assumed to be on top
@@ -678,21 +1470,25 @@ static bool widget_init_inspect_event(Widget *w, const char *filename)
         return true;
     case LUA_TSTRING:
         {
-            sepstate_maybe_init();
+            SepState *ss = sepstate_get(w - widgets);
 
             size_t ncode;
             const char *code = lua_tolstring(w->L, -1, &ncode);
 
             LSString chunkname = ls_string_newz_from_f("widget.event of %s", filename);
+            LS_PTH_CHECK(pthread_mutex_lock(&ss->L_mtx));
             bool r = check_lua_call(
-                sepstate.L, luaL_loadbuffer(sepstate.L, code, ncode, chunkname.data));
+                ss->L, luaL_loadbuffer(ss->L, code, ncode, chunkname.data));
+            if (r) {
+                // ss->L: ? chunk
+                w->lref_event = luaL_ref(ss->L, LUA_REGISTRYINDEX); // ss->L: ?
+            }
+            LS_PTH_CHECK(pthread_mutex_unlock(&ss->L_mtx));
             LS_VECTOR_FREE(chunkname);
             if (!r) {
                 return false;
             }
-
-            // sepstate.L: ? chunk
-            w->lref_event = luaL_ref(sepstate.L, LUA_REGISTRYINDEX); // sepstate.L: ?
+            w->sepstate = ss;
             w->sepstate_event = true;
             lua_pop(L, 1); // L: ? widget
             return true;
@@ -724,31 +1520,425 @@ static bool widget_init_inspect_push_opts(Widget *w)
     }
 }
 
-static bool widget_init(Widget *w, const char *filename)
+// Inspects the 'dedicated_thread' field of /w/'s /widget/ table; the /widget/ table is assumed to be
+// on top of /w.L/'s stack. The stack itself is not changed by this function.
+static bool widget_init_inspect_dedicated_thread(Widget *w)
+{
+    lua_State *L = w->L;
+    // L: ? widget
+    lua_getfield(L, -1, "dedicated_thread"); // L: ? widget dedicated_thread
+    switch (lua_type(L, -1)) {
+    case LUA_TNIL:
+        w->dedicated_thread = false;
+        break;
+    case LUA_TBOOLEAN:
+        w->dedicated_thread = lua_toboolean(L, -1);
+        break;
+    default:
+        ERRF("'widget.dedicated_thread': expected boolean or nil, found %s",
+             luaL_typename(L, -1));
+        return false;
+    }
+    lua_pop(L, 1); // L: ? widget
+    return true;
+}
+
+// Inspects the 'coalesce_scroll' field of /w/'s /widget/ table; the /widget/ table is assumed to be
+// on top of /w.L/'s stack. The stack itself is not changed by this function.
+static bool widget_init_inspect_coalesce_scroll(Widget *w)
+{
+    lua_State *L = w->L;
+    // L: ? widget
+    lua_getfield(L, -1, "coalesce_scroll"); // L: ? widget coalesce_scroll
+    switch (lua_type(L, -1)) {
+    case LUA_TNIL:
+        w->coalesce_scroll = false;
+        break;
+    case LUA_TBOOLEAN:
+        w->coalesce_scroll = lua_toboolean(L, -1);
+        break;
+    default:
+        ERRF("'widget.coalesce_scroll': expected boolean or nil, found %s",
+             luaL_typename(L, -1));
+        return false;
+    }
+    lua_pop(L, 1); // L: ? widget
+    return true;
+}
+
+// Inspects the 'memory_limit' field of /w/'s /widget/ table; the /widget/ table is assumed to be
+// on top of /w.L/'s stack. The stack itself is not changed by this function.
+static bool widget_init_inspect_memory_limit(Widget *w)
+{
+    lua_State *L = w->L;
+    // L: ? widget
+    lua_getfield(L, -1, "memory_limit"); // L: ? widget memory_limit
+    switch (lua_type(L, -1)) {
+    case LUA_TNIL:
+        break;
+    case LUA_TNUMBER:
+        {
+            lua_Number limit = lua_tonumber(L, -1);
+            if (!(limit >= 1)) {
+                ERRF("'widget.memory_limit': expected positive number");
+                return false;
+            }
+            if (w->interp != &w->own_interp) {
+                WARNF("'widget.memory_limit' is not supported in shared-interpreter mode, "
+                      "ignoring");
+            } else if (!w->interp->alloc_used) {
+                WARNF("'widget.memory_limit' is not supported with this Lua implementation, "
+                      "ignoring");
+            } else if (limit < (lua_Number) SIZE_MAX) {
+                w->interp->alloc.limit = limit;
+            }
+        }
+        break;
+    default:
+        ERRF("'widget.memory_limit': expected number or nil, found %s", luaL_typename(L, -1));
+        return false;
+    }
+    lua_pop(L, 1); // L: ? widget
+    return true;
+}
+
+// Garbage collection in widgets' Lua states is controlled by luastatus, so that it does not
+// interleave with /widget.cb/ calls: the automatic collector is tuned to only kick in once the heap
+// has grown by /GC_VALVE_PCT/ percent since the last collection (on Lua 5.4, it is also switched to
+// the generational mode), and the *GC thread* periodically performs bounded collection steps in
+// interpreters that are idle, that is, whose mutexes can be locked without waiting.
+//
+// As a safety net, if a widget's heap grows too much (for example, if the widget is never idle
+// when the GC thread comes by), a step is performed right after a call, when the result has
+// already been published. The automatic collector is not stopped altogether, as a single call that
+// produces a lot of garbage would then grow the heap without bound (Lua 5.1 and LuaJIT do not have
+// an emergency collector that runs when an allocation fails).
+
+// How often the GC thread wakes up, in milliseconds.
+#define GC_PERIOD_MS 100
+
+// The amount of work, in KiB (see the documentation for /LUA_GCSTEP/), done in a single step.
+#define GC_STEP_KB 64
+
+// A step is forced after a call if the heap has grown more than twice plus this number of KiB since
+// the last completed cycle.
+#define GC_SLACK_KB 256
+
+// The automatic collector starts a cycle once the heap has grown by this many percent since the
+// last completed one. Lua 5.4 caps the generational mode's equivalent at 255.
+#define GC_VALVE_PCT 200
+
+static struct {
+    // Whether the GC thread should terminate. Guarded by /mtx/.
+    bool quit;
+
+    pthread_mutex_t mtx;
+
+    // Signalled when /quit/ is set; used with /mtx/.
+    pthread_cond_t cond;
+
+    // Whether the GC thread has been spawned and not yet joined. Only accessed by the main thread.
+    bool running;
+
+    pthread_t thread;
+} gc = {.running = false};
+
+// Switches /it->L/ to the mostly manual garbage collection mode.
+static void interp_gc_init(Interp *it)
+{
+    lua_State *L = it->L;
+#if LUA_VERSION_NUM >= 504
+    lua_gc(L, LUA_GCGEN, GC_VALVE_PCT, 0);
+#else
+    lua_gc(L, LUA_GCSETPAUSE, 100 + GC_VALVE_PCT);
+#endif
+    it->gc_baseline_kb = lua_gc(L, LUA_GCCOUNT, 0);
+}
+
+// Performs a garbage collection step in /it->L/. Must be called with /it->mtx/ locked.
+static void interp_gc_step(Interp *it)
+{
+    lua_State *L = it->L;
+    int finished = lua_gc(L, LUA_GCSTEP, GC_STEP_KB);
+#if LUA_VERSION_NUM >= 504
+    // In the generational mode, a step is a whole (minor or major) collection.
+    finished = 1;
+#endif
+    if (finished) {
+        it->gc_baseline_kb = lua_gc(L, LUA_GCCOUNT, 0);
+    }
+}
+
+// Performs a garbage collection step in /it->L/ if its heap has grown too much, or if it is close
+// to /widget.memory_limit/. Must be called with /it->mtx/ locked.
+static void interp_gc_check(Interp *it)
+{
+    int kb = lua_gc(it->L, LUA_GCCOUNT, 0);
+    size_t limit = it->alloc.limit;
+    if (kb > 2 * it->gc_baseline_kb + GC_SLACK_KB ||
+        (limit && it->alloc.in_use > limit - limit / 4))
+    {
+        interp_gc_step(it);
+    }
+}
+
+// The number of VM instructions between two invocations of /interp_hook()/.
+#define HOOK_COUNT 1000
+
+// The minimum interval between two samples the profiler takes in a Lua interpreter instance, in
+// nanoseconds. Together with /HOOK_COUNT/, this bounds the profiler's overhead.
+#define PROF_INTERVAL_NS 1000000
+
+// After a widget has overrun its /widget.cb_budget/ /n/ times in a row, its calls are skipped for
+// /BUDGET_BACKOFF_MIN_MS * 2^(n-1)/ milliseconds, but no more than /BUDGET_BACKOFF_MAX_MS/.
+#define BUDGET_BACKOFF_MIN_MS 1000
+#define BUDGET_BACKOFF_MAX_MS (5 * 60 * 1000)
+
+// The address of this variable is the key (in the registry of /Interp::L/) of a light userdata
+// pointing to the /Interp/ itself, so that /interp_hook()/ can find it.
+static char interp_regkey;
+
+// A count hook installed on interpreters in which the profiler or a /widget.cb_budget/ watchdog
+// needs to regularly take control while Lua code runs.
+static void interp_hook(lua_State *L, lua_Debug *ar)
+{
+    (void) ar;
+
+    lua_pushlightuserdata(L, &interp_regkey); // L: ? key
+    lua_rawget(L, LUA_REGISTRYINDEX); // L: ? interp
+    Interp *it = lua_touserdata(L, -1);
+    lua_pop(L, 1); // L: ?
+
+    Widget *w = it->cur;
+    if (!w) {
+        // Initialization code is running.
+        return;
+    }
+    uint64_t now = stats_now();
+    if (w->profile && now - it->prof_last >= PROF_INTERVAL_NS) {
+        // Attribute all the time since the previous sample to the current stack.
+        profile_sample(w->profile, L, (now - it->prof_last) / 1000);
+        it->prof_last = now;
+    }
+    if (it->deadline && now >= it->deadline) {
+        // Keep raising errors until the call is over, so that it can not be caught by /pcall()/.
+        it->deadline_hit = true;
+        luaL_error(L, "widget.cb_budget of %f seconds exceeded", w->budget_ns / 1e9);
+    }
+}
+
+// Installs /interp_hook()/ on /it->L/, unless it is installed already. Must be called with
+// /it->mtx/ locked (or before /it/ is shared with other threads).
+static void interp_hook_install(Interp *it)
+{
+    if (it->hooked) {
+        return;
+    }
+    lua_pushlightuserdata(it->L, &interp_regkey); // it->L: ? key
+    lua_pushlightuserdata(it->L, it); // it->L: ? key it
+    lua_rawset(it->L, LUA_REGISTRYINDEX); // it->L: ?
+    lua_sethook(it->L, interp_hook, LUA_MASKCOUNT, HOOK_COUNT);
+    it->hooked = true;
+}
+
+// Marks /w/ as the widget whose code runs in /it->L/ from now on (/now/ being the current time).
+// Must be called with /it->mtx/ locked.
+static inline void interp_enter(Interp *it, Widget *w, uint64_t now)
+{
+    it->cur = w;
+    it->prof_last = now;
+}
+
+// Must be called before unlocking /it->mtx/ locked after /interp_enter()/.
+static inline void interp_leave(Interp *it)
+{
+    it->cur = NULL;
+}
+
+// Initializes /it/ with a new Lua interpreter instance with the standard libraries and the
+// /luastatus/ module loaded, and /l_error_handler/ pushed onto its stack.
+static void interp_init(Interp *it)
+{
+    it->L = xnew_lua_state(&it->alloc, &it->alloc_used);
+    LS_PTH_CHECK(pthread_mutex_init(&it->mtx, NULL));
+
+    it->cur = NULL;
+    it->deadline = 0;
+    it->hooked = false;
+    if (profile_dir) {
+        interp_hook_install(it);
+    }
+
+    luaL_openlibs(it->L);
+    // it->L: -
+    inject_libs(it->L); // it->L: -
+    lua_pushcfunction(it->L, l_error_handler); // it->L: l_error_handler
+}
+
+static void interp_destroy(Interp *it)
+{
+    lua_close(it->L);
+    lua_alloc_destroy(&it->alloc);
+    LS_PTH_CHECK(pthread_mutex_destroy(&it->mtx));
+}
+
+// Unlocks /map.mtx/ if it has been locked by /map_get()/ on behalf of /w/.
+static void widget_unlock_map(Widget *w)
+{
+    if (w->map_locked) {
+        LS_PTH_CHECK(pthread_mutex_unlock(&map.mtx));
+        w->map_locked = false;
+    }
+}
+
+// Inspects the 'cb_budget' field of /w/'s /widget/ table; the /widget/ table is assumed to be on
+// top of /w.L/'s stack. The stack itself is not changed by this function.
+static bool widget_init_inspect_cb_budget(Widget *w)
+{
+    lua_State *L = w->L;
+    w->budget_ns = 0;
+    w->budget_strikes = 0;
+    w->backoff_until = 0;
+    // L: ? widget
+    lua_getfield(L, -1, "cb_budget"); // L: ? widget cb_budget
+    switch (lua_type(L, -1)) {
+    case LUA_TNIL:
+        break;
+    case LUA_TNUMBER:
+        {
+            lua_Number budget = lua_tonumber(L, -1);
+            if (!(budget > 0)) {
+                ERRF("'widget.cb_budget': expected positive number");
+                return false;
+            }
+            // Clamp to about a year; more is as good as no budget at all.
+            if (budget > 3.0e7) {
+                budget = 3.0e7;
+            }
+            w->budget_ns = budget * 1e9;
+            if (!w->budget_ns) {
+                w->budget_ns = 1;
+            }
+            interp_hook_install(w->interp);
+        }
+        break;
+    default:
+        ERRF("'widget.cb_budget': expected number or nil, found %s", luaL_typename(L, -1));
+        return false;
+    }
+    lua_pop(L, 1); // L: ? widget
+    return true;
+}
+
+// Inspects the 'min_interval' and 'max_rate' fields of /w/'s /widget/ table; the /widget/ table is
+// assumed to be on top of /w->L/'s stack.
+static bool widget_init_inspect_rate(Widget *w)
+{
+    lua_State *L = w->L;
+    w->min_interval_ns = 0;
+    w->last_cb = 0;
+    // L: ? widget
+    lua_getfield(L, -1, "min_interval"); // L: ? widget min_interval
+    lua_getfield(L, -2, "max_rate"); // L: ? widget min_interval max_rate
+    double interval = 0;
+    switch (lua_type(L, -2)) {
+    case LUA_TNIL:
+        break;
+    case LUA_TNUMBER:
+        interval = lua_tonumber(L, -2);
+        if (!(interval >= 0)) {
+            ERRF("'widget.min_interval': expected non-negative number");
+            return false;
+        }
+        break;
+    default:
+        ERRF("'widget.min_interval': expected number or nil, found %s", luaL_typename(L, -2));
+        return false;
+    }
+    switch (lua_type(L, -1)) {
+    case LUA_TNIL:
+        break;
+    case LUA_TNUMBER:
+        {
+            lua_Number rate = lua_tonumber(L, -1);
+            if (!(rate > 0)) {
+                ERRF("'widget.max_rate': expected positive number");
+                return false;
+            }
+            if (1 / rate > interval) {
+                interval = 1 / rate;
+            }
+        }
+        break;
+    default:
+        ERRF("'widget.max_rate': expected number or nil, found %s", luaL_typename(L, -1));
+        return false;
+    }
+    // Clamp to about a year, as with /widget.cb_budget/.
+    if (interval > 3.0e7) {
+        interval = 3.0e7;
+    }
+    w->min_interval_ns = interval * 1e9;
+    lua_pop(L, 2); // L: ? widget
+    return true;
+}
+
+// Initializes a widget /w/ with index /widget_idx/ from file /filename/.
+//
+// May be called concurrently for different widgets. In shared-interpreter mode, the shared
+// interpreter /w/ is going to run in must have been initialized; /w/'s initialization then holds
+// its mutex, so that widgets sharing an interpreter are initialized one after another.
+static bool widget_init(Widget *w, const char *filename, size_t widget_idx)
 {
-    w->L = xnew_lua_state();
-    LS_PTH_CHECK(pthread_mutex_init(&w->L_mtx, NULL));
+    if (shared.n) {
+        w->interp = &shared.interps[widget_idx % shared.n];
+        assert(w->interp->L);
+        LOCK_L(w);
+    } else {
+        w->interp = &w->own_interp;
+        interp_init(w->interp);
+    }
+    w->L = w->interp->L;
+    w->lref_env = LUA_NOREF;
+    w->lref_cb = LUA_NOREF;
+    w->lref_event = LUA_NOREF;
+    w->sepstate_event = false;
+    w->map_locked = false;
     w->filename = ls_xstrdup(filename);
     bool plugin_loaded = false;
 
     DEBUGF("initializing widget '%s'", filename);
 
-    luaL_openlibs(w->L);
-    // w->L: -
-    inject_libs(w->L); // w->L: -
-    lua_pushcfunction(w->L, l_error_handler); // w->L: l_error_handler
+    assert(lua_gettop(w->L) == 1); // w->L: l_error_handler
+
+    if (shared.n) {
+        push_widget_env(w->L); // w->L: l_error_handler env
+        lua_pushvalue(w->L, -1); // w->L: l_error_handler env env
+        w->lref_env = luaL_ref(w->L, LUA_REGISTRYINDEX); // w->L: l_error_handler env
+    }
 
     DEBUGF("running file '%s'", filename);
-    if (!check_lua_call(w->L, luaL_loadfile(w->L, filename))) {
+    if (!check_lua_call(w->L, bytecode_cache_loadfile(w->L, filename))) {
         goto error;
     }
+    if (shared.n) {
+        // w->L: l_error_handler env chunk
+        set_function_env(w->L, 2);
+        lua_remove(w->L, 2); // w->L: l_error_handler chunk
+    }
     // w->L: l_error_handler chunk
     if (!do_lua_call(w->L, 0, 0)) {
         goto error;
     }
     // w->L: l_error_handler
 
-    lua_getglobal(w->L, "widget"); // w->L: l_error_handler widget
+    if (shared.n) {
+        lua_rawgeti(w->L, LUA_REGISTRYINDEX, w->lref_env); // w->L: l_error_handler env
+        lua_getfield(w->L, -1, "widget"); // w->L: l_error_handler env widget
+        lua_remove(w->L, -2); // w->L: l_error_handler widget
+    } else {
+        lua_getglobal(w->L, "widget"); // w->L: l_error_handler widget
+    }
     if (!lua_istable(w->L, -1)) {
         ERRF("'widget': expected table, found %s", luaL_typename(w->L, -1));
         goto error;
@@ -758,8 +1948,14 @@ static bool widget_init(Widget *w, const char *filename)
         goto error;
     }
     plugin_loaded = true;
+    w->log_who = ls_string_newz_from_f("%s@%s", w->plugin.name, filename).data;
     if (!widget_init_inspect_cb(w) ||
         !widget_init_inspect_event(w, filename) ||
+        !widget_init_inspect_dedicated_thread(w) ||
+        !widget_init_inspect_coalesce_scroll(w) ||
+        !widget_init_inspect_memory_limit(w) ||
+        !widget_init_inspect_cb_budget(w) ||
+        !widget_init_inspect_rate(w) ||
         !widget_init_inspect_push_opts(w))
     {
         goto error;
@@ -771,22 +1967,45 @@ static bool widget_init(Widget *w, const char *filename)
         .sayf = external_sayf,
         .map_get = map_get,
     };
+    w->source = NULL;
+    w->started = false;
+    LS_VECTOR_INIT(w->snapbuf);
 
-    if (w->plugin.iface.init(&w->data, w->L) == LUASTATUS_ERR) {
+    int init_r = plugin_iface_init(&w->plugin, &w->data, w->L);
+    widget_unlock_map(w);
+    if (init_r == LUASTATUS_ERR) {
         ERRF("plugin's init() failed");
         goto error;
     }
     assert(lua_gettop(w->L) == 3); // w->L: l_error_handler widget opts
     lua_pop(w->L, 2); // w->L: l_error_handler
 
+    if (shared.n) {
+        UNLOCK_L(w);
+    } else {
+        interp_gc_init(w->interp);
+    }
+
     DEBUGF("widget successfully initialized");
     return true;
 
 error:
-    lua_close(w->L);
-    LS_PTH_CHECK(pthread_mutex_destroy(&w->L_mtx));
+    if (shared.n) {
+        // We can't close a shared interpreter; just get rid of everything this widget has left in
+        // it.
+        lua_settop(w->L, 1); // w->L: l_error_handler
+        luaL_unref(w->L, LUA_REGISTRYINDEX, w->lref_env);
+        luaL_unref(w->L, LUA_REGISTRYINDEX, w->lref_cb);
+        if (!w->sepstate_event) {
+            luaL_unref(w->L, LUA_REGISTRYINDEX, w->lref_event);
+        }
+        UNLOCK_L(w);
+    } else {
+        interp_destroy(w->interp);
+    }
     free(w->filename);
     if (plugin_loaded) {
+        free(w->log_who);
         plugin_unload(&w->plugin);
     }
     return false;
@@ -794,252 +2013,1570 @@ error:
 
 static void widget_init_stillborn(Widget *w)
 {
-    sepstate_maybe_init();
+    w->sepstate = NULL;
     w->L = NULL;
     w->lref_event = LUA_REFNIL;
     w->sepstate_event = true;
 }
 
-static inline bool widget_is_stillborn(Widget *w)
-{
-    return !w->L;
-}
-
 // Returns the Lua interpreter instance for the /widget.event/ function of a widget /w/.
 static inline lua_State *widget_event_lua_state(Widget *w)
 {
-    return w->sepstate_event ? sepstate.L : w->L;
+    return w->sepstate_event ? w->sepstate->L : w->L;
 }
 
 // Returns a pointer to the mutex guarding the Lua interpreter instance for the /widget.event/
 // function of a widget /w/.
 static inline pthread_mutex_t *widget_event_L_mtx(Widget *w)
 {
-    return w->sepstate_event ? &sepstate.L_mtx : &w->L_mtx;
-}
-
-static inline size_t widget_index(Widget *w)
-{
-    return w - widgets;
+    return w->sepstate_event ? &w->sepstate->L_mtx : &w->interp->mtx;
 }
 
 static void widget_destroy(Widget *w)
 {
     if (!widget_is_stillborn(w)) {
-        w->plugin.iface.destroy(&w->data);
+        plugin_iface_destroy(&w->plugin, &w->data);
         plugin_unload(&w->plugin);
-        lua_close(w->L);
-        LS_PTH_CHECK(pthread_mutex_destroy(&w->L_mtx));
+        if (w->interp == &w->own_interp) {
+            interp_destroy(w->interp);
+        }
         free(w->filename);
+        free(w->log_who);
+        LS_VECTOR_FREE(w->snapbuf);
+    }
+    if (w->slot && w->slot != ERROR_SNAPSHOT) {
+        snapshot_destroy(w->slot);
+    }
+    if (w->profile) {
+        profile_destroy(w->profile);
+    }
+    if (w->deferred) {
+        snapshot_destroy(w->deferred);
+    }
+    for (size_t i = 0; i < w->evq->size; ++i) {
+        snapshot_destroy(w->evq->entries[(w->evq->head + i) % EVQ_CAPACITY].s);
+    }
+    free(w->evq);
+    free(w->stats);
+}
+
+// Registers /barlib/'s functions at /L/.
+// If /w/ is not /NULL/, also registers /w->plugin/'s functions at /L/.
+static void register_funcs(lua_State *L, Widget *w)
+{
+    // L: ?
+    if (w && w->lref_env != LUA_NOREF) {
+        lua_rawgeti(L, LUA_REGISTRYINDEX, w->lref_env); // L: ? env
+        lua_pushstring(L, "luastatus"); // L: ? env "luastatus"
+        lua_rawget(L, -2); // L: ? env luastatus
+        lua_remove(L, -2); // L: ? luastatus
+    } else {
+        lua_getglobal(L, "luastatus"); // L: ? luastatus
+    }
+
+    if (!lua_istable(L, -1)) {
+        assert(w);
+        assert(!widget_is_stillborn(w));
+
+        WARNF("widget '%s': 'luastatus' is not a table anymore, will not register "
+              "barlib/plugin functions",
+              w->filename);
+        goto done;
+    }
+    if (barlib.iface.register_funcs) {
+        lua_newtable(L); // L: ? luastatus table
+
+        int old_top = lua_gettop(L);
+        (void) old_top;
+        barlib.iface.register_funcs(&barlib.data, L); // L: ? luastatus table
+        assert(lua_gettop(L) == old_top);
+
+        lua_setfield(L, -2, "barlib"); // L: ? luastatus
+    }
+    if (w && plugin_iface_has_register_funcs(&w->plugin)) {
+        lua_newtable(L); // L: ? luastatus table
+
+        int old_top = lua_gettop(L);
+        (void) old_top;
+        plugin_iface_register_funcs(&w->plugin, &w->data, L); // L: ? luastatus table
+        assert(lua_gettop(L) == old_top);
+
+        lua_setfield(L, -2, "plugin"); // L: ? luastatus
+    }
+
+done:
+    lua_pop(L, 1); // L: ?
+}
+
+// Initializes the /widgets/ and /nwidgets/ global variables from the given list of file names:
+// sets /nwidgets/, allocates /widgets/, initialized all the widgets, and makes ones whose
+// initialization failed stillborn.
+// Widgets are initialized concurrently by a pool of at most /INIT_MAX_THREADS/ threads, so that
+// a widget whose plugin's /init()/ takes long (e.g. connects to something) does not delay the
+// initialization of the others. Each of the threads takes the next widget not yet taken (see
+// /widgets_init_thread()/).
+#define INIT_MAX_THREADS 8
+
+static struct {
+    char *const *filenames;
+    // The index of the next widget to initialize.
+    size_t next;
+} init_queue;
+
+static void widgets_init_one(size_t i)
+{
+    const char *filename = init_queue.filenames[i];
+    if (!widget_init(&widgets[i], filename, i)) {
+        ERRF("cannot load widget '%s'", filename);
+        widget_init_stillborn(&widgets[i]);
+    }
+}
+
+static void *widgets_init_thread(void *arg)
+{
+    (void) arg;
+    size_t i;
+    while ((i = __atomic_fetch_add(&init_queue.next, 1, __ATOMIC_RELAXED)) < nwidgets) {
+        widgets_init_one(i);
+    }
+    return NULL;
+}
+
+static void widgets_init(char *const *filenames, size_t nfilenames)
+{
+    nwidgets = nfilenames;
+    widgets = LS_XNEW(Widget, nwidgets);
+    for (size_t i = 0; i < nwidgets; ++i) {
+        widgets[i].slot = NULL;
+        widgets[i].set_hash_valid = false;
+        widgets[i].log_rate = (LoggerRate) {0};
+        widgets[i].stats = LS_XNEW0(WidgetStats, 1);
+        widgets[i].profile = NULL;
+        widgets[i].deferred = NULL;
+        widgets[i].evq = LS_XNEW0(EventQueue, 1);
+    }
+    // Initialize the shared interpreters that are going to be used beforehand, so that
+    // /widget_init()/ can lock their mutexes.
+    for (size_t i = 0; i < shared.n && i < nwidgets; ++i) {
+        interp_init(&shared.interps[i]);
+    }
+
+    init_queue.filenames = filenames;
+    init_queue.next = 0;
+
+    size_t nthreads = nwidgets < INIT_MAX_THREADS ? nwidgets : INIT_MAX_THREADS;
+    if (nthreads <= 1) {
+        for (size_t i = 0; i < nwidgets; ++i) {
+            widgets_init_one(i);
+        }
+    } else {
+        pthread_t threads[INIT_MAX_THREADS];
+        for (size_t i = 0; i < nthreads; ++i) {
+            LS_PTH_CHECK(pthread_create(&threads[i], NULL, widgets_init_thread, NULL));
+        }
+        for (size_t i = 0; i < nthreads; ++i) {
+            LS_PTH_CHECK(pthread_join(threads[i], NULL));
+        }
+    }
+
+    for (size_t i = 0; i < shared.n; ++i) {
+        if (shared.interps[i].L) {
+            interp_gc_init(&shared.interps[i]);
+        }
+    }
+}
+
+static void widgets_destroy(void)
+{
+    for (size_t i = 0; i < nwidgets; ++i) {
+        widget_destroy(&widgets[i]);
+    }
+    free(widgets);
+    // The shared interpreters must outlive the plugins of the widgets running in them.
+    for (size_t i = 0; i < shared.n; ++i) {
+        if (shared.interps[i].L) {
+            interp_destroy(&shared.interps[i]);
+        }
+    }
+    free(shared.interps);
+}
+
+// Should be invoked whenever the barlib reports a fatal error.
+static LS_ATTR_NORETURN
+void fatal_error_reported(void)
+{
+    logger_flush();
+    fflush(NULL);
+    _exit(EXIT_FAILURE);
+}
+
+// Performs a garbage collection step in /it->L/ if it is idle and its heap has grown since the last
+// completed cycle.
+static void gc_visit(Interp *it)
+{
+    int r = pthread_mutex_trylock(&it->mtx);
+    if (r == EBUSY) {
+        return;
+    }
+    LS_PTH_CHECK(r);
+    if (lua_gc(it->L, LUA_GCCOUNT, 0) > it->gc_baseline_kb) {
+        interp_gc_step(it);
+    }
+    LS_PTH_CHECK(pthread_mutex_unlock(&it->mtx));
+}
+
+static void *gc_thread(void *arg)
+{
+    (void) arg;
+
+    LS_PTH_CHECK(pthread_mutex_lock(&gc.mtx));
+    while (1) {
+        struct timespec deadline;
+        LS_PTH_CHECK(clock_gettime(CLOCK_MONOTONIC, &deadline));
+        deadline.tv_nsec += GC_PERIOD_MS * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_nsec -= 1000000000L;
+            ++deadline.tv_sec;
+        }
+        while (!gc.quit) {
+            int r = pthread_cond_timedwait(&gc.cond, &gc.mtx, &deadline);
+            if (r == ETIMEDOUT) {
+                break;
+            }
+            LS_PTH_CHECK(r);
+        }
+        if (gc.quit) {
+            break;
+        }
+        for (size_t i = 0; i < shared.n; ++i) {
+            if (shared.interps[i].L) {
+                gc_visit(&shared.interps[i]);
+            }
+        }
+        for (size_t i = 0; i < nwidgets; ++i) {
+            Widget *w = &widgets[i];
+            if (!widget_is_stillborn(w) && w->interp == &w->own_interp) {
+                gc_visit(w->interp);
+            }
+        }
+    }
+    LS_PTH_CHECK(pthread_mutex_unlock(&gc.mtx));
+    return NULL;
+}
+
+static void gc_start(void)
+{
+    gc.quit = false;
+    LS_PTH_CHECK(pthread_mutex_init(&gc.mtx, NULL));
+
+    pthread_condattr_t attr;
+    LS_PTH_CHECK(pthread_condattr_init(&attr));
+    LS_PTH_CHECK(pthread_condattr_setclock(&attr, CLOCK_MONOTONIC));
+    LS_PTH_CHECK(pthread_cond_init(&gc.cond, &attr));
+    LS_PTH_CHECK(pthread_condattr_destroy(&attr));
+
+    LS_PTH_CHECK(pthread_create(&gc.thread, NULL, gc_thread, NULL));
+    gc.running = true;
+}
+
+static void gc_maybe_stop(void)
+{
+    if (!gc.running) {
+        return;
+    }
+    LS_PTH_CHECK(pthread_mutex_lock(&gc.mtx));
+    gc.quit = true;
+    LS_PTH_CHECK(pthread_cond_signal(&gc.cond));
+    LS_PTH_CHECK(pthread_mutex_unlock(&gc.mtx));
+
+    LS_PTH_CHECK(pthread_join(gc.thread, NULL));
+    gc.running = false;
+
+    LS_PTH_CHECK(pthread_cond_destroy(&gc.cond));
+    LS_PTH_CHECK(pthread_mutex_destroy(&gc.mtx));
+}
+
+// Publishes an update /s/ (either a snapshot of /widget.cb/'s result, or /ERROR_SNAPSHOT/) of a
+// widget /w/ into its slot, replacing the previous one if it has not been consumed yet, and wakes
+// the render thread up.
+static void publish(Widget *w, Snapshot *s)
+{
+    Snapshot *old = __atomic_exchange_n(&w->slot, s, __ATOMIC_SEQ_CST);
+    if (old && old != ERROR_SNAPSHOT) {
+        snapshot_destroy(old);
+    }
+    if (!__atomic_exchange_n(&render.pending, true, __ATOMIC_SEQ_CST)) {
+        if (sem_post(&render.wakeup) < 0) {
+            LS_PANIC("sem_post() failed");
+        }
+    }
+}
+
+// Should be invoked whenever a call in /w->L/ fails; reports if this happened because /w/ has
+// exceeded its memory limit.
+static void widget_check_memory_limit(Widget *w)
+{
+    LuaAlloc *alloc = &w->interp->alloc;
+    if (alloc->limit_hit) {
+        ERRF("widget '%s' has exceeded its memory limit of %zu bytes", w->filename, alloc->limit);
+        alloc->limit_hit = false;
+    }
+}
+
+// Returns the size of /it->L/'s heap in bytes. Must be called with /it->mtx/ locked.
+static uint64_t interp_heap_bytes(Interp *it)
+{
+    if (it->alloc_used) {
+        return it->alloc.in_use;
+    }
+    return (uint64_t) lua_gc(it->L, LUA_GCCOUNT, 0) * 1024 + lua_gc(it->L, LUA_GCCOUNTB, 0);
+}
+
+// A widget with /widget.min_interval/ or /widget.max_rate/ has its /widget.cb/ called on behalf of
+// its plugin no more often than that. A plugin call that comes too early is *deferred*: its
+// payload is copied into /Widget::deferred/ (replacing the payload of an earlier deferred call, if
+// any, so that only the latest one is ever evaluated), and the *pacer thread* calls /widget.cb/
+// with it once the interval has passed. While the widgets are paused (see /pausectl/), all the
+// plugin calls are deferred, and the pacer thread only evaluates them on resumption.
+//
+// Payloads that can not be copied (see snapshot.h) are not deferred, but evaluated immediately.
+static struct {
+    // A mutex guarding /quit/ and the /deferred/ and /deferred_due/ fields of all the widgets.
+    pthread_mutex_t mtx;
+
+    // Signalled when a call is deferred, or /quit/ is set; used with /mtx/.
+    pthread_cond_t cond;
+
+    // Whether the pacer thread should evaluate all the deferred calls right away (even if the
+    // widgets are paused) and terminate.
+    bool quit;
+
+    // Whether the pacer thread has been spawned and not yet joined. Only accessed by the main
+    // thread.
+    bool running;
+
+    pthread_t thread;
+} pacer = {.running = false};
+
+// Returns /true/ if the calls of /w/ are currently being skipped because it has overrun its
+// /widget.cb_budget/. Must be called with /w->interp->mtx/ locked.
+static bool widget_in_backoff(Widget *w)
+{
+    if (!w->backoff_until) {
+        return false;
+    }
+    if (stats_now() < w->backoff_until) {
+        return true;
+    }
+    w->backoff_until = 0;
+    return false;
+}
+
+// Like /do_lua_call()/ on /w->L/, but aborts the call once it overruns /widget.cb_budget/, if
+// any, and, if it did, makes /widget_in_backoff()/ return /true/ for some time. Must be called
+// with /w->interp->mtx/ locked.
+static bool widget_do_call(Widget *w, int nargs, int nresults)
+{
+    if (!w->budget_ns) {
+        return do_lua_call(w->L, nargs, nresults);
+    }
+    Interp *it = w->interp;
+    uint64_t now = stats_now();
+    it->deadline = now + w->budget_ns;
+    it->deadline_hit = false;
+    bool r = do_lua_call(w->L, nargs, nresults);
+    it->deadline = 0;
+
+    if (!it->deadline_hit) {
+        w->budget_strikes = 0;
+        return r;
+    }
+    if (w->budget_strikes < 32) {
+        ++w->budget_strikes;
+    }
+    uint64_t backoff_ms = (uint64_t) BUDGET_BACKOFF_MIN_MS << (w->budget_strikes - 1);
+    if (backoff_ms > BUDGET_BACKOFF_MAX_MS) {
+        backoff_ms = BUDGET_BACKOFF_MAX_MS;
+    }
+    w->backoff_until = stats_now() + backoff_ms * 1000000;
+    ERRF("widget '%s' has exceeded its budget (%u time(s) in a row); skipping its calls for %g s",
+         w->filename, w->budget_strikes, backoff_ms / 1e3);
+    return r;
+}
+
+static lua_State *plugin_call_begin(void *userdata)
+{
+    Widget *w = userdata;
+    WTRACEF(w, "plugin_call_begin(userdata=%p)", userdata);
+
+    uint64_t t = stats_now();
+    LOCK_L(w);
+    uint64_t lock_wait = stats_now() - t;
+    stats_hist_record(&w->stats->lock_wait, lock_wait);
+    LS_USDT2(luastatus, cb__start, (size_t) (w - widgets), lock_wait);
+    interp_enter(w->interp, w, t + lock_wait);
+
+    lua_State *L = w->L;
+    assert(lua_gettop(L) == 1); // w->L: l_error_handler
+    lua_rawgeti(L, LUA_REGISTRYINDEX, w->lref_cb); // w->L: l_error_handler cb
+    return L;
+}
+
+// Calls /widget.cb/ of /w/ and publishes the result. Must be called with /w->interp->mtx/ locked.
+static void widget_run_cb(Widget *w)
+{
+    lua_State *L = w->L;
+    assert(lua_gettop(L) == 3); // L: l_error_handler cb data
+    uint64_t t = stats_now();
+    w->last_cb = t;
+    Snapshot *s = ERROR_SNAPSHOT;
+    LS_USDT1(luastatus, cb__lua__start, (size_t) (w - widgets));
+    bool ok = widget_do_call(w, 1, 1);
+    LS_USDT2(luastatus, cb__lua__done, (size_t) (w - widgets), ok);
+    if (ok) {
+        // L: l_error_handler result
+        char errbuf[256];
+        if (snapshot_serialize(&w->snapbuf, L, errbuf, sizeof(errbuf))) {
+            s = snapshot_new(&w->snapbuf);
+        } else {
+            ERRF("widget '%s': cb returned an unsupported value: %s", w->filename, errbuf);
+        }
+        lua_settop(L, 1); // L: l_error_handler
+    } else {
+        widget_check_memory_limit(w);
+        stats_inc(&w->stats->cb_errors);
+    }
+    // L: l_error_handler
+    uint64_t elapsed = stats_now() - t;
+    stats_hist_record(&w->stats->cb, elapsed);
+    LS_USDT3(luastatus, cb__done, (size_t) (w - widgets), elapsed, s != ERROR_SNAPSHOT);
+    publish(w, s);
+    interp_gc_check(w->interp);
+    __atomic_store_n(&w->stats->heap_bytes, interp_heap_bytes(w->interp), __ATOMIC_RELAXED);
+}
+
+// If a call of /widget.cb/ of /w/ on behalf of its plugin should be deferred because of
+// /w->min_interval_ns/, or because the widgets are paused, does so with the payload on top of
+// /w->L/'s stack, and returns /true/; otherwise, returns /false/. Must be called with
+// /w->interp->mtx/ locked.
+static bool widget_maybe_defer(Widget *w)
+{
+    lua_State *L = w->L;
+    assert(lua_gettop(L) == 3); // L: l_error_handler cb data
+    uint64_t now = stats_now();
+    bool r = false;
+
+    LS_PTH_CHECK(pthread_mutex_lock(&pacer.mtx));
+    if (!w->deferred && !pausectl.paused && now - w->last_cb >= w->min_interval_ns) {
+        goto done;
+    }
+    char errbuf[256];
+    if (!snapshot_serialize(&w->snapbuf, L, errbuf, sizeof(errbuf))) {
+        WTRACEF(w, "cannot defer the call: %s", errbuf);
+        // The payload of this call is newer than the deferred one.
+        if (w->deferred) {
+            snapshot_destroy(w->deferred);
+            w->deferred = NULL;
+        }
+        goto done;
+    }
+    if (w->deferred) {
+        snapshot_destroy(w->deferred);
+        stats_inc(&w->stats->cb_coalesced);
+    } else {
+        // If the widgets are paused, the call is evaluated right on resumption.
+        w->deferred_due = pausectl.paused ? now : w->last_cb + w->min_interval_ns;
+        LS_PTH_CHECK(pthread_cond_signal(&pacer.cond));
+    }
+    w->deferred = snapshot_new(&w->snapbuf);
+    r = true;
+done:
+    LS_PTH_CHECK(pthread_mutex_unlock(&pacer.mtx));
+    return r;
+}
+
+static void plugin_call_end(void *userdata)
+{
+    Widget *w = userdata;
+    WTRACEF(w, "plugin_call_end(userdata=%p)", userdata);
+
+    lua_State *L = w->L;
+    assert(lua_gettop(L) == 3); // L: l_error_handler cb data
+    if (widget_in_backoff(w)) {
+        WTRACEF(w, "widget is in backoff, skipping the call");
+        lua_settop(L, 1); // L: l_error_handler
+        interp_leave(w->interp);
+        UNLOCK_L(w);
+        return;
+    }
+    bool paused = __atomic_load_n(&pausectl.paused, __ATOMIC_SEQ_CST);
+    if ((w->min_interval_ns || paused) && widget_maybe_defer(w)) {
+        WTRACEF(w, "call deferred");
+        lua_settop(L, 1); // L: l_error_handler
+        interp_leave(w->interp);
+        UNLOCK_L(w);
+        return;
+    }
+    widget_run_cb(w);
+    interp_leave(w->interp);
+    UNLOCK_L(w);
+}
+
+static void plugin_call_cancel(void *userdata)
+{
+    Widget *w = userdata;
+    WTRACEF(w, "plugin_call_cancel(userdata=%p)", userdata);
+
+    lua_settop(w->L, 1); // w->L: l_error_handler
+    interp_leave(w->interp);
+    UNLOCK_L(w);
+}
+
+// Calls /widget.cb/ of /w/ with the payload of its deferred call, if it still has one; called by
+// the pacer thread.
+static void widget_run_deferred(Widget *w)
+{
+    uint64_t t = stats_now();
+    LOCK_L(w);
+    uint64_t lock_wait = stats_now() - t;
+    stats_hist_record(&w->stats->lock_wait, lock_wait);
+    LS_USDT2(luastatus, cb__start, (size_t) (w - widgets), lock_wait);
+    interp_enter(w->interp, w, t + lock_wait);
+
+    // Take the payload only now that /w->interp->mtx/ is locked, so that a newer call of the plugin
+    // can not be evaluated before it.
+    LS_PTH_CHECK(pthread_mutex_lock(&pacer.mtx));
+    Snapshot *s = w->deferred;
+    w->deferred = NULL;
+    LS_PTH_CHECK(pthread_mutex_unlock(&pacer.mtx));
+
+    if (s) {
+        if (widget_in_backoff(w)) {
+            WTRACEF(w, "widget is in backoff, skipping the deferred call");
+        } else {
+            lua_State *L = w->L;
+            assert(lua_gettop(L) == 1); // L: l_error_handler
+            lua_rawgeti(L, LUA_REGISTRYINDEX, w->lref_cb); // L: l_error_handler cb
+            snapshot_push(s, L); // L: l_error_handler cb data
+            widget_run_cb(w);
+        }
+        snapshot_destroy(s);
+    }
+    interp_leave(w->interp);
+    UNLOCK_L(w);
+}
+
+static void *pacer_thread(void *arg)
+{
+    (void) arg;
+
+    LS_PTH_CHECK(pthread_mutex_lock(&pacer.mtx));
+    while (1) {
+        Widget *next = NULL;
+        if (!pausectl.paused || pacer.quit) {
+            for (size_t i = 0; i < nwidgets; ++i) {
+                Widget *w = &widgets[i];
+                if (w->deferred && (!next || w->deferred_due < next->deferred_due)) {
+                    next = w;
+                }
+            }
+        }
+        if (!next) {
+            if (pacer.quit) {
+                break;
+            }
+            LS_PTH_CHECK(pthread_cond_wait(&pacer.cond, &pacer.mtx));
+            continue;
+        }
+        if (!pacer.quit && next->deferred_due > stats_now()) {
+            struct timespec deadline = {
+                .tv_sec = next->deferred_due / 1000000000,
+                .tv_nsec = next->deferred_due % 1000000000,
+            };
+            int r = pthread_cond_timedwait(&pacer.cond, &pacer.mtx, &deadline);
+            if (r != ETIMEDOUT) {
+                LS_PTH_CHECK(r);
+            }
+            continue;
+        }
+        LS_PTH_CHECK(pthread_mutex_unlock(&pacer.mtx));
+        widget_run_deferred(next);
+        LS_PTH_CHECK(pthread_mutex_lock(&pacer.mtx));
+    }
+    LS_PTH_CHECK(pthread_mutex_unlock(&pacer.mtx));
+    return NULL;
+}
+
+static void pacer_start(void)
+{
+    pacer.quit = false;
+    LS_PTH_CHECK(pthread_mutex_init(&pacer.mtx, NULL));
+
+    pthread_condattr_t attr;
+    LS_PTH_CHECK(pthread_condattr_init(&attr));
+    LS_PTH_CHECK(pthread_condattr_setclock(&attr, CLOCK_MONOTONIC));
+    LS_PTH_CHECK(pthread_cond_init(&pacer.cond, &attr));
+    LS_PTH_CHECK(pthread_condattr_destroy(&attr));
+
+    LS_PTH_CHECK(pthread_create(&pacer.thread, NULL, pacer_thread, NULL));
+    pacer.running = true;
+}
+
+// Lets the pacer thread evaluate the deferred calls, and joins it, if running.
+static void pacer_maybe_stop(void)
+{
+    if (!pacer.running) {
+        return;
+    }
+    LS_PTH_CHECK(pthread_mutex_lock(&pacer.mtx));
+    pacer.quit = true;
+    LS_PTH_CHECK(pthread_cond_signal(&pacer.cond));
+    LS_PTH_CHECK(pthread_mutex_unlock(&pacer.mtx));
+
+    LS_PTH_CHECK(pthread_join(pacer.thread, NULL));
+    pacer.running = false;
+
+    LS_PTH_CHECK(pthread_cond_destroy(&pacer.cond));
+    LS_PTH_CHECK(pthread_mutex_destroy(&pacer.mtx));
+}
+
+// Passes event /ev/ to /widget.event/ of widget /w/ with index /widget_idx/; called by the event
+// workers.
+static void widget_handle_event(Widget *w, size_t widget_idx, QueuedEvent *ev)
+{
+    uint64_t t = stats_now();
+    LOCK_E(w);
+    uint64_t lock_wait = stats_now() - t;
+    stats_hist_record(&w->stats->lock_wait, lock_wait);
+    LS_USDT2(luastatus, event__start, widget_idx, lock_wait);
+    if (!w->sepstate_event) {
+        interp_enter(w->interp, w, t + lock_wait);
+    }
+
+    lua_State *L = widget_event_lua_state(w);
+    assert(lua_gettop(L) == 1); // L: l_error_handler
+    if (!w->sepstate_event && widget_in_backoff(w)) {
+        WTRACEF(w, "widget is in backoff, skipping the event");
+    } else {
+        lua_rawgeti(L, LUA_REGISTRYINDEX, w->lref_event); // L: l_error_handler event
+        snapshot_push(ev->s, L); // L: l_error_handler event arg
+        if (ev->count > 1 && lua_istable(L, -1)) {
+            lua_pushnumber(L, ev->count); // L: l_error_handler event arg count
+            lua_setfield(L, -2, "count"); // L: l_error_handler event arg
+        }
+
+        t = stats_now();
+        bool ok = w->sepstate_event ? do_lua_call(L, 1, 0) : widget_do_call(w, 1, 0);
+        if (!ok) {
+            // L: l_error_handler
+            if (!w->sepstate_event) {
+                widget_check_memory_limit(w);
+            }
+            stats_inc(&w->stats->event_errors);
+            publish(w, ERROR_SNAPSHOT);
+        }
+        uint64_t elapsed = stats_now() - t;
+        stats_hist_record(&w->stats->event, elapsed);
+        LS_USDT3(luastatus, event__done, widget_idx, elapsed, ok);
+        // L: l_error_handler
+        if (!w->sepstate_event) {
+            interp_gc_check(w->interp);
+        }
+    }
+    if (!w->sepstate_event) {
+        interp_leave(w->interp);
+    }
+    UNLOCK_E(w);
+}
+
+// Appends /idx/ to /evq.ready/. Must be called with /evq.mtx/ locked.
+static void evq_ready_push(size_t idx)
+{
+    assert(evq.ready_size < nwidgets);
+    evq.ready[(evq.ready_head + evq.ready_size) % nwidgets] = idx;
+    ++evq.ready_size;
+}
+
+static void *evq_worker(void *arg)
+{
+    (void) arg;
+
+    LS_PTH_CHECK(pthread_mutex_lock(&evq.mtx));
+    while (1) {
+        while (!evq.ready_size && !evq.quit) {
+            LS_PTH_CHECK(pthread_cond_wait(&evq.cond, &evq.mtx));
+        }
+        if (!evq.ready_size) {
+            // /evq.quit/ is set, and there is nothing left to handle.
+            break;
+        }
+        size_t idx = evq.ready[evq.ready_head];
+        evq.ready_head = (evq.ready_head + 1) % nwidgets;
+        --evq.ready_size;
+
+        EventQueue *q = widgets[idx].evq;
+        QueuedEvent ev = q->entries[q->head];
+        q->head = (q->head + 1) % EVQ_CAPACITY;
+        --q->size;
+
+        LS_PTH_CHECK(pthread_mutex_unlock(&evq.mtx));
+        widget_handle_event(&widgets[idx], idx, &ev);
+        snapshot_destroy(ev.s);
+        LS_PTH_CHECK(pthread_mutex_lock(&evq.mtx));
+
+        if (q->size) {
+            evq_ready_push(idx);
+        } else {
+            q->scheduled = false;
+        }
+    }
+    LS_PTH_CHECK(pthread_mutex_unlock(&evq.mtx));
+    return NULL;
+}
+
+// If the value on top of /L/'s stack is a table with a /button/ field equal to 4, 5, 6 or 7 (which
+// is how i3bar reports scroll wheel events), returns the button; otherwise, returns /0/. The stack
+// itself is not changed by this function.
+static int event_scroll_button(lua_State *L)
+{
+    if (!lua_istable(L, -1)) {
+        return 0;
+    }
+    lua_pushstring(L, "button"); // L: ? event "button"
+    lua_rawget(L, -2); // L: ? event button
+    int r = 0;
+    if (lua_type(L, -1) == LUA_TNUMBER) {
+        lua_Number button = lua_tonumber(L, -1);
+        if (button == 4 || button == 5 || button == 6 || button == 7) {
+            r = button;
+        }
+    }
+    lua_pop(L, 1); // L: ? event
+    return r;
+}
+
+// Appends an event /s/ with scroll button /scroll_button/ (see /event_scroll_button()/) to the
+// queue of widget /w/ with index /widget_idx/, or coalesces it with the last queued one.
+static void evq_push(Widget *w, size_t widget_idx, Snapshot *s, int scroll_button)
+{
+    uint64_t ndropped = 0;
+
+    LS_PTH_CHECK(pthread_mutex_lock(&evq.mtx));
+    EventQueue *q = w->evq;
+    if (scroll_button && q->size) {
+        QueuedEvent *last = &q->entries[(q->head + q->size - 1) % EVQ_CAPACITY];
+        if (last->scroll_button == scroll_button) {
+            ++last->count;
+            snapshot_destroy(s);
+            goto done;
+        }
+    }
+    if (q->size == EVQ_CAPACITY) {
+        ndropped = ++q->ndropped;
+        snapshot_destroy(s);
+        goto done;
+    }
+    q->entries[(q->head + q->size) % EVQ_CAPACITY] = (QueuedEvent) {
+        .s = s,
+        .scroll_button = scroll_button,
+        .count = 1,
+    };
+    ++q->size;
+    if (!q->scheduled) {
+        q->scheduled = true;
+        evq_ready_push(widget_idx);
+        LS_PTH_CHECK(pthread_cond_signal(&evq.cond));
+    }
+done:
+    LS_PTH_CHECK(pthread_mutex_unlock(&evq.mtx));
+
+    // Only report the 1st, 2nd, 4th, 8th, etc. dropped event, so as not to flood the log.
+    if (ndropped && !(ndropped & (ndropped - 1))) {
+        WARNF("widget '%s': event queue is full, %llu event(s) dropped so far",
+              w->filename, (unsigned long long) ndropped);
+    }
+}
+
+static lua_State *ew_call_begin(void *userdata, size_t widget_idx)
+{
+    assert(widget_idx < nwidgets);
+    Widget *w = &widgets[widget_idx];
+    WTRACEF(w, "ew_call_begin(userdata=%p, widget_idx=%zu)", userdata, widget_idx);
+
+    LS_PTH_CHECK(pthread_mutex_lock(&evq.stage_mtx));
+    assert(lua_gettop(evq.L) == 0); // evq.L: -
+    return evq.L;
+}
+
+static void ew_call_end(void *userdata, size_t widget_idx)
+{
+    assert(widget_idx < nwidgets);
+    Widget *w = &widgets[widget_idx];
+    WTRACEF(w, "ew_call_end(userdata=%p, widget_idx=%zu)", userdata, widget_idx);
+
+    lua_State *L = evq.L;
+    assert(lua_gettop(L) == 1); // L: arg
+    Snapshot *s = NULL;
+    int scroll_button = 0;
+    if (w->lref_event != LUA_REFNIL) {
+        char errbuf[256];
+        if (snapshot_serialize(&evq.buf, L, errbuf, sizeof(errbuf))) {
+            s = snapshot_new(&evq.buf);
+            if (w->coalesce_scroll) {
+                scroll_button = event_scroll_button(L);
+            }
+        } else {
+            ERRF("widget '%s': event watcher generated an unsupported value: %s",
+                 w->filename, errbuf);
+        }
+    }
+    lua_settop(L, 0); // L: -
+    LS_PTH_CHECK(pthread_mutex_unlock(&evq.stage_mtx));
+
+    if (s) {
+        evq_push(w, widget_idx, s, scroll_button);
+    }
+}
+
+static void ew_call_cancel(void *userdata, size_t widget_idx)
+{
+    assert(widget_idx < nwidgets);
+    Widget *w = &widgets[widget_idx];
+    WTRACEF(w, "ew_call_cancel(userdata=%p, widget_idx=%zu)", userdata, widget_idx);
+
+    lua_settop(evq.L, 0); // evq.L: -
+    LS_PTH_CHECK(pthread_mutex_unlock(&evq.stage_mtx));
+}
+
+// Should be invoked whenever the plugin of a widget /w/ stops running: either its /run()/ returns,
+// or one of its reactor callbacks returns /LUASTATUS_ERR/.
+static void widget_plugin_stopped(Widget *w)
+{
+    publish(w, ERROR_SNAPSHOT);
+}
+
+// Each thread spawned for a widget whose plugin implements the first revision of the interface runs
+// this function. /arg/ is a pointer to the widget.
+static void *widget_thread(void *arg)
+{
+    Widget *w = arg;
+    DEBUGF("thread for widget '%s' is running", w->filename);
+
+    w->plugin.mod->iface.v1.run(&w->data, (LuastatusPluginRunFuncs_v1) {
+        .call_begin  = plugin_call_begin,
+        .call_end    = plugin_call_end,
+        .call_cancel = plugin_call_cancel,
+    });
+    WARNF("plugin's run() for widget '%s' has returned", w->filename);
+
+    widget_plugin_stopped(w);
+
+    return NULL;
+}
+
+static int plugin_watch_fd(void *userdata, int fd, int events)
+{
+    Widget *w = userdata;
+    WTRACEF(w, "plugin_watch_fd(userdata=%p, fd=%d, events=%d)", userdata, fd, events);
+
+    return reactor_source_watch_fd(w->source, fd, events);
+}
+
+static int plugin_unwatch_fd(void *userdata, int fd)
+{
+    Widget *w = userdata;
+    WTRACEF(w, "plugin_unwatch_fd(userdata=%p, fd=%d)", userdata, fd);
+
+    return reactor_source_unwatch_fd(w->source, fd);
+}
+
+static void plugin_set_timeout(void *userdata, double tmo)
+{
+    Widget *w = userdata;
+    WTRACEF(w, "plugin_set_timeout(userdata=%p, tmo=%g)", userdata, tmo);
+
+    reactor_source_set_timeout(w->source, tmo);
+}
+
+static const LuastatusPluginReactorFuncs_v2 plugin_reactor_funcs = {
+    .call_begin  = plugin_call_begin,
+    .call_end    = plugin_call_end,
+    .call_cancel = plugin_call_cancel,
+    .watch_fd    = plugin_watch_fd,
+    .unwatch_fd  = plugin_unwatch_fd,
+    .set_timeout = plugin_set_timeout,
+};
+
+// Checks the value /ret/ returned by a reactor callback of the plugin of a widget /w/.
+//
+// Returns /true/ if the widget should continue running; /false/ otherwise.
+static bool widget_check_reactor_call(Widget *w, int ret)
+{
+    if (ret == LUASTATUS_ERR) {
+        WARNF("plugin of widget '%s' has stopped", w->filename);
+        widget_plugin_stopped(w);
+        return false;
+    }
+    return true;
+}
+
+// Reactor callbacks of widgets whose plugins implement the second revision of the interface.
+// /userdata/ is a pointer to the widget.
+
+static bool widget_on_fd(void *userdata, int fd, int revents)
+{
+    Widget *w = userdata;
+    const LuastatusPluginIface_v2 *iface = &w->plugin.mod->iface.v2;
+    if (!iface->on_fd) {
+        return true;
+    }
+    return widget_check_reactor_call(w, iface->on_fd(&w->data, plugin_reactor_funcs, fd, revents));
+}
+
+static bool widget_on_timeout(void *userdata)
+{
+    Widget *w = userdata;
+    const LuastatusPluginIface_v2 *iface = &w->plugin.mod->iface.v2;
+    int ret;
+    if (!w->started) {
+        // A reactor source's initial timeout is zero, so this is the first callback.
+        DEBUGF("starting widget '%s' in a reactor", w->filename);
+        w->started = true;
+        ret = iface->start(&w->data, plugin_reactor_funcs);
+    } else if (iface->on_timeout) {
+        ret = iface->on_timeout(&w->data, plugin_reactor_funcs);
+    } else {
+        ret = LUASTATUS_OK;
+    }
+    return widget_check_reactor_call(w, ret);
+}
+
+static bool widget_on_pause(void *userdata, bool paused)
+{
+    Widget *w = userdata;
+    const LuastatusPluginIface_v2 *iface = &w->plugin.mod->iface.v2;
+    int (*f)(LuastatusPluginData_v1 *, LuastatusPluginReactorFuncs_v2) =
+        paused ? iface->pause : iface->resume;
+    if (!w->started || !f) {
+        return true;
+    }
+    DEBUGF("%s widget '%s'", paused ? "pausing" : "resuming", w->filename);
+    return widget_check_reactor_call(w, f(&w->data, plugin_reactor_funcs));
+}
+
+static Reactor *xnew_reactor(void)
+{
+    Reactor *r = reactor_new();
+    if (!r) {
+        FATALF("cannot create reactor: %s", ls_strerror_onstack(errno));
+        abort();
+    }
+    return r;
+}
+
+static void *pause_thread(void *arg)
+{
+    (void) arg;
+
+    bool cur = false;
+    while (1) {
+        while (sem_wait(&pausectl.wakeup) < 0) {
+            if (errno != EINTR) {
+                LS_PANIC("sem_wait() failed");
+            }
+        }
+        if (__atomic_load_n(&pausectl.quit, __ATOMIC_SEQ_CST)) {
+            break;
+        }
+        bool requested = __atomic_load_n(&pausectl.requested, __ATOMIC_SEQ_CST);
+        if (requested == cur) {
+            continue;
+        }
+        cur = requested;
+        INFOF("%s widgets", cur ? "pausing" : "resuming");
+
+        LS_PTH_CHECK(pthread_mutex_lock(&pacer.mtx));
+        __atomic_store_n(&pausectl.paused, cur, __ATOMIC_SEQ_CST);
+        LS_PTH_CHECK(pthread_cond_signal(&pacer.cond));
+        LS_PTH_CHECK(pthread_mutex_unlock(&pacer.mtx));
+
+        for (size_t i = 0; i < pausectl.nreactors; ++i) {
+            reactor_set_paused(pausectl.reactors[i], cur);
+        }
+    }
+    return NULL;
+}
+
+// Spawns the pause thread, which is going to pause /nreactors/ reactors /reactors/ along with the
+// widgets. /pausectl.wakeup/ must have been initialized, and the pacer thread spawned.
+static void pause_start(Reactor *const *reactors, size_t nreactors)
+{
+    pausectl.reactors = reactors;
+    pausectl.nreactors = nreactors;
+    pausectl.quit = false;
+    LS_PTH_CHECK(pthread_create(&pausectl.thread, NULL, pause_thread, NULL));
+    pausectl.running = true;
+}
+
+// Joins the pause thread, if running; the widgets are left in whatever state they are.
+static void pause_maybe_stop(void)
+{
+    if (!pausectl.running) {
+        return;
+    }
+    __atomic_store_n(&pausectl.quit, true, __ATOMIC_SEQ_CST);
+    if (sem_post(&pausectl.wakeup) < 0) {
+        LS_PANIC("sem_post() failed");
+    }
+    LS_PTH_CHECK(pthread_join(pausectl.thread, NULL));
+    pausectl.running = false;
+}
+
+// Returns the number of threads to run the shared reactor with, given that /nsources/ widgets are
+// run in it.
+static size_t shared_reactor_nthreads(size_t nsources)
+{
+    enum { MIN_THREADS = 2, MAX_THREADS = 4 };
+
+    long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t r = ncpus > 0 ? (size_t) ncpus : 1;
+    if (r < MIN_THREADS) {
+        r = MIN_THREADS;
+    }
+    if (r > MAX_THREADS) {
+        r = MAX_THREADS;
+    }
+    return r < nsources ? r : nsources;
+}
+
+// Invokes /barlib/'s /set_error()/ method on the widget with index /widget_idx/ and performs all
+// the error-checking required.
+static void render_set_error(size_t widget_idx)
+{
+    LS_USDT1(luastatus, set__error, widget_idx);
+    if (barlib.iface.set_error(&barlib.data, widget_idx) == LUASTATUS_ERR) {
+        FATALF("barlib's set_error() reported fatal error");
+        fatal_error_reported();
     }
 }
 
-// Registers /barlib/'s functions at /L/.
-// If /w/ is not /NULL/, also registers /w->plugin/'s functions at /L/.
-static void register_funcs(lua_State *L, Widget *w)
+// Passes an update /s/ of the widget with index /widget_idx/ to /barlib/, unless it is structurally
+// equal to the last one successfully passed (and /render.skip_unchanged/ is set). Returns /true/ if
+// the barlib has been called.
+static bool render_update(size_t widget_idx, Snapshot *s)
 {
-    // L: ?
-    lua_getglobal(L, "luastatus"); // L: ? luastatus
+    Widget *w = &widgets[widget_idx];
+    uint64_t t = stats_now();
+    if (s == ERROR_SNAPSHOT) {
+        LS_USDT1(luastatus, set__start, widget_idx);
+        w->set_hash_valid = false;
+        render_set_error(widget_idx);
+        goto done;
+    }
+    uint64_t hash = 0;
+    if (render.skip_unchanged) {
+        hash = snapshot_hash(s);
+        if (w->set_hash_valid && w->set_hash == hash) {
+            snapshot_destroy(s);
+            stats_inc(&w->stats->sets_skipped);
+            return false;
+        }
+    }
+    LS_USDT1(luastatus, set__start, widget_idx);
+    lua_State *L = render.L;
+    snapshot_push(s, L); // L: result
+    w->set_hash_valid = false;
+    switch (barlib.iface.set(&barlib.data, L, widget_idx)) {
+    case LUASTATUS_OK:
+        w->set_hash_valid = render.skip_unchanged;
+        w->set_hash = hash;
+        break;
+    case LUASTATUS_NONFATAL_ERR:
+        render_set_error(widget_idx);
+        break;
+    case LUASTATUS_ERR:
+        FATALF("barlib's set() reported fatal error");
+        fatal_error_reported();
+        break;
+    }
+    lua_settop(L, 0); // L: -
+    snapshot_destroy(s);
+done:
+    {
+        uint64_t elapsed = stats_now() - t;
+        stats_hist_record(&w->stats->set, elapsed);
+        LS_USDT2(luastatus, set__done, widget_idx, elapsed);
+    }
+    return true;
+}
 
-    if (!lua_istable(L, -1)) {
-        assert(w);
-        assert(!widget_is_stillborn(w));
+// Consumes all the filled slots.
+static void render_frame(void)
+{
+    __atomic_store_n(&render.pending, false, __ATOMIC_SEQ_CST);
 
-        WARNF("widget '%s': 'luastatus' is not a table anymore, will not register "
-              "barlib/plugin functions",
-              w->filename);
-        goto done;
+    bool changed = false;
+    for (size_t i = 0; i < nwidgets; ++i) {
+        Snapshot *s = __atomic_exchange_n(&widgets[i].slot, NULL, __ATOMIC_SEQ_CST);
+        if (s && render_update(i, s)) {
+            changed = true;
+        }
     }
-    if (barlib.iface.register_funcs) {
-        lua_newtable(L); // L: ? luastatus table
+    if (changed && barlib.iface_rev == 2) {
+        TRACEF("flushing the frame");
+        if (barlib.iface.flush(&barlib.data) == LUASTATUS_ERR) {
+            FATALF("barlib's flush() reported fatal error");
+            fatal_error_reported();
+        }
+    }
+}
 
-        int old_top = lua_gettop(L);
-        (void) old_top;
-        barlib.iface.register_funcs(&barlib.data, L); // L: ? luastatus table
-        assert(lua_gettop(L) == old_top);
+static void *render_thread(void *arg)
+{
+    (void) arg;
 
-        lua_setfield(L, -2, "barlib"); // L: ? luastatus
+    struct timespec frame_ts = {
+        .tv_sec = frame_period_ms / 1000,
+        .tv_nsec = (long) (frame_period_ms % 1000) * 1000000L,
+    };
+    while (1) {
+        while (sem_wait(&render.wakeup) < 0) {
+            if (errno != EINTR) {
+                LS_PANIC("sem_wait() failed");
+            }
+        }
+        bool quit = __atomic_load_n(&render.quit, __ATOMIC_SEQ_CST);
+        if (!quit && frame_period_ms) {
+            // Wait for the end of the frame, letting other updates in.
+            struct timespec rem = frame_ts;
+            while (nanosleep(&rem, &rem) < 0 && errno == EINTR) {
+            }
+        }
+        render_frame();
+        if (quit) {
+            break;
+        }
     }
-    if (w && w->plugin.iface.register_funcs) {
-        lua_newtable(L); // L: ? luastatus table
+    return NULL;
+}
 
-        int old_top = lua_gettop(L);
-        (void) old_top;
-        w->plugin.iface.register_funcs(&w->data, L); // L: ? luastatus table
-        assert(lua_gettop(L) == old_top);
+static void render_start(void)
+{
+    if (frame_period_ms) {
+        DEBUGF("coalescing updates into frames of %u ms", frame_period_ms);
+    }
+    render.L = xnew_lua_state(&render.alloc, NULL);
+    render.pending = false;
+    render.quit = false;
+    // A barlib whose /set()/ has side effects beyond drawing the data passed opts out of skipping
+    // unchanged updates (see DOCS/WRITING_BARLIB_OR_PLUGIN.md).
+    render.skip_unchanged = !*map_get(NULL, "flag:barlib_wants:unchanged_sets");
+    if (!render.skip_unchanged) {
+        DEBUGF("barlib wants unchanged updates, not skipping them");
+    }
+    if (sem_init(&render.wakeup, 0, 0) < 0) {
+        LS_PANIC("sem_init() failed");
+    }
+    LS_PTH_CHECK(pthread_create(&render.thread, NULL, render_thread, NULL));
+    render.running = true;
+}
 
-        lua_setfield(L, -2, "plugin"); // L: ? luastatus
+// Makes the render thread consume the pending updates, if any, and joins it, if it is running.
+static void render_maybe_stop(void)
+{
+    if (!render.running) {
+        return;
     }
+    __atomic_store_n(&render.quit, true, __ATOMIC_SEQ_CST);
+    if (sem_post(&render.wakeup) < 0) {
+        LS_PANIC("sem_post() failed");
+    }
+    LS_PTH_CHECK(pthread_join(render.thread, NULL));
+    render.running = false;
 
-done:
-    lua_pop(L, 1); // L: ?
+    if (sem_destroy(&render.wakeup) < 0) {
+        LS_PANIC("sem_destroy() failed");
+    }
+    lua_close(render.L);
+    lua_alloc_destroy(&render.alloc);
 }
 
-// Initializes the /widgets/ and /nwidgets/ global variables from the given list of file names:
-// sets /nwidgets/, allocates /widgets/, initialized all the widgets, and makes ones whose
-// initialization failed stillborn.
-static void widgets_init(char *const *filenames, size_t nfilenames)
+// The period, in seconds, with which the metrics are appended to the file given with /-M/.
+#define STATS_DUMP_PERIOD_S 10
+
+static struct {
+    // The file passed with /-M/, or /NULL/.
+    const char *path;
+
+    // The stream of /path/, opened for appending, or /NULL/.
+    FILE *f;
+
+    // A self-pipe; the /SIGUSR1/ handler writes 'd' (dump) into it, and /stats_maybe_stop()/ writes
+    // 'q' (quit). The write end is non-blocking, so that the handler never blocks the thread that
+    // has taken the signal (which may be the stats thread itself).
+    int pipe_fds[2];
+
+    // Whether the stats thread has been spawned and not yet joined. Only accessed by the main
+    // thread.
+    bool running;
+
+    pthread_t thread;
+} stats_dumper = {.path = NULL, .f = NULL, .pipe_fds = {-1, -1}, .running = false};
+
+static void stats_sigusr1_handler(int signo)
 {
-    nwidgets = nfilenames;
-    widgets = LS_XNEW(Widget, nwidgets);
+    (void) signo;
+
+    int saved_errno = errno;
+    // If the pipe is full (the write fails with /EAGAIN/), a dump is already pending anyway.
+    ssize_t r = write(stats_dumper.pipe_fds[1], "d", 1);
+    (void) r;
+    errno = saved_errno;
+}
+
+// Logs a summary of the metrics of each widget.
+static void stats_log(void)
+{
+    LSString buf = LS_VECTOR_NEW();
     for (size_t i = 0; i < nwidgets; ++i) {
-        if (!widget_init(&widgets[i], filenames[i])) {
-            ERRF("cannot load widget '%s'", filenames[i]);
-            widget_init_stillborn(&widgets[i]);
+        Widget *w = &widgets[i];
+        if (widget_is_stillborn(w)) {
+            continue;
         }
+        LS_VECTOR_CLEAR(buf);
+        stats_append_summary(&buf, w->stats);
+        INFOF("stats: %s: %.*s", w->filename, (int) buf.size, buf.data);
     }
+    LS_VECTOR_FREE(buf);
 }
 
-static void widgets_destroy(void)
+// Appends a JSON line with the metrics of each widget to /stats_dumper.f/.
+static void stats_write(void)
 {
+    struct timespec ts;
+    LS_PTH_CHECK(clock_gettime(CLOCK_REALTIME, &ts));
+    double now = ts.tv_sec + ts.tv_nsec / 1e9;
+
+    LSString buf = LS_VECTOR_NEW();
     for (size_t i = 0; i < nwidgets; ++i) {
-        widget_destroy(&widgets[i]);
+        Widget *w = &widgets[i];
+        if (!widget_is_stillborn(w)) {
+            stats_append_json(&buf, w->filename, now, w->stats);
+        }
     }
-    free(widgets);
+    if (fwrite(buf.data, 1, buf.size, stats_dumper.f) != buf.size || fflush(stats_dumper.f) < 0) {
+        WARNF("stats: cannot write to '%s': %s", stats_dumper.path, ls_strerror_onstack(errno));
+    }
+    LS_VECTOR_FREE(buf);
 }
 
-// Should be invoked whenever the barlib reports a fatal error.
-static LS_ATTR_NORETURN
-void fatal_error_reported(void)
+static void *stats_thread(void *arg)
 {
-    fflush(NULL);
-    _exit(EXIT_FAILURE);
+    (void) arg;
+
+    const uint64_t period_ns = (uint64_t) STATS_DUMP_PERIOD_S * 1000000000;
+
+    struct pollfd pfd = {.fd = stats_dumper.pipe_fds[0], .events = POLLIN};
+    // The time (as returned by /stats_now()/) of the next periodic write, so that requests to dump
+    // the metrics into the log do not postpone it.
+    uint64_t deadline = stats_now() + period_ns;
+    while (1) {
+        int timeout = -1;
+        if (stats_dumper.f) {
+            uint64_t now = stats_now();
+            if (now >= deadline) {
+                stats_write();
+                deadline = stats_now() + period_ns;
+                continue;
+            }
+            // Round up, so that /poll()/ does not time out right before the deadline.
+            timeout = (deadline - now + 999999) / 1000000;
+        }
+        int r = poll(&pfd, 1, timeout);
+        if (r < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            LS_PANIC("poll() failed");
+        }
+        if (r == 0) {
+            // The deadline has passed; the write is done at the top of the loop.
+            continue;
+        }
+        // Take all the pending requests at once, so that a burst of /SIGUSR1/ results in a single
+        // dump.
+        char cmds[64];
+        ssize_t nread = read(stats_dumper.pipe_fds[0], cmds, sizeof(cmds));
+        if (nread < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            LS_PANIC("read() failed");
+        }
+        if (memchr(cmds, 'q', nread)) {
+            break;
+        }
+        stats_log();
+    }
+    if (stats_dumper.f) {
+        stats_write();
+    }
+    return NULL;
 }
 
-// Invokes /barlib/'s /set_error()/ method on the widget with index /widget_idx/ and performs all
-// the error-checking required.
+// Spawns the stats thread: makes /SIGUSR1/ dump the metrics into the log and, if /-M/ was passed,
+// appends them to the given file periodically.
 //
-// Does not do any locking/unlocking.
-static void set_error_unlocked(size_t widget_idx)
+// Must be called before the map is frozen, as it claims /SIGUSR1/ via /map_get()/.
+static void stats_start(void)
 {
-    if (barlib.iface.set_error(&barlib.data, widget_idx) == LUASTATUS_ERR) {
-        FATALF("barlib's set_error() reported fatal error");
-        fatal_error_reported();
+    if (stats_dumper.path) {
+        int fd = open(stats_dumper.path, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0666);
+        if (fd < 0 || !(stats_dumper.f = fdopen(fd, "a"))) {
+            WARNF("stats: cannot open '%s': %s", stats_dumper.path, ls_strerror_onstack(errno));
+            if (fd >= 0) {
+                close(fd);
+            }
+        }
     }
+
+    if (ls_cloexec_pipe(stats_dumper.pipe_fds) < 0) {
+        LS_PANIC("pipe() failed");
+    }
+    if (ls_make_nonblock(stats_dumper.pipe_fds[1]) < 0) {
+        LS_PANIC("ls_make_nonblock() failed");
+    }
+
+    void **flag = map_get(NULL, "flag:signal_handled:SIGUSR1");
+    if (*flag) {
+        WARNF("stats: SIGUSR1 is already handled by a plugin; metrics can not be dumped on it");
+    } else {
+        *flag = &stats_dumper;
+        struct sigaction sa = {.sa_flags = SA_RESTART, .sa_handler = stats_sigusr1_handler};
+        sigemptyset(&sa.sa_mask);
+        if (sigaction(SIGUSR1, &sa, NULL) < 0) {
+            WARNF("stats: sigaction: SIGUSR1: %s", ls_strerror_onstack(errno));
+        }
+    }
+
+    LS_PTH_CHECK(pthread_create(&stats_dumper.thread, NULL, stats_thread, NULL));
+    stats_dumper.running = true;
 }
 
-static lua_State *plugin_call_begin(void *userdata)
+// Makes the stats thread write out the metrics one last time, if /-M/ was passed, and joins it, if
+// it is running.
+static void stats_maybe_stop(void)
 {
-    TRACEF("plugin_call_begin(userdata=%p)", userdata);
+    if (!stats_dumper.running) {
+        return;
+    }
+    struct sigaction sa = {.sa_handler = SIG_IGN};
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGUSR1, &sa, NULL);
+
+    while (write(stats_dumper.pipe_fds[1], "q", 1) < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            // The pipe is full; wait for the stats thread to drain it.
+            struct pollfd pfd = {.fd = stats_dumper.pipe_fds[1], .events = POLLOUT};
+            poll(&pfd, 1, -1);
+        } else if (errno != EINTR) {
+            LS_PANIC("write() failed");
+        }
+    }
+    LS_PTH_CHECK(pthread_join(stats_dumper.thread, NULL));
+    stats_dumper.running = false;
+
+    close(stats_dumper.pipe_fds[0]);
+    close(stats_dumper.pipe_fds[1]);
+    if (stats_dumper.f) {
+        fclose(stats_dumper.f);
+        stats_dumper.f = NULL;
+    }
+}
 
-    Widget *w = userdata;
-    LOCK_L(w);
+// The period, in seconds, with which the profiles are written out, if /-P/ was passed.
+#define PROF_WRITE_PERIOD_S 10
 
-    lua_State *L = w->L;
-    assert(lua_gettop(L) == 1); // w->L: l_error_handler
-    lua_rawgeti(L, LUA_REGISTRYINDEX, w->lref_cb); // w->L: l_error_handler cb
-    return L;
-}
+static struct {
+    // Whether the profiler thread should write the profiles one last time and terminate. Guarded
+    // by /mtx/.
+    bool quit;
 
-static void plugin_call_end(void *userdata)
+    pthread_mutex_t mtx;
+
+    // Signalled when /quit/ is set; used with /mtx/.
+    pthread_cond_t cond;
+
+    // Whether the profiler thread has been spawned and not yet joined. Only accessed by the main
+    // thread.
+    bool running;
+
+    pthread_t thread;
+} prof = {.running = false};
+
+static void prof_write_all(void)
 {
-    TRACEF("plugin_call_end(userdata=%p)", userdata);
+    for (size_t i = 0; i < nwidgets; ++i) {
+        Profile *p = widgets[i].profile;
+        if (p && !profile_write(p)) {
+            WARNF("cannot write profile '%s': %s", profile_path(p), ls_strerror_onstack(errno));
+        }
+    }
+}
 
-    Widget *w = userdata;
-    lua_State *L = w->L;
-    assert(lua_gettop(L) == 3); // L: l_error_handler cb data
-    bool r = do_lua_call(L, 1, 1);
-    LOCK_B();
-    size_t widget_idx = widget_index(w);
-    if (r) {
-        // L: l_error_handler result
-        switch (barlib.iface.set(&barlib.data, L, widget_idx)) {
-        case LUASTATUS_OK:
-            // L: l_error_handler result
-            break;
-        case LUASTATUS_NONFATAL_ERR:
-            // L: l_error_handler ?
-            set_error_unlocked(widget_idx);
-            break;
-        case LUASTATUS_ERR:
-            // L: l_error_handler ?
-            FATALF("barlib's set() reported fatal error");
-            fatal_error_reported();
+static void *prof_thread(void *arg)
+{
+    (void) arg;
+
+    LS_PTH_CHECK(pthread_mutex_lock(&prof.mtx));
+    while (1) {
+        struct timespec deadline;
+        LS_PTH_CHECK(clock_gettime(CLOCK_MONOTONIC, &deadline));
+        deadline.tv_sec += PROF_WRITE_PERIOD_S;
+        while (!prof.quit) {
+            int r = pthread_cond_timedwait(&prof.cond, &prof.mtx, &deadline);
+            if (r == ETIMEDOUT) {
+                break;
+            }
+            LS_PTH_CHECK(r);
+        }
+        prof_write_all();
+        if (prof.quit) {
             break;
         }
-        lua_settop(L, 1); // L: l_error_handler
-    } else {
-        // L: l_error_handler
-        set_error_unlocked(widget_idx);
     }
-    UNLOCK_B();
-    UNLOCK_L(w);
+    LS_PTH_CHECK(pthread_mutex_unlock(&prof.mtx));
+    return NULL;
 }
 
-static void plugin_call_cancel(void *userdata)
+// Creates a profile for each successfully initialized widget, and spawns the profiler thread,
+// which writes them out periodically.
+static void prof_start(void)
 {
-    TRACEF("plugin_call_cancel(userdata=%p)", userdata);
+    for (size_t i = 0; i < nwidgets; ++i) {
+        Widget *w = &widgets[i];
+        if (!widget_is_stillborn(w)) {
+            w->profile = profile_new(profile_dir, w->filename, i);
+        }
+    }
 
-    Widget *w = userdata;
-    lua_settop(w->L, 1); // w->L: l_error_handler
-    UNLOCK_L(w);
+    prof.quit = false;
+    LS_PTH_CHECK(pthread_mutex_init(&prof.mtx, NULL));
+
+    pthread_condattr_t attr;
+    LS_PTH_CHECK(pthread_condattr_init(&attr));
+    LS_PTH_CHECK(pthread_condattr_setclock(&attr, CLOCK_MONOTONIC));
+    LS_PTH_CHECK(pthread_cond_init(&prof.cond, &attr));
+    LS_PTH_CHECK(pthread_condattr_destroy(&attr));
+
+    LS_PTH_CHECK(pthread_create(&prof.thread, NULL, prof_thread, NULL));
+    prof.running = true;
 }
 
-static lua_State *ew_call_begin(void *userdata, size_t widget_idx)
+// Makes the profiler thread write out the profiles one last time, and joins it, if it is running.
+static void prof_maybe_stop(void)
 {
-    TRACEF("ew_call_begin(userdata=%p, widget_idx=%zu)", userdata, widget_idx);
+    if (!prof.running) {
+        return;
+    }
+    LS_PTH_CHECK(pthread_mutex_lock(&prof.mtx));
+    prof.quit = true;
+    LS_PTH_CHECK(pthread_cond_signal(&prof.cond));
+    LS_PTH_CHECK(pthread_mutex_unlock(&prof.mtx));
 
-    assert(widget_idx < nwidgets);
-    Widget *w = &widgets[widget_idx];
-    LOCK_E(w);
+    LS_PTH_CHECK(pthread_join(prof.thread, NULL));
+    prof.running = false;
 
-    lua_State *L = widget_event_lua_state(w);
-    assert(lua_gettop(L) == 1); // L: l_error_handler
-    lua_rawgeti(L, LUA_REGISTRYINDEX, w->lref_event); // L: l_error_handler event
-    return L;
+    LS_PTH_CHECK(pthread_cond_destroy(&prof.cond));
+    LS_PTH_CHECK(pthread_mutex_destroy(&prof.mtx));
 }
 
-static void ew_call_end(void *userdata, size_t widget_idx)
+// Creates the staging state and spawns the event workers.
+static void evq_start(void)
 {
-    TRACEF("ew_call_end(userdata=%p, widget_idx=%zu)", userdata, widget_idx);
-
-    assert(widget_idx < nwidgets);
-    Widget *w = &widgets[widget_idx];
-    lua_State *L = widget_event_lua_state(w);
-    assert(lua_gettop(L) == 3); // L: l_error_handler event arg
-    if (w->lref_event == LUA_REFNIL) {
-        lua_pop(L, 2); // L: l_error_handler
-    } else {
-        if (!do_lua_call(L, 1, 0)) {
-            // L: l_error_handler
-            LOCK_B();
-            set_error_unlocked(widget_idx);
-            UNLOCK_B();
+    size_t nevent_widgets = 0;
+    for (size_t i = 0; i < nwidgets; ++i) {
+        if (widgets[i].lref_event != LUA_REFNIL) {
+            ++nevent_widgets;
         }
-        // L: l_error_handler
     }
-    UNLOCK_E(w);
+    long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t n = ncpus > 0 ? (size_t) ncpus : 1;
+    if (n > EVQ_MAX_WORKERS) {
+        n = EVQ_MAX_WORKERS;
+    }
+    if (n > nevent_widgets) {
+        n = nevent_widgets;
+    }
+    DEBUGF("spawning %zu event worker(s)", n);
+
+    evq.L = xnew_lua_state(&evq.alloc, NULL);
+    LS_PTH_CHECK(pthread_mutex_init(&evq.stage_mtx, NULL));
+    LS_VECTOR_INIT(evq.buf);
+    LS_PTH_CHECK(pthread_mutex_init(&evq.mtx, NULL));
+    LS_PTH_CHECK(pthread_cond_init(&evq.cond, NULL));
+    evq.ready = LS_XNEW(size_t, nwidgets ? nwidgets : 1);
+    evq.ready_head = 0;
+    evq.ready_size = 0;
+    evq.quit = false;
+
+    evq.nworkers = n;
+    evq.workers = LS_XNEW(pthread_t, n ? n : 1);
+    for (size_t i = 0; i < n; ++i) {
+        LS_PTH_CHECK(pthread_create(&evq.workers[i], NULL, evq_worker, NULL));
+    }
+    evq.running = true;
 }
 
-static void ew_call_cancel(void *userdata, size_t widget_idx)
+// Lets the event workers handle the queued events, joins them, and destroys the staging state, if
+// running.
+static void evq_maybe_stop(void)
 {
-    TRACEF("ew_call_cancel(userdata=%p, widget_idx=%zu)", userdata, widget_idx);
+    if (!evq.running) {
+        return;
+    }
+    LS_PTH_CHECK(pthread_mutex_lock(&evq.mtx));
+    evq.quit = true;
+    LS_PTH_CHECK(pthread_cond_broadcast(&evq.cond));
+    LS_PTH_CHECK(pthread_mutex_unlock(&evq.mtx));
 
-    assert(widget_idx < nwidgets);
-    Widget *w = &widgets[widget_idx];
-    lua_State *L = widget_event_lua_state(w);
-    lua_settop(L, 1); // L: l_error_handler
-    UNLOCK_E(w);
+    for (size_t i = 0; i < evq.nworkers; ++i) {
+        LS_PTH_CHECK(pthread_join(evq.workers[i], NULL));
+    }
+    evq.running = false;
+
+    free(evq.workers);
+    free(evq.ready);
+    LS_PTH_CHECK(pthread_cond_destroy(&evq.cond));
+    LS_PTH_CHECK(pthread_mutex_destroy(&evq.mtx));
+    LS_VECTOR_FREE(evq.buf);
+    LS_PTH_CHECK(pthread_mutex_destroy(&evq.stage_mtx));
+    lua_close(evq.L);
+    lua_alloc_destroy(&evq.alloc);
 }
 
-// Each thread spawned for a widget runs this function. /arg/ is a pointer to the widget.
-static void *widget_thread(void *arg)
+// Parses the argument of the /-s/ and /-E/ options: a positive number of Lua interpreter
+// instances.
+static int parse_ninterps(const char *s)
 {
-    Widget *w = arg;
-    DEBUGF("thread for widget '%s' is running", w->filename);
-
-    w->plugin.iface.run(&w->data, (LuastatusPluginRunFuncs_v1) {
-        .call_begin  = plugin_call_begin,
-        .call_end    = plugin_call_end,
-        .call_cancel = plugin_call_cancel,
-    });
-    WARNF("plugin's run() for widget '%s' has returned", w->filename);
-
-    LOCK_B();
-    set_error_unlocked(widget_index(w));
-    UNLOCK_B();
+    const char *endptr;
+    int r = ls_strtou_b(s, strlen(s), &endptr);
+    if (r <= 0 || endptr == s || *endptr) {
+        return -1;
+    }
+    return r;
+}
 
-    return NULL;
+// Parses the argument of the /-F/ option: a non-negative number of milliseconds, optionally
+// followed by "ms".
+static int parse_frame_period(const char *s)
+{
+    const char *endptr;
+    int r = ls_strtou_b(s, strlen(s), &endptr);
+    if (r < 0 || endptr == s || (*endptr && strcmp(endptr, "ms") != 0)) {
+        return -1;
+    }
+    return r;
 }
 
 static void prepare_signals(void)
@@ -1054,8 +3591,10 @@ static void prepare_signals(void)
 
 static void print_usage(void)
 {
-    fprintf(stderr, "USAGE: luastatus -b barlib [-B barlib_option [-B ...]] [-l loglevel] [-e] "
-                    "widget.lua [widget2.lua ...]\n"
+    fprintf(stderr, "USAGE: luastatus -b barlib [-B barlib_option [-B ...]] [-l loglevel] "
+                    "[-F frame_period] [-s num_interpreters] [-E num_event_states]\n"
+                    "                 [-M metrics_file] [-P profile_dir] [-C] [-t] [-e]\n"
+                    "                 widget.lua [widget2.lua ...]\n"
                     "       luastatus -v\n"
                     "See luastatus(1) for more information.\n");
 }
@@ -1066,12 +3605,17 @@ int main(int argc, char **argv)
     char *barlib_name = NULL;
     LS_VECTOR_OF(const char *) barlib_args = LS_VECTOR_NEW();
     bool eflag = false;
+    bool cflag = false;
+    bool tflag = false;
     LS_VECTOR_OF(pthread_t) threads = LS_VECTOR_NEW();
+    LS_VECTOR_OF(Reactor *) reactors = LS_VECTOR_NEW();
+    Reactor *shared_reactor = NULL;
+    size_t nshared_reactor_widgets = 0;
     bool barlib_inited = false;
 
     // Parse the arguments.
 
-    for (int c; (c = getopt(argc, argv, "b:B:l:ev")) != -1;) {
+    for (int c; (c = getopt(argc, argv, "b:B:l:F:s:E:M:P:Ctev")) != -1;) {
         switch (c) {
         case 'b':
             barlib_name = optarg;
@@ -1086,6 +3630,56 @@ int main(int argc, char **argv)
                 goto cleanup;
             }
             break;
+        case 'F':
+            {
+                int r = parse_frame_period(optarg);
+                if (r < 0) {
+                    fprintf(stderr, "Invalid frame period '%s'.\n", optarg);
+                    print_usage();
+                    goto cleanup;
+                }
+                frame_period_ms = r;
+            }
+            break;
+        case 's':
+            {
+                int r = parse_ninterps(optarg);
+                if (r < 0) {
+                    fprintf(stderr, "Invalid number of shared interpreters '%s'.\n", optarg);
+                    print_usage();
+                    goto cleanup;
+                }
+                free(shared.interps);
+                shared.n = r;
+                shared.interps = LS_XNEW(Interp, shared.n);
+                for (size_t i = 0; i < shared.n; ++i) {
+                    shared.interps[i].L = NULL;
+                }
+            }
+            break;
+        case 'E':
+            {
+                int r = parse_ninterps(optarg);
+                if (r < 0) {
+                    fprintf(stderr, "Invalid number of event states '%s'.\n", optarg);
+                    print_usage();
+                    goto cleanup;
+                }
+                sepstate.n = r;
+            }
+            break;
+        case 'M':
+            stats_dumper.path = optarg;
+            break;
+        case 'P':
+            profile_dir = optarg;
+            break;
+        case 'C':
+            cflag = true;
+            break;
+        case 't':
+            tflag = true;
+            break;
         case 'e':
             eflag = true;
             break;
@@ -1108,10 +3702,25 @@ int main(int argc, char **argv)
 
     // Prepare.
 
+    logger_start(tflag);
     prepare_signals();
 
+    if (profile_dir && mkdir(profile_dir, 0777) < 0 && errno != EEXIST) {
+        FATALF("cannot create profile directory '%s': %s",
+               profile_dir, ls_strerror_onstack(errno));
+        goto cleanup;
+    }
+
+    if (!cflag) {
+        char errbuf[512];
+        if (!bytecode_cache_init(bytecode_cache_warn, errbuf, sizeof(errbuf))) {
+            WARNF("bytecode cache disabled: %s", errbuf);
+        }
+    }
+
     // Initialize the widgets.
 
+    sepstates_init();
     widgets_init(argv + optind, argc - optind);
 
     TRACEF(
@@ -1122,8 +3731,12 @@ int main(int argc, char **argv)
         WARNF("no widgets specified (see luastatus(1) for usage info)");
     }
 
-    // Initialize the barlib.
+    // Initialize the barlib (which may start requesting pauses right away).
 
+    if (sem_init(&pausectl.wakeup, 0, 0) < 0) {
+        LS_PANIC("sem_init() failed");
+    }
+    pausectl.inited = true;
     LS_VECTOR_PUSH(barlib_args, NULL);
     if (!barlib_init_by_name(barlib_name, barlib_args.data)) {
         FATALF("cannot load barlib '%s'", barlib_name);
@@ -1131,35 +3744,85 @@ int main(int argc, char **argv)
     }
     barlib_inited = true;
 
+    // Spawn the render thread.
+    render_start();
+
+    // Spawn the stats thread, and the profiler thread, if requested; spawn the pacer thread.
+    stats_start();
+    if (profile_dir) {
+        prof_start();
+    }
+    pacer_start();
+
     // Freeze the map.
     map.frozen = true;
 
-    // Register barlib's function at the separate state, if we are going to use it.
-    if (sepstate.L) {
-        register_funcs(sepstate.L, NULL);
+    // Register barlib's function at the separate states we are going to use.
+    for (size_t i = 0; i < sepstate.n; ++i) {
+        if (sepstate.states[i].L) {
+            register_funcs(sepstate.states[i].L, NULL);
+        }
     }
 
-    // Spawn a thread for each successfully initialized widget, call /barlib/'s /set_error()/ method
-    // on each widget whose initialization has failed.
+    // Spawn a thread for each successfully initialized widget whose plugin implements the first
+    // revision of the interface; add a reactor source for each one whose plugin implements the
+    // second revision; publish an error for each widget whose initialization has failed.
+    //
+    // Widgets that have /widget.dedicated_thread/ set get a reactor (with a single thread) of
+    // their own; all the others share one.
 
     LS_VECTOR_RESERVE(threads, nwidgets);
     for (size_t i = 0; i < nwidgets; ++i) {
         Widget *w = &widgets[i];
         if (widget_is_stillborn(w)) {
-            LOCK_B();
-            set_error_unlocked(i);
-            UNLOCK_B();
+            publish(w, ERROR_SNAPSHOT);
         } else {
             register_funcs(w->L, w);
-            pthread_t t;
-            LS_PTH_CHECK(pthread_create(&t, NULL, widget_thread, w));
-            LS_VECTOR_PUSH(threads, t);
+            if (w->plugin.mod->iface_rev == 1) {
+                pthread_t t;
+                LS_PTH_CHECK(pthread_create(&t, NULL, widget_thread, w));
+                LS_VECTOR_PUSH(threads, t);
+            } else {
+                ReactorSourceFuncs funcs = {
+                    .on_fd = widget_on_fd,
+                    .on_timeout = widget_on_timeout,
+                    .on_pause = widget_on_pause,
+                };
+                if (w->dedicated_thread) {
+                    Reactor *r = xnew_reactor();
+                    LS_VECTOR_PUSH(reactors, r);
+                    w->source = reactor_add_source(r, funcs, w);
+                    reactor_run(r, 1);
+                } else {
+                    if (!shared_reactor) {
+                        shared_reactor = xnew_reactor();
+                        LS_VECTOR_PUSH(reactors, shared_reactor);
+                    }
+                    w->source = reactor_add_source(shared_reactor, funcs, w);
+                    ++nshared_reactor_widgets;
+                }
+            }
         }
     }
+    if (shared_reactor) {
+        size_t nthreads = shared_reactor_nthreads(nshared_reactor_widgets);
+        DEBUGF("running %zu widget(s) in the shared reactor with %zu thread(s)",
+               nshared_reactor_widgets, nthreads);
+        reactor_run(shared_reactor, nthreads);
+    }
+
+    // Spawn the pause thread.
 
-    // Run /barlib/'s event watcher, if present.
+    pause_start(reactors.data, reactors.size);
+
+    // Spawn the GC thread.
+
+    gc_start();
+
+    // Run /barlib/'s event watcher, if present, along with the event workers.
 
     if (barlib.iface.event_watcher) {
+        evq_start();
         if (barlib.iface.event_watcher(&barlib.data, (LuastatusBarlibEWFuncs_v1) {
                 .call_begin  = ew_call_begin,
                 .call_end    = ew_call_end,
@@ -1177,6 +3840,20 @@ int main(int argc, char **argv)
     for (size_t i = 0; i < threads.size; ++i) {
         LS_PTH_CHECK(pthread_join(threads.data[i], NULL));
     }
+    for (size_t i = 0; i < reactors.size; ++i) {
+        reactor_join(reactors.data[i]);
+    }
+
+    // Join the pause thread; let the pacer thread evaluate the deferred calls, and the event
+    // workers handle the queued events, and join them; join the GC thread; let the render thread
+    // pass the last updates to the barlib, and join it.
+
+    pause_maybe_stop();
+    pacer_maybe_stop();
+    evq_maybe_stop();
+    gc_maybe_stop();
+    prof_maybe_stop();
+    render_maybe_stop();
 
     // Either hang or exit.
 
@@ -1195,11 +3872,27 @@ cleanup:
     // Let us please valgrind.
     LS_VECTOR_FREE(barlib_args);
     LS_VECTOR_FREE(threads);
+    pause_maybe_stop();
+    for (size_t i = 0; i < reactors.size; ++i) {
+        reactor_destroy(reactors.data[i]);
+    }
+    LS_VECTOR_FREE(reactors);
+    pacer_maybe_stop();
+    evq_maybe_stop();
+    gc_maybe_stop();
+    prof_maybe_stop();
+    render_maybe_stop();
+    stats_maybe_stop();
     widgets_destroy();
     if (barlib_inited) {
         barlib_destroy();
     }
-    sepstate_maybe_destroy();
+    sepstates_destroy();
+    if (pausectl.inited) {
+        sem_destroy(&pausectl.wakeup);
+    }
     map_destroy();
+    bytecode_cache_destroy();
+    logger_stop();
     return ret;
 }
@@ -0,0 +1,283 @@
+/*
+ * Copyright (C) 2015-2020  luastatus developers
+ *
+ * This file is part of luastatus.
+ *
+ * luastatus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * luastatus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with luastatus.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "profiler.h"
+
+#include <lua.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "libls/alloc_utils.h"
+#include "libls/string_.h"
+#include "libls/vector.h"
+#include "libls/panic.h"
+
+// Frames deeper than this are not recorded; the stack is then prefixed with "[truncated]".
+#define MAX_DEPTH 64
+
+// Once this many distinct stacks have been recorded, any new one is accounted under "[other]",
+// so that the memory a profile takes is bounded.
+#define MAX_STACKS 16384
+
+#define OTHER_STACK "[other]"
+
+typedef struct {
+    // An allocated string with the stack in the folded format (without the weight), or /NULL/ if
+    // this slot is empty.
+    char *stack;
+    size_t nstack;
+    uint64_t hash;
+    uint64_t weight;
+} Entry;
+
+struct Profile {
+    // An allocated zero-terminated string with the path of the output file.
+    char *path;
+
+    // An open-addressing hash table of the recorded stacks; /nslots/ is a power of two.
+    Entry *slots;
+    size_t nslots;
+    size_t nused;
+
+    // A buffer the current stack is formatted into.
+    LSString key;
+
+    // Guards all of the above, except /path/.
+    pthread_mutex_t mtx;
+};
+
+// FNV-1a.
+static uint64_t hash_bytes(const char *buf, size_t nbuf)
+{
+    uint64_t h = UINT64_C(14695981039346656037);
+    for (size_t i = 0; i < nbuf; ++i) {
+        h ^= (unsigned char) buf[i];
+        h *= UINT64_C(1099511628211);
+    }
+    return h;
+}
+
+static Entry *find_slot(Entry *slots, size_t nslots, const char *stack, size_t nstack,
+                        uint64_t hash)
+{
+    size_t mask = nslots - 1;
+    for (size_t i = hash & mask;; i = (i + 1) & mask) {
+        Entry *e = &slots[i];
+        if (!e->stack) {
+            return e;
+        }
+        if (e->hash == hash && e->nstack == nstack && memcmp(e->stack, stack, nstack) == 0) {
+            return e;
+        }
+    }
+}
+
+static void grow(Profile *p)
+{
+    size_t nslots = p->nslots * 2;
+    Entry *slots = LS_XNEW0(Entry, nslots);
+    for (size_t i = 0; i < p->nslots; ++i) {
+        Entry *e = &p->slots[i];
+        if (e->stack) {
+            *find_slot(slots, nslots, e->stack, e->nstack, e->hash) = *e;
+        }
+    }
+    free(p->slots);
+    p->slots = slots;
+    p->nslots = nslots;
+}
+
+// Adds /weight/ to the weight of /stack/ (of size /nstack/). Must be called with /p->mtx/ locked.
+static void add(Profile *p, const char *stack, size_t nstack, uint64_t weight)
+{
+    uint64_t hash = hash_bytes(stack, nstack);
+    Entry *e = find_slot(p->slots, p->nslots, stack, nstack, hash);
+    if (!e->stack) {
+        if (p->nused == MAX_STACKS) {
+            add(p, OTHER_STACK, strlen(OTHER_STACK), weight);
+            return;
+        }
+        if ((p->nused + 1) * 2 > p->nslots) {
+            grow(p);
+            e = find_slot(p->slots, p->nslots, stack, nstack, hash);
+        }
+        e->stack = ls_xmemdup(stack, nstack);
+        e->nstack = nstack;
+        e->hash = hash;
+        e->weight = 0;
+        ++p->nused;
+    }
+    e->weight += weight;
+}
+
+Profile *profile_new(const char *dir, const char *filename, size_t idx)
+{
+    Profile *p = LS_XNEW(Profile, 1);
+
+    const char *slash = strrchr(filename, '/');
+    const char *basename = slash ? slash + 1 : filename;
+    LSString path = ls_string_newz_from_f("%s/%zu-%s.folded", dir, idx, basename);
+    p->path = path.data;
+
+    p->nslots = 64;
+    p->slots = LS_XNEW0(Entry, p->nslots);
+    p->nused = 0;
+    // Make sure there is always room for /OTHER_STACK/.
+    add(p, OTHER_STACK, strlen(OTHER_STACK), 0);
+
+    LS_VECTOR_INIT_RESERVE(p->key, 512);
+    LS_PTH_CHECK(pthread_mutex_init(&p->mtx, NULL));
+    return p;
+}
+
+// Appends /s/ to /buf/, replacing the characters that have a special meaning in the folded
+// format.
+static void append_sanitized(LSString *buf, const char *s)
+{
+    for (; *s; ++s) {
+        char c = *s;
+        ls_string_append_c(buf, (c == ';' || c == '\n') ? '_' : c);
+    }
+}
+
+static void append_frame(LSString *buf, const lua_Debug *ar)
+{
+    const char *name = ar->name ? ar->name : "?";
+    if (strcmp(ar->what, "C") == 0) {
+        append_sanitized(buf, name);
+        ls_string_append_s(buf, " [C]");
+    } else if (strcmp(ar->what, "main") == 0) {
+        ls_string_append_s(buf, "main chunk (");
+        append_sanitized(buf, ar->short_src);
+        ls_string_append_c(buf, ')');
+    } else {
+        append_sanitized(buf, name);
+        ls_string_append_s(buf, " (");
+        append_sanitized(buf, ar->short_src);
+        ls_string_append_f(buf, ":%d)", ar->linedefined);
+    }
+}
+
+void profile_sample(Profile *p, lua_State *L, uint64_t weight)
+{
+    lua_Debug ars[MAX_DEPTH];
+    int depth = 0;
+    while (depth < MAX_DEPTH && lua_getstack(L, depth, &ars[depth])) {
+        lua_getinfo(L, "Sn", &ars[depth]);
+        ++depth;
+    }
+    if (!depth) {
+        return;
+    }
+    lua_Debug extra;
+    bool truncated = depth == MAX_DEPTH && lua_getstack(L, depth, &extra);
+
+    LS_PTH_CHECK(pthread_mutex_lock(&p->mtx));
+
+    LS_VECTOR_CLEAR(p->key);
+    if (truncated) {
+        ls_string_append_s(&p->key, "[truncated];");
+    }
+    for (int i = depth - 1; i >= 0; --i) {
+        append_frame(&p->key, &ars[i]);
+        if (i) {
+            ls_string_append_c(&p->key, ';');
+        }
+    }
+    add(p, p->key.data, p->key.size, weight);
+
+    LS_PTH_CHECK(pthread_mutex_unlock(&p->mtx));
+}
+
+static bool write_all(int fd, const char *buf, size_t nbuf)
+{
+    while (nbuf) {
+        ssize_t w = write(fd, buf, nbuf);
+        if (w < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        buf += w;
+        nbuf -= w;
+    }
+    return true;
+}
+
+bool profile_write(Profile *p)
+{
+    LSString out = LS_VECTOR_NEW();
+
+    LS_PTH_CHECK(pthread_mutex_lock(&p->mtx));
+    for (size_t i = 0; i < p->nslots; ++i) {
+        Entry *e = &p->slots[i];
+        if (e->stack && e->weight) {
+            ls_string_append_b(&out, e->stack, e->nstack);
+            ls_string_append_f(&out, " %llu\n", (unsigned long long) e->weight);
+        }
+    }
+    LS_PTH_CHECK(pthread_mutex_unlock(&p->mtx));
+
+    bool ok = false;
+    LSString tmp = ls_string_newz_from_f("%s.tmp.XXXXXX", p->path);
+    int fd = mkstemp(tmp.data);
+    if (fd < 0) {
+        goto done;
+    }
+    ok = write_all(fd, out.data, out.size);
+    if (close(fd) < 0) {
+        ok = false;
+    }
+    if (ok && rename(tmp.data, p->path) < 0) {
+        ok = false;
+    }
+    if (!ok) {
+        int saved_errno = errno;
+        unlink(tmp.data);
+        errno = saved_errno;
+    }
+done:
+    LS_VECTOR_FREE(tmp);
+    LS_VECTOR_FREE(out);
+    return ok;
+}
+
+const char *profile_path(Profile *p)
+{
+    return p->path;
+}
+
+void profile_destroy(Profile *p)
+{
+    for (size_t i = 0; i < p->nslots; ++i) {
+        free(p->slots[i].stack);
+    }
+    free(p->slots);
+    free(p->path);
+    LS_VECTOR_FREE(p->key);
+    LS_PTH_CHECK(pthread_mutex_destroy(&p->mtx));
+    free(p);
+}
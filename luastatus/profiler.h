@@ -0,0 +1,59 @@
+/*
+ * Copyright (C) 2015-2020  luastatus developers
+ *
+ * This file is part of luastatus.
+ *
+ * luastatus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * luastatus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with luastatus.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef profiler_h_
+#define profiler_h_
+
+#include <lua.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+// A sampling profiler of Lua code.
+//
+// A /Profile/ accumulates sampled Lua call stacks of a single widget, each with a weight (the time,
+// in microseconds, the stack is taken to represent). It is written out in the "folded stacks"
+// format, one stack per line, frames from the outermost to the innermost separated by
+// semicolons, followed by a space and the weight; this is what /flamegraph.pl/ and similar tools
+// consume.
+//
+// Taking samples is up to the caller (luastatus does so from a /lua_sethook()/ hook).
+
+typedef struct Profile Profile;
+
+// Creates a new profile of the widget with file name /filename/ and index /idx/; it will be written
+// to "<dir>/<idx>-<basename of filename>.folded".
+Profile *profile_new(const char *dir, const char *filename, size_t idx);
+
+// Records the current call stack of /L/ with weight /weight/. May be called from a hook.
+// Thread-safe.
+void profile_sample(Profile *p, lua_State *L, uint64_t weight);
+
+// Writes out everything recorded so far into /p/'s file, atomically replacing its previous
+// contents. Thread-safe.
+//
+// On success, /true/ is returned. On failure, /false/ is returned and /errno/ is set.
+bool profile_write(Profile *p);
+
+// Returns the path of /p/'s file.
+const char *profile_path(Profile *p);
+
+void profile_destroy(Profile *p);
+
+#endif
@@ -0,0 +1,460 @@
+/*
+ * Copyright (C) 2015-2020  luastatus developers
+ *
+ * This file is part of luastatus.
+ *
+ * luastatus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * luastatus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with luastatus.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "reactor.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+
+#include "libls/alloc_utils.h"
+#include "libls/vector.h"
+#include "libls/panic.h"
+#include "libls/osdep.h"
+#include "libls/time_utils.h"
+
+// A file descriptor registered in the reactor's epoll instance. The address of a /Watch/ is used as
+// the epoll event's data, so it must stay constant as long as the reactor lives.
+//
+// A /Watch/ is never freed when its file descriptor gets unwatched (a reactor thread may have
+// already fetched an event for it, and be waiting for the source's mutex); instead, it is marked
+// as not alive and is reused if the same file descriptor gets watched again.
+typedef struct {
+    // The source this watch belongs to, or /NULL/ for the reactor's quit pipe.
+    ReactorSource *source;
+
+    int fd;
+
+    // A mask of /POLL*/ flags.
+    int events;
+
+    bool alive;
+} Watch;
+
+struct ReactorSource {
+    Reactor *r;
+
+    ReactorSourceFuncs funcs;
+    void *userdata;
+
+    // A mutex held while any of the callbacks is running.
+    pthread_mutex_t mtx;
+
+    // Guarded by /mtx/.
+    bool stopped;
+
+    // Whether the timeout has expired while the reactor was paused. Guarded by /mtx/.
+    bool missed_timeout;
+
+    // /timer.fd/ is a timerfd.
+    Watch timer;
+
+    LS_VECTOR_OF(Watch *) watches;
+};
+
+struct Reactor {
+    int epfd;
+
+    // Once all the sources have been stopped, a byte is written into /quit_fds[1]/; the read end is
+    // registered (level-triggered) in /epfd/, so that every thread gets woken up and terminates.
+    int quit_fds[2];
+    Watch quit_watch;
+
+    LS_VECTOR_OF(ReactorSource *) sources;
+
+    // A mutex guarding /nactive/.
+    pthread_mutex_t mtx;
+
+    // Number of sources that have not been stopped yet.
+    size_t nactive;
+
+    // Whether the reactor is paused. Only accessed atomically.
+    bool paused;
+
+    LS_VECTOR_OF(pthread_t) threads;
+};
+
+static uint32_t to_epoll_events(int events)
+{
+    uint32_t r = 0;
+    if (events & POLLIN)
+        r |= EPOLLIN;
+    if (events & POLLOUT)
+        r |= EPOLLOUT;
+    if (events & POLLPRI)
+        r |= EPOLLPRI;
+    return r;
+}
+
+static int from_epoll_events(uint32_t events)
+{
+    int r = 0;
+    if (events & EPOLLIN)
+        r |= POLLIN;
+    if (events & EPOLLOUT)
+        r |= POLLOUT;
+    if (events & EPOLLPRI)
+        r |= POLLPRI;
+    if (events & EPOLLERR)
+        r |= POLLERR;
+    if (events & EPOLLHUP)
+        r |= POLLHUP;
+    return r;
+}
+
+// Registers (if /op/ is /EPOLL_CTL_ADD/) or rearms (if /op/ is /EPOLL_CTL_MOD/) /w/ in /r->epfd/.
+// Every watch except for the quit pipe is one-shot: it gets rearmed after the callback returns, so
+// that no two threads fetch an event for the same watch at once.
+static int arm(Reactor *r, Watch *w, int op)
+{
+    struct epoll_event ev = {
+        .events = to_epoll_events(w->events) | EPOLLONESHOT,
+        .data = {.ptr = w},
+    };
+    return epoll_ctl(r->epfd, op, w->fd, &ev);
+}
+
+static void disarm(Reactor *r, Watch *w)
+{
+    // /event/ is ignored, but pre-2.6.9 kernels require it to be non-null.
+    struct epoll_event unused;
+    (void) epoll_ctl(r->epfd, EPOLL_CTL_DEL, w->fd, &unused);
+}
+
+static void signal_quit(Reactor *r)
+{
+    ssize_t unused = write(r->quit_fds[1], "", 1);
+    (void) unused;
+}
+
+Reactor *reactor_new(void)
+{
+    Reactor *r = LS_XNEW(Reactor, 1);
+    *r = (Reactor) {
+        .epfd = -1,
+        .quit_fds = {-1, -1},
+        .sources = LS_VECTOR_NEW(),
+        .nactive = 0,
+        .paused = false,
+        .threads = LS_VECTOR_NEW(),
+    };
+    int saved_errno;
+
+    if ((r->epfd = epoll_create1(EPOLL_CLOEXEC)) < 0) {
+        goto error;
+    }
+    if (ls_cloexec_pipe(r->quit_fds) < 0) {
+        goto error;
+    }
+    r->quit_watch = (Watch) {.source = NULL, .fd = r->quit_fds[0], .events = POLLIN, .alive = true};
+    struct epoll_event ev = {.events = EPOLLIN, .data = {.ptr = &r->quit_watch}};
+    if (epoll_ctl(r->epfd, EPOLL_CTL_ADD, r->quit_fds[0], &ev) < 0) {
+        goto error;
+    }
+    LS_PTH_CHECK(pthread_mutex_init(&r->mtx, NULL));
+    return r;
+
+error:
+    saved_errno = errno;
+    close(r->epfd);
+    close(r->quit_fds[0]);
+    close(r->quit_fds[1]);
+    free(r);
+    errno = saved_errno;
+    return NULL;
+}
+
+ReactorSource *reactor_add_source(Reactor *r, ReactorSourceFuncs funcs, void *userdata)
+{
+    ReactorSource *s = LS_XNEW(ReactorSource, 1);
+    *s = (ReactorSource) {
+        .r = r,
+        .funcs = funcs,
+        .userdata = userdata,
+        .stopped = false,
+        .missed_timeout = false,
+        .watches = LS_VECTOR_NEW(),
+    };
+    int fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+    if (fd < 0) {
+        LS_PANIC("timerfd_create() failed");
+    }
+    s->timer = (Watch) {.source = s, .fd = fd, .events = POLLIN, .alive = true};
+    if (arm(r, &s->timer, EPOLL_CTL_ADD) < 0) {
+        LS_PANIC("epoll_ctl() failed");
+    }
+    LS_PTH_CHECK(pthread_mutex_init(&s->mtx, NULL));
+    reactor_source_set_timeout(s, 0);
+
+    LS_VECTOR_PUSH(r->sources, s);
+    ++r->nactive;
+    return s;
+}
+
+static Watch *find_watch(ReactorSource *s, int fd)
+{
+    for (size_t i = 0; i < s->watches.size; ++i) {
+        Watch *w = s->watches.data[i];
+        if (w->fd == fd) {
+            return w;
+        }
+    }
+    return NULL;
+}
+
+int reactor_source_watch_fd(ReactorSource *s, int fd, int events)
+{
+    Watch *w = find_watch(s, fd);
+    if (w) {
+        int op = w->alive ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+        int old_events = w->events;
+        w->events = events;
+        if (arm(s->r, w, op) < 0) {
+            w->events = old_events;
+            return -1;
+        }
+        w->alive = true;
+        return 0;
+    }
+
+    w = LS_XNEW(Watch, 1);
+    *w = (Watch) {.source = s, .fd = fd, .events = events, .alive = true};
+    if (arm(s->r, w, EPOLL_CTL_ADD) < 0) {
+        // It never got into /epfd/, so it is safe to free it.
+        int saved_errno = errno;
+        free(w);
+        errno = saved_errno;
+        return -1;
+    }
+    LS_VECTOR_PUSH(s->watches, w);
+    return 0;
+}
+
+int reactor_source_unwatch_fd(ReactorSource *s, int fd)
+{
+    Watch *w = find_watch(s, fd);
+    if (!w || !w->alive) {
+        errno = ENOENT;
+        return -1;
+    }
+    disarm(s->r, w);
+    w->alive = false;
+    return 0;
+}
+
+void reactor_source_set_timeout(ReactorSource *s, double tmo)
+{
+    struct itimerspec its = {.it_interval = {0, 0}};
+    if (tmo >= 0) {
+        its.it_value = ls_tmo_to_ts(tmo);
+        // An all-zero /it_value/ would disarm the timer.
+        if (its.it_value.tv_sec == 0 && its.it_value.tv_nsec == 0) {
+            its.it_value.tv_nsec = 1;
+        }
+    } else {
+        its.it_value = (struct timespec) {0, 0};
+    }
+    if (timerfd_settime(s->timer.fd, 0, &its, NULL) < 0) {
+        LS_PANIC("timerfd_settime() failed");
+    }
+}
+
+// Should be called with /s->mtx/ locked.
+static void source_stop(ReactorSource *s)
+{
+    Reactor *r = s->r;
+
+    s->stopped = true;
+    disarm(r, &s->timer);
+    for (size_t i = 0; i < s->watches.size; ++i) {
+        Watch *w = s->watches.data[i];
+        if (w->alive) {
+            disarm(r, w);
+            w->alive = false;
+        }
+    }
+
+    LS_PTH_CHECK(pthread_mutex_lock(&r->mtx));
+    if (--r->nactive == 0) {
+        signal_quit(r);
+    }
+    LS_PTH_CHECK(pthread_mutex_unlock(&r->mtx));
+}
+
+static void dispatch(Reactor *r, Watch *w, uint32_t events)
+{
+    ReactorSource *s = w->source;
+
+    LS_PTH_CHECK(pthread_mutex_lock(&s->mtx));
+
+    if (s->stopped || !w->alive) {
+        goto done;
+    }
+
+    bool ok;
+    if (w == &s->timer) {
+        uint64_t nexpirations;
+        if (read(w->fd, &nexpirations, sizeof(nexpirations)) == sizeof(nexpirations)) {
+            if (__atomic_load_n(&r->paused, __ATOMIC_SEQ_CST)) {
+                // The timer is one-shot, so it will not wake us up again until re-set.
+                s->missed_timeout = true;
+                ok = true;
+            } else {
+                ok = s->funcs.on_timeout(s->userdata);
+            }
+        } else {
+            // The timer has been re-set after the event was fetched.
+            ok = true;
+        }
+    } else {
+        ok = s->funcs.on_fd(s->userdata, w->fd, from_epoll_events(events));
+    }
+
+    if (!ok) {
+        source_stop(s);
+    } else if (w->alive) {
+        if (arm(r, w, EPOLL_CTL_MOD) < 0) {
+            // The file descriptor has been closed without being unwatched first.
+            w->alive = false;
+        }
+    }
+
+done:
+    LS_PTH_CHECK(pthread_mutex_unlock(&s->mtx));
+}
+
+void reactor_set_paused(Reactor *r, bool paused)
+{
+    if (__atomic_load_n(&r->paused, __ATOMIC_SEQ_CST) == paused) {
+        return;
+    }
+    __atomic_store_n(&r->paused, paused, __ATOMIC_SEQ_CST);
+
+    for (size_t i = 0; i < r->sources.size; ++i) {
+        ReactorSource *s = r->sources.data[i];
+        LS_PTH_CHECK(pthread_mutex_lock(&s->mtx));
+        if (s->stopped) {
+            goto next;
+        }
+        if (s->funcs.on_pause && !s->funcs.on_pause(s->userdata, paused)) {
+            source_stop(s);
+            goto next;
+        }
+        if (!paused && s->missed_timeout) {
+            s->missed_timeout = false;
+            reactor_source_set_timeout(s, 0);
+        }
+next:
+        LS_PTH_CHECK(pthread_mutex_unlock(&s->mtx));
+    }
+}
+
+// Like /epoll_wait(r->epfd, ev, 1, -1)/, but with all the signals blocked, just as /ls_poll()/ does.
+static int wait_one(Reactor *r, struct epoll_event *ev)
+{
+    sigset_t allsigs;
+    sigfillset(&allsigs);
+
+    sigset_t origmask;
+    pthread_sigmask(SIG_SETMASK, &allsigs, &origmask);
+    int n = epoll_wait(r->epfd, ev, 1, -1);
+    int saved_errno = errno;
+    pthread_sigmask(SIG_SETMASK, &origmask, NULL);
+
+    errno = saved_errno;
+    return n;
+}
+
+static void *reactor_thread(void *arg)
+{
+    Reactor *r = arg;
+    while (1) {
+        struct epoll_event ev;
+        int n = wait_one(r, &ev);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            LS_PANIC("epoll_wait() failed");
+        }
+        if (n == 0) {
+            continue;
+        }
+        Watch *w = ev.data.ptr;
+        if (!w->source) {
+            // The quit pipe.
+            break;
+        }
+        dispatch(r, w, ev.events);
+    }
+    return NULL;
+}
+
+void reactor_run(Reactor *r, size_t nthreads)
+{
+    LS_PTH_CHECK(pthread_mutex_lock(&r->mtx));
+    if (r->nactive == 0) {
+        signal_quit(r);
+    }
+    LS_PTH_CHECK(pthread_mutex_unlock(&r->mtx));
+
+    LS_VECTOR_RESERVE(r->threads, nthreads);
+    for (size_t i = 0; i < nthreads; ++i) {
+        pthread_t t;
+        LS_PTH_CHECK(pthread_create(&t, NULL, reactor_thread, r));
+        LS_VECTOR_PUSH(r->threads, t);
+    }
+}
+
+void reactor_join(Reactor *r)
+{
+    for (size_t i = 0; i < r->threads.size; ++i) {
+        LS_PTH_CHECK(pthread_join(r->threads.data[i], NULL));
+    }
+    LS_VECTOR_CLEAR(r->threads);
+}
+
+void reactor_destroy(Reactor *r)
+{
+    for (size_t i = 0; i < r->sources.size; ++i) {
+        ReactorSource *s = r->sources.data[i];
+        close(s->timer.fd);
+        for (size_t j = 0; j < s->watches.size; ++j) {
+            free(s->watches.data[j]);
+        }
+        LS_VECTOR_FREE(s->watches);
+        LS_PTH_CHECK(pthread_mutex_destroy(&s->mtx));
+        free(s);
+    }
+    LS_VECTOR_FREE(r->sources);
+    LS_VECTOR_FREE(r->threads);
+    LS_PTH_CHECK(pthread_mutex_destroy(&r->mtx));
+    close(r->epfd);
+    close(r->quit_fds[0]);
+    close(r->quit_fds[1]);
+    free(r);
+}
@@ -0,0 +1,118 @@
+/*
+ * Copyright (C) 2015-2020  luastatus developers
+ *
+ * This file is part of luastatus.
+ *
+ * luastatus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * luastatus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with luastatus.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef reactor_h_
+#define reactor_h_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// An epoll-based event loop run by a fixed pool of threads.
+//
+// A reactor consists of *sources*. Each source has a set of watched file descriptors and a single
+// timer; whenever one of them becomes ready, one of the reactor's threads invokes the
+// corresponding callback of the source.
+//
+// Callbacks of the same source never run concurrently (each source has a mutex that is held while
+// any of its callbacks is running); callbacks of different sources may.
+//
+// A source is *stopped* once any of its callbacks returns /false/; it then gets no more callbacks.
+// Once all the sources have been stopped, the reactor's threads terminate.
+//
+// A reactor may be *paused* (see /reactor_set_paused()/): while it is, timeouts of the sources
+// expire silently; once it is resumed, each source whose timeout has expired in the meantime gets a
+// single /on_timeout/ callback. File descriptors are watched as usual.
+
+typedef struct Reactor Reactor;
+
+typedef struct ReactorSource ReactorSource;
+
+typedef struct {
+    // Called when file descriptor /fd/, previously watched with /reactor_source_watch_fd()/, becomes
+    // ready. /revents/ is a mask of /POLL*/ flags.
+    //
+    // May be called spuriously (after /fd/ has been unwatched, or when it is not actually ready).
+    //
+    // Should return /true/ to keep the source running, or /false/ to stop it.
+    bool (*on_fd)(void *userdata, int fd, int revents);
+
+    // Called when the source's timeout, as set with /reactor_source_set_timeout()/, expires.
+    //
+    // Should return /true/ to keep the source running, or /false/ to stop it.
+    bool (*on_timeout)(void *userdata);
+
+    // Called when the reactor gets paused (/paused/ is /true/) or resumed (/paused/ is /false/),
+    // from the thread that has called /reactor_set_paused()/. On resumption, this is called before
+    // the catch-up /on_timeout/ callback, if any.
+    //
+    // Should return /true/ to keep the source running, or /false/ to stop it.
+    //
+    // May be /NULL/.
+    bool (*on_pause)(void *userdata, bool paused);
+} ReactorSourceFuncs;
+
+// Creates a new reactor. On failure, /NULL/ is returned and /errno/ is set.
+Reactor *reactor_new(void);
+
+// Creates a new source with callbacks /funcs/ that receive /userdata/.
+//
+// The source's timeout is initially set to zero, so the first callback a source receives is always
+// /funcs.on_timeout/.
+//
+// May only be called before /reactor_run()/. Panics on failure.
+ReactorSource *reactor_add_source(Reactor *r, ReactorSourceFuncs funcs, void *userdata);
+
+// Starts watching file descriptor /fd/ for events /events/ (a mask of /POLLIN/, /POLLOUT/ and
+// /POLLPRI/). If /fd/ is already being watched, its event mask is replaced.
+//
+// May only be called from within a callback of /s/.
+//
+// On success, /0/ is returned. On failure, /-1/ is returned and /errno/ is set.
+int reactor_source_watch_fd(ReactorSource *s, int fd, int events);
+
+// Stops watching file descriptor /fd/. This must be done before /fd/ is closed.
+//
+// May only be called from within a callback of /s/.
+//
+// On success, /0/ is returned. If /fd/ is not being watched, /-1/ is returned and /errno/ is set to
+// /ENOENT/.
+int reactor_source_unwatch_fd(ReactorSource *s, int fd);
+
+// Arms the timer of /s/ so that it expires in /tmo/ seconds, replacing the previous timeout, if any.
+// If /tmo/ is negative, disarms it.
+//
+// May only be called from within a callback of /s/.
+void reactor_source_set_timeout(ReactorSource *s, double tmo);
+
+// Pauses (if /paused/ is /true/) or resumes (if /paused/ is /false/) /r/; does nothing if it is
+// already in that state. May be called from any thread, but not concurrently with itself for the
+// same reactor, and only after /reactor_run()/.
+void reactor_set_paused(Reactor *r, bool paused);
+
+// Spawns /nthreads/ threads that run /r/. /nthreads/ must be positive.
+void reactor_run(Reactor *r, size_t nthreads);
+
+// Waits until the threads spawned by /reactor_run()/ have terminated, that is, until all the
+// sources of /r/ have been stopped.
+void reactor_join(Reactor *r);
+
+// Destroys /r/ and all its sources. Must not be called while /r/ is running.
+void reactor_destroy(Reactor *r);
+
+#endif
@@ -0,0 +1,370 @@
+/*
+ * Copyright (C) 2015-2020  luastatus developers
+ *
+ * This file is part of luastatus.
+ *
+ * luastatus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * luastatus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with luastatus.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "snapshot.h"
+
+#include <lua.h>
+#include <lauxlib.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "libls/alloc_utils.h"
+#include "libls/string_.h"
+#include "libls/panic.h"
+
+// The format is a sequence of *items*, each beginning with a tag byte:
+//   /TAG_NIL/, /TAG_FALSE/, /TAG_TRUE/: nothing follows;
+//   /TAG_NUMBER/: followed by a /lua_Number/;
+//   /TAG_INTEGER/: followed by a /lua_Integer/ (only on Lua 5.3+);
+//   /TAG_STRING/: followed by a /size_t/ length and then the bytes of the string;
+//   /TAG_TABLE/: followed by the length of the table's sequence part (a /size_t/, used to
+//     pre-allocate the array part of the re-created table, so that it is traversed in the same
+//     order), the number of key-value pairs (a /size_t/), and then by that many pairs of items.
+// Values of multi-byte fields are stored unaligned, in host byte order.
+enum {
+    TAG_NIL,
+    TAG_FALSE,
+    TAG_TRUE,
+    TAG_NUMBER,
+    TAG_INTEGER,
+    TAG_STRING,
+    TAG_TABLE,
+};
+
+typedef struct {
+    LSString *buf;
+    lua_State *L;
+    char *errbuf;
+    size_t nerrbuf;
+} Writer;
+
+static inline void put_raw(Writer *w, const void *p, size_t n)
+{
+    ls_string_append_b(w->buf, p, n);
+}
+
+static inline void put_tag(Writer *w, char tag)
+{
+    ls_string_append_c(w->buf, tag);
+}
+
+static bool put_value(Writer *w, int depth)
+{
+    lua_State *L = w->L;
+
+    switch (lua_type(L, -1)) {
+    case LUA_TNIL:
+        put_tag(w, TAG_NIL);
+        return true;
+
+    case LUA_TBOOLEAN:
+        put_tag(w, lua_toboolean(L, -1) ? TAG_TRUE : TAG_FALSE);
+        return true;
+
+    case LUA_TNUMBER:
+#if LUA_VERSION_NUM >= 503
+        if (lua_isinteger(L, -1)) {
+            lua_Integer i = lua_tointeger(L, -1);
+            put_tag(w, TAG_INTEGER);
+            put_raw(w, &i, sizeof(i));
+            return true;
+        }
+#endif
+        {
+            lua_Number d = lua_tonumber(L, -1);
+            put_tag(w, TAG_NUMBER);
+            put_raw(w, &d, sizeof(d));
+        }
+        return true;
+
+    case LUA_TSTRING:
+        {
+            size_t ns;
+            const char *s = lua_tolstring(L, -1, &ns);
+            put_tag(w, TAG_STRING);
+            put_raw(w, &ns, sizeof(ns));
+            put_raw(w, s, ns);
+        }
+        return true;
+
+    case LUA_TTABLE:
+        {
+            if (depth == SNAPSHOT_MAX_DEPTH) {
+                snprintf(w->errbuf, w->nerrbuf, "tables nested too deep (more than %d levels)",
+                         SNAPSHOT_MAX_DEPTH);
+                return false;
+            }
+            if (!lua_checkstack(L, 3)) {
+                snprintf(w->errbuf, w->nerrbuf, "out of Lua stack space");
+                return false;
+            }
+            put_tag(w, TAG_TABLE);
+#if LUA_VERSION_NUM >= 502
+            size_t narr = lua_rawlen(L, -1);
+#else
+            size_t narr = lua_objlen(L, -1);
+#endif
+            put_raw(w, &narr, sizeof(narr));
+            // Reserve space for the number of pairs; fill it in later.
+            size_t npairs_pos = w->buf->size;
+            size_t npairs = 0;
+            put_raw(w, &npairs, sizeof(npairs));
+
+            // L: ? table
+            lua_pushnil(L); // L: ? table nil
+            while (lua_next(L, -2)) {
+                // L: ? table key value
+                lua_pushvalue(L, -2); // L: ? table key value key
+                if (!put_value(w, depth + 1)) {
+                    lua_pop(L, 3); // L: ? table
+                    return false;
+                }
+                lua_pop(L, 1); // L: ? table key value
+                if (!put_value(w, depth + 1)) {
+                    lua_pop(L, 2); // L: ? table
+                    return false;
+                }
+                lua_pop(L, 1); // L: ? table key
+                ++npairs;
+            }
+            // L: ? table
+            memcpy(w->buf->data + npairs_pos, &npairs, sizeof(npairs));
+        }
+        return true;
+
+    default:
+        snprintf(w->errbuf, w->nerrbuf, "values of type '%s' are not supported",
+                 luaL_typename(L, -1));
+        return false;
+    }
+}
+
+bool snapshot_serialize(LSString *buf, lua_State *L, char *errbuf, size_t nerrbuf)
+{
+    LS_VECTOR_CLEAR(*buf);
+    Writer w = {.buf = buf, .L = L, .errbuf = errbuf, .nerrbuf = nerrbuf};
+    return put_value(&w, 0);
+}
+
+Snapshot *snapshot_new(const LSString *buf)
+{
+    Snapshot *s = ls_xmalloc(sizeof(Snapshot) + buf->size, 1);
+    s->size = buf->size;
+    // see DOCS/c_notes/empty-ranges-and-c-stdlib.md
+    if (buf->size) {
+        memcpy(s->data, buf->data, buf->size);
+    }
+    return s;
+}
+
+typedef struct {
+    const char *cur;
+    const char *end;
+    lua_State *L;
+} Reader;
+
+static inline void get_raw(Reader *r, void *p, size_t n)
+{
+    if ((size_t) (r->end - r->cur) < n) {
+        LS_PANIC("snapshot: unexpected end of data");
+    }
+    memcpy(p, r->cur, n);
+    r->cur += n;
+}
+
+static void push_value(Reader *r)
+{
+    lua_State *L = r->L;
+
+    char tag;
+    get_raw(r, &tag, 1);
+
+    switch (tag) {
+    case TAG_NIL:
+        lua_pushnil(L);
+        break;
+
+    case TAG_FALSE:
+    case TAG_TRUE:
+        lua_pushboolean(L, tag == TAG_TRUE);
+        break;
+
+    case TAG_NUMBER:
+        {
+            lua_Number d;
+            get_raw(r, &d, sizeof(d));
+            lua_pushnumber(L, d);
+        }
+        break;
+
+#if LUA_VERSION_NUM >= 503
+    case TAG_INTEGER:
+        {
+            lua_Integer i;
+            get_raw(r, &i, sizeof(i));
+            lua_pushinteger(L, i);
+        }
+        break;
+#endif
+
+    case TAG_STRING:
+        {
+            size_t ns;
+            get_raw(r, &ns, sizeof(ns));
+            if ((size_t) (r->end - r->cur) < ns) {
+                LS_PANIC("snapshot: unexpected end of data");
+            }
+            lua_pushlstring(L, r->cur, ns);
+            r->cur += ns;
+        }
+        break;
+
+    case TAG_TABLE:
+        {
+            size_t narr;
+            size_t npairs;
+            get_raw(r, &narr, sizeof(narr));
+            get_raw(r, &npairs, sizeof(npairs));
+            if (narr > npairs) {
+                narr = npairs;
+            }
+            if (!lua_checkstack(L, 3)) {
+                LS_PANIC("snapshot: out of Lua stack space");
+            }
+            lua_createtable(L, (int) narr, (int) (npairs - narr)); // L: ? table
+            for (size_t i = 0; i < npairs; ++i) {
+                push_value(r); // L: ? table key
+                push_value(r); // L: ? table key value
+                lua_rawset(L, -3); // L: ? table
+            }
+        }
+        break;
+
+    default:
+        LS_PANIC("snapshot: invalid tag");
+    }
+}
+
+void snapshot_push(const Snapshot *s, lua_State *L)
+{
+    Reader r = {.cur = s->data, .end = s->data + s->size, .L = L};
+    push_value(&r);
+    if (r.cur != r.end) {
+        LS_PANIC("snapshot: trailing data");
+    }
+}
+
+// The finalizer of SplitMix64.
+static inline uint64_t mix(uint64_t x)
+{
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+// FNV-1a.
+static uint64_t hash_bytes(uint64_t h, const char *p, size_t n)
+{
+    for (size_t i = 0; i < n; ++i) {
+        h ^= (unsigned char) p[i];
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+static uint64_t hash_value(Reader *r)
+{
+    char tag;
+    get_raw(r, &tag, 1);
+    uint64_t h = mix(0xcbf29ce484222325ULL + (unsigned char) tag);
+
+    switch (tag) {
+    case TAG_NIL:
+    case TAG_FALSE:
+    case TAG_TRUE:
+        return h;
+
+    case TAG_NUMBER:
+        {
+            char bytes[sizeof(lua_Number)];
+            get_raw(r, bytes, sizeof(bytes));
+            return mix(hash_bytes(h, bytes, sizeof(bytes)));
+        }
+
+#if LUA_VERSION_NUM >= 503
+    case TAG_INTEGER:
+        {
+            char bytes[sizeof(lua_Integer)];
+            get_raw(r, bytes, sizeof(bytes));
+            return mix(hash_bytes(h, bytes, sizeof(bytes)));
+        }
+#endif
+
+    case TAG_STRING:
+        {
+            size_t ns;
+            get_raw(r, &ns, sizeof(ns));
+            if ((size_t) (r->end - r->cur) < ns) {
+                LS_PANIC("snapshot: unexpected end of data");
+            }
+            h = hash_bytes(h, r->cur, ns);
+            r->cur += ns;
+            return mix(h ^ ns);
+        }
+
+    case TAG_TABLE:
+        {
+            size_t narr;
+            size_t npairs;
+            get_raw(r, &narr, sizeof(narr));
+            get_raw(r, &npairs, sizeof(npairs));
+            // Combine the hashes of the pairs with a commutative operation, so that the result
+            // does not depend on the order the table has been traversed in.
+            uint64_t acc = 0;
+            for (size_t i = 0; i < npairs; ++i) {
+                uint64_t hk = hash_value(r);
+                uint64_t hv = hash_value(r);
+                acc += mix(hk ^ mix(hv + 0x9e3779b97f4a7c15ULL));
+            }
+            return mix(h ^ acc ^ mix(npairs));
+        }
+
+    default:
+        LS_PANIC("snapshot: invalid tag");
+    }
+}
+
+uint64_t snapshot_hash(const Snapshot *s)
+{
+    Reader r = {.cur = s->data, .end = s->data + s->size, .L = NULL};
+    uint64_t h = hash_value(&r);
+    if (r.cur != r.end) {
+        LS_PANIC("snapshot: trailing data");
+    }
+    return h;
+}
+
+void snapshot_destroy(Snapshot *s)
+{
+    free(s);
+}
@@ -0,0 +1,64 @@
+/*
+ * Copyright (C) 2015-2020  luastatus developers
+ *
+ * This file is part of luastatus.
+ *
+ * luastatus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * luastatus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with luastatus.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef snapshot_h_
+#define snapshot_h_
+
+#include <lua.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "libls/string_.h"
+
+// A snapshot is a self-contained serialized copy of a Lua value that can be passed to another
+// thread and re-created in a different Lua state.
+//
+// Only nil, booleans, numbers, strings and tables (whose keys and values are, recursively, any of
+// these) are supported; tables may be nested no deeper than /SNAPSHOT_MAX_DEPTH/ levels.
+// Metatables are not preserved.
+
+#define SNAPSHOT_MAX_DEPTH 32
+
+typedef struct {
+    size_t size;
+    char data[];
+} Snapshot;
+
+// Serializes the value on top of /L/'s stack into /buf/ (which gets cleared first). The stack of
+// /L/ is left unchanged.
+//
+// On success, /true/ is returned. On failure (if the value, or any value nested in it, is not
+// supported), /false/ is returned and an error message is written into /errbuf/ of size
+// /nerrbuf/.
+bool snapshot_serialize(LSString *buf, lua_State *L, char *errbuf, size_t nerrbuf);
+
+// Creates a new snapshot with a copy of the contents of /buf/, as filled by
+// /snapshot_serialize()/.
+Snapshot *snapshot_new(const LSString *buf);
+
+// Re-creates the value saved in /s/ and pushes it onto /L/'s stack.
+void snapshot_push(const Snapshot *s, lua_State *L);
+
+// Returns a structural hash of the value saved in /s/: snapshots of values that are equal (tables
+// being compared by contents, recursively, regardless of the order of traversal) have equal hashes.
+uint64_t snapshot_hash(const Snapshot *s);
+
+void snapshot_destroy(Snapshot *s);
+
+#endif
@@ -0,0 +1,218 @@
+/*
+ * Copyright (C) 2015-2020  luastatus developers
+ *
+ * This file is part of luastatus.
+ *
+ * luastatus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * luastatus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with luastatus.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "stats.h"
+
+#include <lua.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "libls/string_.h"
+
+static inline size_t bucket_index(uint64_t v)
+{
+    if (v < STATS_NSUB) {
+        return v;
+    }
+    if (v >> STATS_MAX_EXP) {
+        v = (UINT64_C(1) << STATS_MAX_EXP) - 1;
+    }
+    int msb = 63 - __builtin_clzll(v);
+    int shift = msb - STATS_SUB_BITS;
+    // The leading bit is implied by the exponent; take the next /STATS_SUB_BITS/ bits.
+    size_t sub = (v >> shift) & (STATS_NSUB - 1);
+    return (size_t) (shift + 1) * STATS_NSUB + sub;
+}
+
+// Returns the middle of the range of values that fall into bucket /i/.
+static inline uint64_t bucket_value(size_t i)
+{
+    if (i < STATS_NSUB) {
+        return i;
+    }
+    int shift = (int) (i / STATS_NSUB) - 1;
+    uint64_t lo = ((uint64_t) STATS_NSUB + i % STATS_NSUB) << shift;
+    return lo + ((UINT64_C(1) << shift) >> 1);
+}
+
+void stats_hist_record(StatsHist *h, uint64_t value)
+{
+    __atomic_add_fetch(&h->count, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&h->sum, value, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&h->buckets[bucket_index(value)], 1, __ATOMIC_RELAXED);
+
+    uint64_t max = __atomic_load_n(&h->max, __ATOMIC_RELAXED);
+    while (value > max) {
+        if (__atomic_compare_exchange_n(&h->max, &max, value, true,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        {
+            break;
+        }
+    }
+}
+
+uint64_t stats_hist_percentile(const StatsHist *h, double p)
+{
+    uint64_t count = __atomic_load_n(&h->count, __ATOMIC_RELAXED);
+    if (!count) {
+        return 0;
+    }
+    uint64_t rank = (uint64_t) (p / 100 * count + 0.5);
+    if (rank < 1) {
+        rank = 1;
+    }
+    uint64_t seen = 0;
+    for (size_t i = 0; i < STATS_NBUCKETS; ++i) {
+        seen += __atomic_load_n(&h->buckets[i], __ATOMIC_RELAXED);
+        if (seen >= rank) {
+            uint64_t v = bucket_value(i);
+            uint64_t max = __atomic_load_n(&h->max, __ATOMIC_RELAXED);
+            return v < max ? v : max;
+        }
+    }
+    return __atomic_load_n(&h->max, __ATOMIC_RELAXED);
+}
+
+typedef struct {
+    uint64_t count;
+    double mean;
+    uint64_t p50;
+    uint64_t p90;
+    uint64_t p99;
+    uint64_t max;
+} Summary;
+
+static Summary summarize(const StatsHist *h)
+{
+    uint64_t count = __atomic_load_n(&h->count, __ATOMIC_RELAXED);
+    uint64_t sum = __atomic_load_n(&h->sum, __ATOMIC_RELAXED);
+    return (Summary) {
+        .count = count,
+        .mean = count ? (double) sum / count : 0,
+        .p50 = stats_hist_percentile(h, 50),
+        .p90 = stats_hist_percentile(h, 90),
+        .p99 = stats_hist_percentile(h, 99),
+        .max = __atomic_load_n(&h->max, __ATOMIC_RELAXED),
+    };
+}
+
+static const struct {
+    const char *name;
+    size_t offset;
+} hists[] = {
+    {"cb",        offsetof(WidgetStats, cb)},
+    {"lock_wait", offsetof(WidgetStats, lock_wait)},
+    {"event",     offsetof(WidgetStats, event)},
+    {"set",       offsetof(WidgetStats, set)},
+};
+
+static inline const StatsHist *get_hist(const WidgetStats *s, size_t i)
+{
+    return (const StatsHist *) ((const char *) s + hists[i].offset);
+}
+
+static inline uint64_t get_counter(const uint64_t *c)
+{
+    return __atomic_load_n(c, __ATOMIC_RELAXED);
+}
+
+static void push_field(lua_State *L, const char *key, lua_Number value)
+{
+    lua_pushnumber(L, value);
+    lua_setfield(L, -2, key);
+}
+
+void stats_push(lua_State *L, const WidgetStats *s)
+{
+    lua_createtable(L, 0, 7); // L: table
+    for (size_t i = 0; i < sizeof(hists) / sizeof(hists[0]); ++i) {
+        Summary sm = summarize(get_hist(s, i));
+        lua_createtable(L, 0, 6); // L: table table
+        push_field(L, "count", sm.count);
+        push_field(L, "mean", sm.mean / 1e9);
+        push_field(L, "p50", sm.p50 / 1e9);
+        push_field(L, "p90", sm.p90 / 1e9);
+        push_field(L, "p99", sm.p99 / 1e9);
+        push_field(L, "max", sm.max / 1e9);
+        lua_setfield(L, -2, hists[i].name); // L: table
+    }
+    push_field(L, "cb_errors", get_counter(&s->cb_errors));
+    push_field(L, "event_errors", get_counter(&s->event_errors));
+    push_field(L, "cb_coalesced", get_counter(&s->cb_coalesced));
+    push_field(L, "sets_skipped", get_counter(&s->sets_skipped));
+    push_field(L, "heap_bytes", get_counter(&s->heap_bytes));
+}
+
+static void append_json_string(LSString *buf, const char *s)
+{
+    ls_string_append_c(buf, '"');
+    for (; *s; ++s) {
+        unsigned char c = *s;
+        if (c == '"' || c == '\\') {
+            ls_string_append_c(buf, '\\');
+            ls_string_append_c(buf, c);
+        } else if (c < 0x20) {
+            ls_string_append_f(buf, "\\u%04x", c);
+        } else {
+            ls_string_append_c(buf, c);
+        }
+    }
+    ls_string_append_c(buf, '"');
+}
+
+void stats_append_json(LSString *buf, const char *name, double time, const WidgetStats *s)
+{
+    ls_string_append_f(buf, "{\"time\":%.3f,\"widget\":", time);
+    append_json_string(buf, name);
+    for (size_t i = 0; i < sizeof(hists) / sizeof(hists[0]); ++i) {
+        Summary sm = summarize(get_hist(s, i));
+        ls_string_append_f(
+            buf,
+            ",\"%s\":{\"count\":%llu,\"mean_us\":%.3f,\"p50_us\":%.3f,\"p90_us\":%.3f,"
+            "\"p99_us\":%.3f,\"max_us\":%.3f}",
+            hists[i].name, (unsigned long long) sm.count, sm.mean / 1e3,
+            sm.p50 / 1e3, sm.p90 / 1e3, sm.p99 / 1e3, sm.max / 1e3);
+    }
+    ls_string_append_f(
+        buf, ",\"cb_errors\":%llu,\"event_errors\":%llu,\"cb_coalesced\":%llu,"
+        "\"sets_skipped\":%llu,\"heap_bytes\":%llu}\n",
+        (unsigned long long) get_counter(&s->cb_errors),
+        (unsigned long long) get_counter(&s->event_errors),
+        (unsigned long long) get_counter(&s->cb_coalesced),
+        (unsigned long long) get_counter(&s->sets_skipped),
+        (unsigned long long) get_counter(&s->heap_bytes));
+}
+
+void stats_append_summary(LSString *buf, const WidgetStats *s)
+{
+    for (size_t i = 0; i < sizeof(hists) / sizeof(hists[0]); ++i) {
+        Summary sm = summarize(get_hist(s, i));
+        ls_string_append_f(
+            buf, "%s: n=%llu p50=%.1fus p99=%.1fus max=%.1fus; ",
+            hists[i].name, (unsigned long long) sm.count,
+            sm.p50 / 1e3, sm.p99 / 1e3, sm.max / 1e3);
+    }
+    ls_string_append_f(
+        buf, "errors: cb=%llu event=%llu; coalesced: %llu; skipped: %llu; heap: %llu bytes",
+        (unsigned long long) get_counter(&s->cb_errors),
+        (unsigned long long) get_counter(&s->event_errors),
+        (unsigned long long) get_counter(&s->cb_coalesced),
+        (unsigned long long) get_counter(&s->sets_skipped),
+        (unsigned long long) get_counter(&s->heap_bytes));
+}
@@ -0,0 +1,113 @@
+/*
+ * Copyright (C) 2015-2020  luastatus developers
+ *
+ * This file is part of luastatus.
+ *
+ * luastatus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * luastatus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with luastatus.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef stats_h_
+#define stats_h_
+
+#include <lua.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+
+#include "libls/string_.h"
+
+// Per-widget runtime metrics.
+//
+// Durations are recorded into histograms with logarithmic buckets, each power of two being split
+// into /1 << STATS_SUB_BITS/ linear sub-buckets (like HdrHistogram does), so that any recorded
+// value is known with a relative error of at most /1 / (1 << STATS_SUB_BITS)/.
+//
+// All the fields are only accessed atomically, so recording is lock-free, and metrics may be read
+// while being recorded (although a reader may then see a slightly inconsistent picture).
+
+#define STATS_SUB_BITS 3
+#define STATS_NSUB (1 << STATS_SUB_BITS)
+
+// Values, in nanoseconds, are clamped to /2^STATS_MAX_EXP - 1/ (a bit more than 78 hours).
+#define STATS_MAX_EXP 48
+
+#define STATS_NBUCKETS ((STATS_MAX_EXP - STATS_SUB_BITS + 1) * STATS_NSUB)
+
+typedef struct {
+    uint64_t count;
+    uint64_t sum;
+    uint64_t max;
+    uint64_t buckets[STATS_NBUCKETS];
+} StatsHist;
+
+typedef struct {
+    // Time spent in /widget.cb/ (including the serialization of its result).
+    StatsHist cb;
+
+    // Time spent waiting for the widget's Lua interpreter instance to become available before
+    // calling /widget.cb/ or /widget.event/.
+    StatsHist lock_wait;
+
+    // Time spent in /widget.event/.
+    StatsHist event;
+
+    // Time spent in barlib's /set()/ or /set_error()/ for this widget.
+    StatsHist set;
+
+    uint64_t cb_errors;
+    uint64_t event_errors;
+
+    // The number of plugin calls whose payload has been superseded by a newer one before being
+    // passed to /widget.cb/ (see /widget.min_interval/).
+    uint64_t cb_coalesced;
+
+    // The number of updates not passed to barlib's /set()/ because they were structurally equal to
+    // the previous one.
+    uint64_t sets_skipped;
+
+    // The size of the heap of the widget's Lua interpreter instance, in bytes, after the last call.
+    uint64_t heap_bytes;
+} WidgetStats;
+
+// Returns the current time of /CLOCK_MONOTONIC/ in nanoseconds.
+static inline uint64_t stats_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void stats_hist_record(StatsHist *h, uint64_t value);
+
+// Returns an approximation of percentile /p/ (from 0 to 100) of the values recorded into /h/, or
+// /0/ if none were.
+uint64_t stats_hist_percentile(const StatsHist *h, double p);
+
+// Increments a counter.
+static inline void stats_inc(uint64_t *counter)
+{
+    __atomic_add_fetch(counter, 1, __ATOMIC_RELAXED);
+}
+
+// Pushes a table with /s/'s metrics onto /L/'s stack. Durations are in seconds.
+void stats_push(lua_State *L, const WidgetStats *s);
+
+// Appends a JSON object with /s/'s metrics, as well as /name/ and /time/ (a Unix time), followed by
+// a newline, to /buf/. Durations are in microseconds.
+void stats_append_json(LSString *buf, const char *name, double time, const WidgetStats *s);
+
+// Appends a human-readable single-line summary of /s/'s metrics to /buf/.
+void stats_append_summary(LSString *buf, const WidgetStats *s);
+
+#endif
@@ -21,8 +21,9 @@
 #include <errno.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <poll.h>
 
-#include "include/plugin_v1.h"
+#include "include/plugin_v2.h"
 #include "include/sayf_macros.h"
 
 #include "libmoonvisit/moonvisit.h"
@@ -34,6 +35,7 @@
 typedef struct {
     double period;
     char *fifo;
+    int fifo_fd;
     LSPushedTimeout pushed_tmo;
 } Priv;
 
@@ -41,6 +43,7 @@ static void destroy(LuastatusPluginData *pd)
 {
     Priv *p = pd->priv;
     free(p->fifo);
+    close(p->fifo_fd);
     ls_pushed_timeout_destroy(&p->pushed_tmo);
     free(p);
 }
@@ -51,6 +54,7 @@ static int init(LuastatusPluginData *pd, lua_State *L)
     *p = (Priv) {
         .period = 1.0,
         .fifo = NULL,
+        .fifo_fd = -1,
     };
     ls_pushed_timeout_init(&p->pushed_tmo);
 
@@ -86,41 +90,57 @@ static void register_funcs(LuastatusPluginData *pd, lua_State *L)
     lua_setfield(L, -2, "push_period"); // L: table
 }
 
-static void run(LuastatusPluginData *pd, LuastatusPluginRunFuncs funcs)
+// Calls /cb/ with /what/, then (re-)opens the FIFO, if needed, and re-arms the timer.
+static int update(LuastatusPluginData *pd, LuastatusPluginReactorFuncs funcs, const char *what)
 {
     Priv *p = pd->priv;
 
-    int fifo_fd = -1;
+    lua_State *L = funcs.call_begin(pd->userdata);
+    lua_pushstring(L, what);
+    funcs.call_end(pd->userdata);
 
-    const char *what = "hello";
-
-    while (1) {
-        lua_State *L = funcs.call_begin(pd->userdata);
-        lua_pushstring(L, what);
-        funcs.call_end(pd->userdata);
-
-        if (ls_fifo_open(&fifo_fd, p->fifo) < 0) {
+    if (p->fifo_fd < 0) {
+        if (ls_fifo_open(&p->fifo_fd, p->fifo) < 0) {
             LS_WARNF(pd, "ls_fifo_open: %s: %s", p->fifo, LS_FIFO_STRERROR_ONSTACK(errno));
-        }
-        double tmo = ls_pushed_timeout_fetch(&p->pushed_tmo, p->period);
-        int r = ls_fifo_wait(&fifo_fd, tmo);
-        if (r < 0) {
-            LS_FATALF(pd, "ls_fifo_wait: %s", ls_strerror_onstack(errno));
-            goto error;
-        } else if (r == 0) {
-            what = "timeout";
-        } else {
-            what = "fifo";
+        } else if (p->fifo_fd >= 0 && funcs.watch_fd(pd->userdata, p->fifo_fd, POLLIN) < 0) {
+            LS_FATALF(pd, "watch_fd: %s", ls_strerror_onstack(errno));
+            return LUASTATUS_ERR;
         }
     }
+    funcs.set_timeout(pd->userdata, ls_pushed_timeout_fetch(&p->pushed_tmo, p->period));
+    return LUASTATUS_OK;
+}
 
-error:
-    close(fifo_fd);
+static int start(LuastatusPluginData *pd, LuastatusPluginReactorFuncs funcs)
+{
+    return update(pd, funcs, "hello");
+}
+
+static int on_fd(LuastatusPluginData *pd, LuastatusPluginReactorFuncs funcs, int fd, int revents)
+{
+    Priv *p = pd->priv;
+    (void) revents;
+
+    if (fd != p->fifo_fd) {
+        return LUASTATUS_OK;
+    }
+    funcs.unwatch_fd(pd->userdata, p->fifo_fd);
+    close(p->fifo_fd);
+    p->fifo_fd = -1;
+
+    return update(pd, funcs, "fifo");
+}
+
+static int on_timeout(LuastatusPluginData *pd, LuastatusPluginReactorFuncs funcs)
+{
+    return update(pd, funcs, "timeout");
 }
 
-LuastatusPluginIface luastatus_plugin_iface_v1 = {
+LuastatusPluginIface luastatus_plugin_iface_v2 = {
     .init = init,
     .register_funcs = register_funcs,
-    .run = run,
+    .start = start,
+    .on_fd = on_fd,
+    .on_timeout = on_timeout,
     .destroy = destroy,
 };
@@ -0,0 +1,195 @@
+/*
+ * Copyright (C) 2015-2020  luastatus developers
+ *
+ * This file is part of luastatus.
+ *
+ * luastatus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * luastatus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with luastatus.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Checks /ls_fmt_double()/ on special and random values: the output must read back as exactly the
+// same value, and is compared in length with the shortest /%.<N>g/ that does; then compares its
+// speed with that of /ls_string_append_f(s, "%.20g", v)/, which the i3 barlib used before.
+//
+// Usage: bench-fmt-num [NITERS]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <float.h>
+#include <math.h>
+#include <time.h>
+
+#include "libls/string_.h"
+#include "libls/vector.h"
+#include "libls/fmt_num.h"
+#include "libls/parse_int.h"
+
+static uint64_t rand64(void)
+{
+    uint64_t r = 0;
+    for (int i = 0; i < 4; ++i) {
+        r = (r << 16) ^ (rand() & 0xFFFF);
+    }
+    return r;
+}
+
+// Returns the number of significant digits in /s/.
+static int count_significant(const char *s)
+{
+    int first = -1, last = -1, i = 0;
+    for (; *s && *s != 'e'; ++s) {
+        if (*s >= '0' && *s <= '9') {
+            if (*s != '0') {
+                if (first < 0) {
+                    first = i;
+                }
+                last = i;
+            }
+            ++i;
+        }
+    }
+    return first < 0 ? 1 : last - first + 1;
+}
+
+static int nlonger = 0;
+
+static bool check_one(double v)
+{
+    char buf[LS_FMT_NUM_BUFSZ + 1];
+    size_t n = ls_fmt_double(buf, v);
+    buf[n] = '\0';
+
+    double back = strtod(buf, NULL);
+    if (back != v) {
+        fprintf(stderr, "%.17g: got '%s', which reads back as %.17g\n", v, buf, back);
+        return false;
+    }
+    if (strchr(buf, '.') || strchr(buf, 'e')) {
+        int shortest;
+        for (shortest = 1; shortest < 17; ++shortest) {
+            char ref[64];
+            snprintf(ref, sizeof(ref), "%.*g", shortest, v);
+            if (strtod(ref, NULL) == v) {
+                break;
+            }
+        }
+        int found = count_significant(buf);
+        if (found < shortest) {
+            fprintf(stderr, "%.17g: got '%s', shorter than the shortest?\n", v, buf);
+            return false;
+        }
+        if (found > shortest) {
+            ++nlonger;
+        }
+    }
+    return true;
+}
+
+static bool check(void)
+{
+    static const double SPECIAL[] = {
+        0.0, -0.0, 1.0, -1.0, 0.1, 0.2, 0.3, 1.0 / 3, 2.0 / 3, 3.14159, 100.5, 1e-7, 1.5e-7, 1e-6,
+        123456.789, 1e20, 1e21, 1e22, 1.7976931348623157e308, 2.2250738585072014e-308,
+        4.9406564584124654e-324, 9007199254740992.0, 9007199254740993.0, -9007199254740991.0,
+        9223372036854775808.0, 18446744073709551616.0, 5e-324, 1e300, 123e-20,
+    };
+    for (size_t i = 0; i < sizeof(SPECIAL) / sizeof(SPECIAL[0]); ++i) {
+        if (!check_one(SPECIAL[i])) {
+            return false;
+        }
+    }
+    srand(42);
+    for (int k = 0; k < 200000; ++k) {
+        uint64_t u = rand64();
+        double v;
+        memcpy(&v, &u, sizeof(v));
+        if (!isfinite(v)) {
+            continue;
+        }
+        if (!check_one(v) || !check_one((double) (int) u / 100)) {
+            return false;
+        }
+    }
+    printf("check passed; %d random values got a representation one digit longer than the "
+           "shortest\n", nlonger);
+    return true;
+}
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+#define NVALUES 1024
+
+static void bench(const char *name, const double *values, int niters)
+{
+    LSString s = LS_VECTOR_NEW();
+
+    uint64_t t_old = now_ns();
+    for (int k = 0; k < niters; ++k) {
+        LS_VECTOR_CLEAR(s);
+        ls_string_append_f(&s, "%.20g", values[k % NVALUES]);
+    }
+    t_old = now_ns() - t_old;
+
+    uint64_t t_new = now_ns();
+    for (int k = 0; k < niters; ++k) {
+        LS_VECTOR_CLEAR(s);
+        ls_string_append_double(&s, values[k % NVALUES]);
+    }
+    t_new = now_ns() - t_new;
+
+    printf("%-10s old %7.1f ns, new %7.1f ns (%.1fx)\n",
+           name, (double) t_old / niters, (double) t_new / niters, (double) t_old / t_new);
+    LS_VECTOR_FREE(s);
+}
+
+int main(int argc, char **argv)
+{
+    int niters = 1000000;
+    if (argc > 2) {
+        goto usage;
+    }
+    if (argc == 2 && (niters = ls_full_strtou(argv[1])) <= 0) {
+        goto usage;
+    }
+
+    if (!check()) {
+        return 1;
+    }
+
+    static double ints[NVALUES], fracs[NVALUES], randoms[NVALUES];
+    for (int i = 0; i < NVALUES; ++i) {
+        ints[i] = rand() % 2000;
+        fracs[i] = (double) (rand() % 100000) / 100;
+        uint64_t u;
+        do {
+            u = rand64();
+            memcpy(&randoms[i], &u, sizeof(u));
+        } while (!isfinite(randoms[i]));
+    }
+    bench("integers", ints, niters);
+    bench("fractions", fracs, niters);
+    bench("random", randoms, niters);
+    return 0;
+
+usage:
+    fprintf(stderr, "USAGE: %s [NITERS]\n", argv[0]);
+    return 2;
+}
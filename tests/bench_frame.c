@@ -0,0 +1,259 @@
+/*
+ * Copyright (C) 2015-2020  luastatus developers
+ *
+ * This file is part of luastatus.
+ *
+ * luastatus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * luastatus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with luastatus.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Compares the ways a text barlib may emit lines of output (frames) to a pipe:
+//
+//   * "stdio": /fwrite()/ of every piece into a /FILE/, then /fflush()/ (what the barlibs used to
+//     do);
+//   * "writev": a single /writev()/ of pointers to the pieces (retried on partial writes);
+//   * "writer": /ls_writer_push_framev()/ of pointers to the pieces (what the barlibs do now); the
+//     frame is gathered into the writer's buffer and written by the writer thread.
+//
+// A thread on the other end of the pipe reads everything as fast as it can. For each way, the
+// time spent in the emitting thread and the number of /write*()/ system calls (the /syscw/ field
+// of /proc/self/io/) per frame are printed.
+//
+// Usage: bench-frame [NWIDGETS [NFRAMES]]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/uio.h>
+
+#include "libls/alloc_utils.h"
+#include "libls/string_.h"
+#include "libls/vector.h"
+#include "libls/writer.h"
+#include "libls/parse_int.h"
+
+static size_t nwidgets = 50;
+static size_t nframes = 100000;
+
+static LSString *bufs;
+
+static int pipe_fds[2];
+
+static void *reader_thread(void *arg)
+{
+    (void) arg;
+    char buf[65536];
+    while (read(pipe_fds[0], buf, sizeof(buf)) > 0) {
+    }
+    return NULL;
+}
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static uint64_t write_syscalls(void)
+{
+    FILE *f = fopen("/proc/self/io", "r");
+    if (!f) {
+        return 0;
+    }
+    char line[128];
+    unsigned long long r = 0;
+    while (fgets(line, sizeof(line), f)) {
+        if (sscanf(line, "syscw: %llu", &r) == 1) {
+            break;
+        }
+    }
+    fclose(f);
+    return r;
+}
+
+// Fills /bufs/ with i3bar-like segments.
+static void make_bufs(void)
+{
+    bufs = LS_XNEW(LSString, nwidgets);
+    for (size_t i = 0; i < nwidgets; ++i) {
+        LS_VECTOR_INIT(bufs[i]);
+        ls_string_append_f(
+            &bufs[i],
+            "{\"name\":\"%zu\",\"full_text\":\"widget %zu: some text\",\"separator\":false}",
+            i, i);
+    }
+}
+
+static void collect_iov(LSIovecs *iov)
+{
+    LS_VECTOR_CLEAR(*iov);
+    ls_iovecs_append(iov, "[", 1);
+    for (size_t i = 0; i < nwidgets; ++i) {
+        if (i) {
+            ls_iovecs_append(iov, ",", 1);
+        }
+        ls_iovecs_append(iov, bufs[i].data, bufs[i].size);
+    }
+    ls_iovecs_append(iov, "],\n", 3);
+}
+
+static void emit_stdio(void)
+{
+    FILE *out = fdopen(dup(pipe_fds[1]), "w");
+    if (!out) {
+        perror("fdopen");
+        exit(1);
+    }
+    for (size_t k = 0; k < nframes; ++k) {
+        putc_unlocked('[', out);
+        for (size_t i = 0; i < nwidgets; ++i) {
+            if (i) {
+                putc_unlocked(',', out);
+            }
+            fwrite(bufs[i].data, 1, bufs[i].size, out);
+        }
+        fputs("],\n", out);
+        fflush(out);
+    }
+    fclose(out);
+}
+
+static void emit_writev(void)
+{
+    long iov_max = sysconf(_SC_IOV_MAX);
+    if (iov_max <= 0) {
+        iov_max = 16; // the minimum POSIX allows
+    }
+    LSIovecs iov = LS_VECTOR_NEW();
+    for (size_t k = 0; k < nframes; ++k) {
+        collect_iov(&iov);
+        struct iovec *v = iov.data;
+        size_t nv = iov.size;
+        while (nv) {
+            ssize_t w = writev(pipe_fds[1], v, nv > (size_t) iov_max ? (int) iov_max : (int) nv);
+            if (w < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                perror("writev");
+                exit(1);
+            }
+            // Skip the fully written buffers, and advance into the partially written one.
+            for (; nv && (size_t) w >= v->iov_len; ++v, --nv) {
+                w -= v->iov_len;
+            }
+            if (nv) {
+                v->iov_base = (char *) v->iov_base + w;
+                v->iov_len -= w;
+            }
+        }
+    }
+    LS_VECTOR_FREE(iov);
+}
+
+static uint64_t writer_dropped;
+
+static void emit_writer(void)
+{
+    LSWriter *w = ls_writer_new(pipe_fds[1]);
+    if (!w) {
+        perror("ls_writer_new");
+        exit(1);
+    }
+    LSIovecs iov = LS_VECTOR_NEW();
+    for (size_t k = 0; k < nframes; ++k) {
+        collect_iov(&iov);
+        if (ls_writer_push_framev(w, iov.data, iov.size) < 0) {
+            perror("ls_writer_push_framev");
+            exit(1);
+        }
+    }
+    writer_dropped = ls_writer_dropped(w);
+    ls_writer_destroy(w);
+    LS_VECTOR_FREE(iov);
+}
+
+static void run(const char *name, void (*emit)(void))
+{
+    if (pipe(pipe_fds) < 0) {
+        perror("pipe");
+        exit(1);
+    }
+    pthread_t reader;
+    if ((errno = pthread_create(&reader, NULL, reader_thread, NULL))) {
+        perror("pthread_create");
+        exit(1);
+    }
+
+    uint64_t syscw = write_syscalls();
+    uint64_t t = now_ns();
+    emit();
+    t = now_ns() - t;
+    syscw = write_syscalls() - syscw;
+
+    close(pipe_fds[1]);
+    pthread_join(reader, NULL);
+    close(pipe_fds[0]);
+
+    printf("%-8s %10.1f ns/frame %8.2f write syscalls/frame\n",
+           name, (double) t / nframes, (double) syscw / nframes);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc > 3) {
+        goto usage;
+    }
+    if (argc > 1) {
+        int v = ls_full_strtou(argv[1]);
+        if (v < 0) {
+            goto usage;
+        }
+        nwidgets = v;
+    }
+    if (argc > 2) {
+        int v = ls_full_strtou(argv[2]);
+        if (v <= 0) {
+            goto usage;
+        }
+        nframes = v;
+    }
+
+    make_bufs();
+    size_t nframe = 3 + (nwidgets ? nwidgets - 1 : 0);
+    for (size_t i = 0; i < nwidgets; ++i) {
+        nframe += bufs[i].size;
+    }
+    printf("%zu widgets, %zu frames of %zu bytes\n", nwidgets, nframes, nframe);
+
+    run("stdio", emit_stdio);
+    run("writev", emit_writev);
+    run("writer", emit_writer);
+    printf("(writer: %ju frames dropped)\n", (uintmax_t) writer_dropped);
+
+    for (size_t i = 0; i < nwidgets; ++i) {
+        LS_VECTOR_FREE(bufs[i]);
+    }
+    free(bufs);
+    return 0;
+
+usage:
+    fprintf(stderr, "USAGE: %s [NWIDGETS [NFRAMES]]\n", argv[0]);
+    return 2;
+}
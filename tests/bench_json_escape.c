@@ -0,0 +1,179 @@
+/*
+ * Copyright (C) 2015-2020  luastatus developers
+ *
+ * This file is part of luastatus.
+ *
+ * luastatus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * luastatus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with luastatus.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Checks /append_json_escaped_b()/ of the i3 barlib against a byte-at-a-time reference on random
+// strings, then compares its speed with that of the previous implementation (which scanned the
+// string byte by byte and escaped everything as /\u00XX/) on a few typical inputs.
+//
+// Usage: bench-json-escape [NITERS]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "libls/string_.h"
+#include "libls/vector.h"
+#include "libls/parse_int.h"
+
+#include "barlibs/i3/generator_utils.h"
+
+static void reference_escape(LSString *s, const char *buf, size_t nbuf)
+{
+    ls_string_append_c(s, '"');
+    for (size_t i = 0; i < nbuf; ++i) {
+        unsigned char c = buf[i];
+        switch (c) {
+        case '"':  ls_string_append_s(s, "\\\""); break;
+        case '\\': ls_string_append_s(s, "\\\\"); break;
+        case '\b': ls_string_append_s(s, "\\b");  break;
+        case '\f': ls_string_append_s(s, "\\f");  break;
+        case '\n': ls_string_append_s(s, "\\n");  break;
+        case '\r': ls_string_append_s(s, "\\r");  break;
+        case '\t': ls_string_append_s(s, "\\t");  break;
+        default:
+            if (c < 32) {
+                ls_string_append_f(s, "\\u%04X", c);
+            } else {
+                ls_string_append_c(s, c);
+            }
+        }
+    }
+    ls_string_append_c(s, '"');
+}
+
+// The previous implementation.
+static void old_escape(LSString *s, const char *zts)
+{
+    static const char *HEX_CHARS = "0123456789ABCDEF";
+
+    ls_string_append_c(s, '"');
+    size_t prev = 0;
+    size_t i;
+    for (i = 0; ; ++i) {
+        unsigned char c = zts[i];
+        if (c == '\0')
+            break;
+
+        if (c < 32 || c == '\\' || c == '"' || c == '/') {
+            ls_string_append_b(s, zts + prev, i - prev);
+            char buf[] = {'\\', 'u', '0', '0', HEX_CHARS[c / 16], HEX_CHARS[c % 16]};
+            ls_string_append_b(s, buf, sizeof(buf));
+            prev = i + 1;
+        }
+    }
+    ls_string_append_b(s, zts + prev, i - prev);
+    ls_string_append_c(s, '"');
+}
+
+static bool check(void)
+{
+    static const char ALPHABET[] = {'a', 'b', ' ', '"', '\\', '/', '\n', '\t', '\0', 1, 31, 32, 127,
+                                    (char) 128, (char) 255};
+    LSString expected = LS_VECTOR_NEW();
+    LSString found = LS_VECTOR_NEW();
+    char buf[100];
+    bool ok = true;
+    srand(42);
+    for (int k = 0; k < 100000 && ok; ++k) {
+        size_t nbuf = rand() % sizeof(buf);
+        // Mostly clean strings, so that the vectorized path is taken.
+        int clean_ratio = rand() % 64;
+        for (size_t i = 0; i < nbuf; ++i) {
+            buf[i] = rand() % 64 < clean_ratio ? 'x' : ALPHABET[rand() % sizeof(ALPHABET)];
+        }
+        LS_VECTOR_CLEAR(expected);
+        LS_VECTOR_CLEAR(found);
+        reference_escape(&expected, buf, nbuf);
+        append_json_escaped_b(&found, buf, nbuf);
+        if (expected.size != found.size || memcmp(expected.data, found.data, found.size) != 0) {
+            fprintf(stderr, "Mismatch: expected '%.*s', found '%.*s'\n",
+                    (int) expected.size, expected.data, (int) found.size, found.data);
+            ok = false;
+        }
+    }
+    LS_VECTOR_FREE(expected);
+    LS_VECTOR_FREE(found);
+    return ok;
+}
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void bench(const char *name, const char *input, int niters)
+{
+    size_t ninput = strlen(input);
+    LSString s = LS_VECTOR_NEW();
+
+    uint64_t t_old = now_ns();
+    for (int k = 0; k < niters; ++k) {
+        LS_VECTOR_CLEAR(s);
+        old_escape(&s, input);
+    }
+    t_old = now_ns() - t_old;
+
+    uint64_t t_new = now_ns();
+    for (int k = 0; k < niters; ++k) {
+        LS_VECTOR_CLEAR(s);
+        append_json_escaped_b(&s, input, ninput);
+    }
+    t_new = now_ns() - t_new;
+
+    printf("%-8s %5zu bytes: old %8.1f ns, new %8.1f ns (%.1fx)\n",
+           name, ninput, (double) t_old / niters, (double) t_new / niters,
+           (double) t_old / t_new);
+    LS_VECTOR_FREE(s);
+}
+
+int main(int argc, char **argv)
+{
+    int niters = 1000000;
+    if (argc > 2) {
+        goto usage;
+    }
+    if (argc == 2 && (niters = ls_full_strtou(argv[1])) <= 0) {
+        goto usage;
+    }
+
+    if (!check()) {
+        return 1;
+    }
+
+    char long_clean[1025];
+    for (size_t i = 0; i < sizeof(long_clean) - 1; ++i) {
+        long_clean[i] = 'a' + i % 26;
+    }
+    long_clean[sizeof(long_clean) - 1] = '\0';
+
+    bench("key", "full_text", niters);
+    bench("short", "CPU: 12% 2.4 GHz", niters);
+    bench("markup", "<span color=\"#ff0000\">/dev/sda1</span>: 45%", niters);
+    bench("lines", "first line\nsecond line\n\tindented\n", niters);
+    bench("long", long_clean, niters / 16);
+    return 0;
+
+usage:
+    fprintf(stderr, "USAGE: %s [NITERS]\n", argv[0]);
+    return 2;
+}
@@ -0,0 +1,174 @@
+/*
+ * Copyright (C) 2015-2020  luastatus developers
+ *
+ * This file is part of luastatus.
+ *
+ * luastatus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * luastatus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with luastatus.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Checks /key_cache_get()/ of the i3 barlib (hits, overflow of the cache, classification, keys with
+// NUL bytes), then compares the speed of a cache hit with that of escaping and classifying the key
+// anew, as was done before the cache, on a few typical keys.
+//
+// Usage: bench-key-cache [NITERS]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+
+#include "libls/string_.h"
+#include "libls/vector.h"
+#include "libls/parse_int.h"
+
+#include "barlibs/i3/generator_utils.h"
+#include "barlibs/i3/key_cache.h"
+
+// More than the cache may hold.
+#define NDISTINCT 1000
+
+static bool check_entry(const KeyCacheEntry *e, const char *key, size_t nkey, KeyKind kind)
+{
+    LSString json = LS_VECTOR_NEW();
+    append_json_escaped_b(&json, key, nkey);
+    ls_string_append_c(&json, ':');
+    bool ok = e->used &&
+              e->key.size == nkey && (!nkey || memcmp(e->key.data, key, nkey) == 0) &&
+              e->kind == kind &&
+              e->json.size == json.size && memcmp(e->json.data, json.data, json.size) == 0;
+    if (!ok) {
+        fprintf(stderr, "Wrong entry for key '%.*s' (%zu bytes)\n", (int) nkey, key, nkey);
+    }
+    LS_VECTOR_FREE(json);
+    return ok;
+}
+
+static bool check(void)
+{
+    KeyCache c;
+    key_cache_init(&c);
+    bool ok = true;
+
+    const KeyCacheEntry *full_text = key_cache_get(&c, "full_text", 9);
+    ok = ok && check_entry(full_text, "full_text", 9, KEY_KIND_REGULAR);
+    ok = ok && check_entry(key_cache_get(&c, "name", 4), "name", 4, KEY_KIND_NAME);
+    ok = ok && check_entry(key_cache_get(&c, "separator", 9), "separator", 9, KEY_KIND_SEPARATOR);
+    ok = ok && check_entry(key_cache_get(&c, "names", 5), "names", 5, KEY_KIND_REGULAR);
+    ok = ok && check_entry(key_cache_get(&c, "separator_block_width", 21),
+                           "separator_block_width", 21, KEY_KIND_REGULAR);
+    ok = ok && check_entry(key_cache_get(&c, "", 0), "", 0, KEY_KIND_REGULAR);
+
+    // Keys with NUL bytes are distinct from their prefixes and from each other.
+    ok = ok && check_entry(key_cache_get(&c, "name\0", 5), "name\0", 5, KEY_KIND_REGULAR);
+    ok = ok && check_entry(key_cache_get(&c, "a\0b", 3), "a\0b", 3, KEY_KIND_REGULAR);
+    ok = ok && check_entry(key_cache_get(&c, "a\0c", 3), "a\0c", 3, KEY_KIND_REGULAR);
+    ok = ok && check_entry(key_cache_get(&c, "a", 1), "a", 1, KEY_KIND_REGULAR);
+    ok = ok && check_entry(key_cache_get(&c, "a\0b", 3), "a\0b", 3, KEY_KIND_REGULAR);
+
+    // Overflow the cache; keys that do not fit must still be served correctly.
+    char key[32];
+    for (int i = 0; i < NDISTINCT && ok; ++i) {
+        int nkey = snprintf(key, sizeof(key), "key\"%d", i);
+        ok = check_entry(key_cache_get(&c, key, nkey), key, nkey, KEY_KIND_REGULAR);
+    }
+    if (ok && c.nentries >= NDISTINCT) {
+        fprintf(stderr, "The cache is not bounded: %zu entries\n", c.nentries);
+        ok = false;
+    }
+    // The last key did not fit, and is served from the scratch entry.
+    int nkey = snprintf(key, sizeof(key), "key\"%d", NDISTINCT - 1);
+    if (ok && key_cache_get(&c, key, nkey) != &c.scratch) {
+        fprintf(stderr, "A key that does not fit is not served from the scratch entry\n");
+        ok = false;
+    }
+
+    // Keys cached before the overflow are still hits, and classified as before.
+    if (ok && key_cache_get(&c, "full_text", 9) != full_text) {
+        fprintf(stderr, "A cached key is not a hit after the cache has filled up\n");
+        ok = false;
+    }
+    ok = ok && check_entry(full_text, "full_text", 9, KEY_KIND_REGULAR);
+    ok = ok && check_entry(key_cache_get(&c, "name", 4), "name", 4, KEY_KIND_NAME);
+    ok = ok && check_entry(key_cache_get(&c, "separator", 9), "separator", 9, KEY_KIND_SEPARATOR);
+    ok = ok && check_entry(key_cache_get(&c, "a\0c", 3), "a\0c", 3, KEY_KIND_REGULAR);
+
+    key_cache_destroy(&c);
+    return ok;
+}
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void bench(const char *key, int niters)
+{
+    size_t nkey = strlen(key);
+    LSString s = LS_VECTOR_NEW();
+    KeyCache c;
+    key_cache_init(&c);
+    volatile int sink = 0;
+
+    uint64_t t_old = now_ns();
+    for (int k = 0; k < niters; ++k) {
+        LS_VECTOR_CLEAR(s);
+        sink += strcmp(key, "name") == 0 || strcmp(key, "separator") == 0;
+        append_json_escaped_b(&s, key, nkey);
+        ls_string_append_c(&s, ':');
+    }
+    t_old = now_ns() - t_old;
+
+    uint64_t t_new = now_ns();
+    for (int k = 0; k < niters; ++k) {
+        LS_VECTOR_CLEAR(s);
+        const KeyCacheEntry *e = key_cache_get(&c, key, nkey);
+        sink += e->kind;
+        ls_string_append_b(&s, e->json.data, e->json.size);
+    }
+    t_new = now_ns() - t_new;
+
+    printf("%-24s old %8.1f ns, new %8.1f ns (%.1fx)\n",
+           key, (double) t_old / niters, (double) t_new / niters, (double) t_old / t_new);
+    key_cache_destroy(&c);
+    LS_VECTOR_FREE(s);
+}
+
+int main(int argc, char **argv)
+{
+    int niters = 1000000;
+    if (argc > 2) {
+        goto usage;
+    }
+    if (argc == 2 && (niters = ls_full_strtou(argv[1])) <= 0) {
+        goto usage;
+    }
+
+    if (!check()) {
+        return 1;
+    }
+
+    bench("name", niters);
+    bench("full_text", niters);
+    bench("color", niters);
+    bench("separator_block_width", niters);
+    return 0;
+
+usage:
+    fprintf(stderr, "USAGE: %s [NITERS]\n", argv[0]);
+    return 2;
+}
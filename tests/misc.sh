@@ -115,4 +115,96 @@ widget = setmetatable(
 
 assert_works_1W $B 'widget = {plugin = "./plugin-mock.so", cb = function() end}'
 
+assert_works_1W $B '
+widget = {
+    plugin = "./plugin-mock.so",
+    opts = {make_calls = 3},
+    cb_budget = 0.1,
+    cb = function() while true do pcall(function() while true do end end) end end,
+}'
+
+assert_works_1W $B 'widget = {plugin = "./plugin-mock.so", cb_budget = -1, cb = function() end}'
+
+assert_works_1W $B '
+n = 0
+widget = {
+    plugin = "./plugin-mock.so",
+    opts = {make_calls = 1000},
+    min_interval = 60,
+    cb = function()
+        n = n + 1
+        if n > 2 then os.exit(1) end
+    end,
+}'
+
+assert_works_1W $B 'widget = {plugin = "./plugin-mock.so", max_rate = 0, cb = function() end}'
+
+assert_works_1W $B '
+n = 0
+widget = {
+    plugin = "./plugin-mock.so",
+    opts = {make_calls = 4},
+    memory_limit = 1024 * 1024,
+    cb = function()
+        n = n + 1
+        if n % 2 == 0 then
+            return "fine"
+        end
+        local t = {}
+        for i = 1, 1e7 do t[i] = tostring(i) end
+        -- Only reached if the limit is not enforced.
+        os.exit(1)
+    end,
+}'
+
+scroll_tmpdir=$(mktemp -d)
+assert_succeeds -e $B -B gen_events=300 -B event_button=4 <(cat <<__EOF__
+total = 0
+widget = {
+    plugin = "./plugin-mock.so",
+    cb = function() end,
+    coalesce_scroll = true,
+    event = function(t)
+        assert(t.button == 4)
+        total = total + (t.count or 1)
+        if total > 300 then os.exit(1) end
+        if total == 300 then assert(io.open("$scroll_tmpdir/done", "w")):close() end
+        local start = os.clock()
+        while os.clock() - start < 0.01 do end
+    end,
+}
+__EOF__
+)
+[[ -e $scroll_tmpdir/done ]] || fail "Coalesced scroll events do not add up to 300"
+rm -rf -- "$scroll_tmpdir"
+
+assert_cache_entries()
+{
+    local n
+    n=$(find "$XDG_CACHE_HOME" -name '*.luac' | wc -l)
+    if (( n != $1 )); then
+        fail "Expected $1 bytecode cache entries, found $n"
+    fi
+}
+
+cache_tmpdir=$(mktemp -d)
+export XDG_CACHE_HOME=$cache_tmpdir
+cached_widget=$cache_tmpdir/widget.lua
+echo 'widget = {plugin = "./plugin-mock.so", opts = {make_calls = 1}, cb = function() end}' \
+    > "$cached_widget"
+assert_succeeds -e -C $B "$cached_widget"
+assert_cache_entries 0
+assert_succeeds -e $B "$cached_widget"
+assert_cache_entries 1
+assert_succeeds -e $B "$cached_widget"
+assert_cache_entries 1
+echo 'widget = {plugin = "./plugin-mock.so", opts = {make_calls = 2}, cb = function() end}' \
+    > "$cached_widget"
+assert_succeeds -e $B "$cached_widget"
+assert_cache_entries 1
+assert_succeeds -e -C $B "$cached_widget"
+assert_cache_entries 1
+rm -rf -- "$cache_tmpdir"
+unset XDG_CACHE_HOME
+
 echo >&2 "=== PASSED ==="
@@ -32,6 +32,8 @@ typedef struct {
     size_t nwidgets;
     unsigned char *widgets;
     int nevents;
+    int pause_every;
+    int event_button;
 } Priv;
 
 static void destroy(LuastatusBarlibData *bd)
@@ -48,6 +50,8 @@ static int init(LuastatusBarlibData *bd, const char *const *opts, size_t nwidget
         .nwidgets = nwidgets,
         .widgets = LS_XNEW0(unsigned char, nwidgets),
         .nevents = 0,
+        .pause_every = 0,
+        .event_button = 0,
     };
     for (const char *const *s = opts; *s; ++s) {
         const char *v;
@@ -56,6 +60,16 @@ static int init(LuastatusBarlibData *bd, const char *const *opts, size_t nwidget
                 LS_FATALF(bd, "gen_events value is not a proper integer");
                 goto error;
             }
+        } else if ((v = ls_strfollow(*s, "pause_every="))) {
+            if ((p->pause_every = ls_full_strtou(v)) < 0) {
+                LS_FATALF(bd, "pause_every value is not a proper integer");
+                goto error;
+            }
+        } else if ((v = ls_strfollow(*s, "event_button="))) {
+            if ((p->event_button = ls_full_strtou(v)) < 0) {
+                LS_FATALF(bd, "event_button value is not a proper integer");
+                goto error;
+            }
         } else {
             LS_FATALF(bd, "unknown option: '%s'", *s);
             goto error;
@@ -95,9 +109,18 @@ static int event_watcher(LuastatusBarlibData *bd, LuastatusBarlibEWFuncs funcs)
     }
     unsigned seed = time(NULL);
     for (int i = 0; i < p->nevents; ++i) {
+        if (p->pause_every && i % p->pause_every == 0) {
+            bd->set_paused(bd->userdata, (i / p->pause_every) % 2 == 0);
+        }
         size_t widget_idx = rand_r(&seed) % p->nwidgets;
         lua_State *L = funcs.call_begin(bd->userdata, widget_idx);
-        lua_pushnil(L);
+        if (p->event_button) {
+            lua_createtable(L, 0, 1);
+            lua_pushinteger(L, p->event_button);
+            lua_setfield(L, -2, "button");
+        } else {
+            lua_pushnil(L);
+        }
         funcs.call_end(bd->userdata, widget_idx);
     }
     return LUASTATUS_NONFATAL_ERR;
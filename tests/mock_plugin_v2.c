@@ -0,0 +1,88 @@
+/*
+ * Copyright (C) 2015-2020  luastatus developers
+ *
+ * This file is part of luastatus.
+ *
+ * luastatus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * luastatus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with luastatus.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <lua.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "include/plugin_v2.h"
+#include "include/sayf_macros.h"
+
+#include "libmoonvisit/moonvisit.h"
+
+#include "libls/alloc_utils.h"
+
+typedef struct {
+    uint64_t ncalls;
+} Priv;
+
+static void destroy(LuastatusPluginData *pd)
+{
+    Priv *p = pd->priv;
+    free(p);
+}
+
+static int init(LuastatusPluginData *pd, lua_State *L)
+{
+    Priv *p = pd->priv = LS_XNEW(Priv, 1);
+    *p = (Priv) {
+        .ncalls = 0,
+    };
+
+    char errbuf[256];
+    MoonVisit mv = {.L = L, .errbuf = errbuf, .nerrbuf = sizeof(errbuf)};
+
+    // Parse make_calls
+    if (moon_visit_uint(&mv, -1, "make_calls", &p->ncalls, true) < 0)
+        goto mverror;
+
+    return LUASTATUS_OK;
+
+mverror:
+    LS_FATALF(pd, "%s", errbuf);
+//error:
+    destroy(pd);
+    return LUASTATUS_ERR;
+}
+
+static int on_timeout(LuastatusPluginData *pd, LuastatusPluginReactorFuncs funcs)
+{
+    Priv *p = pd->priv;
+    if (!p->ncalls)
+        return LUASTATUS_ERR;
+    --p->ncalls;
+
+    lua_State *L = funcs.call_begin(pd->userdata);
+    lua_pushnil(L);
+    funcs.call_end(pd->userdata);
+
+    funcs.set_timeout(pd->userdata, 0);
+    return LUASTATUS_OK;
+}
+
+static int start(LuastatusPluginData *pd, LuastatusPluginReactorFuncs funcs)
+{
+    return on_timeout(pd, funcs);
+}
+
+LuastatusPluginIface luastatus_plugin_iface_v2 = {
+    .init = init,
+    .start = start,
+    .on_timeout = on_timeout,
+    .destroy = destroy,
+};
@@ -23,10 +23,11 @@ run1() {
         local event_beg='[['         event_end=']]'
     fi
     shift 3
-    "${VALGRIND[@]}" "$@" "${LUASTATUS[@]}" -e -b ./barlib-mock.so -B gen_events="$m" <(cat <<__EOF__
+    "${VALGRIND[@]}" "$@" "${LUASTATUS[@]}" ${SHARED:+-s "$SHARED"} ${EVSTATES:+-E "$EVSTATES"} \
+        -e -b ./barlib-mock.so -B gen_events="$m" ${PAUSE:+-B pause_every="$PAUSE"} <(cat <<__EOF__
 n = 0
 widget = {
-    plugin = './plugin-mock.so',
+    plugin = '${PLUGIN:-./plugin-mock.so}',
     opts = {
         make_calls = $n,
     },
@@ -64,4 +65,33 @@ run2 10000 10000 \
 run2 100000 100000 \
     --tool=helgrind
 
+PLUGIN=./plugin-mock-v2.so run2 10000 10000 \
+    --suppressions=dlopen.supp \
+    --leak-check=full \
+    --show-leak-kinds=all \
+    --errors-for-leak-kinds=all \
+    --track-fds=yes
+
+PLUGIN=./plugin-mock-v2.so run2 100000 100000 \
+    --tool=helgrind
+
+SHARED=1 run2 10000 10000 \
+    --suppressions=dlopen.supp \
+    --leak-check=full \
+    --show-leak-kinds=all \
+    --errors-for-leak-kinds=all \
+    --track-fds=yes
+
+SHARED=1 run2 100000 100000 \
+    --tool=helgrind
+
+EVSTATES=3 run2 100000 100000 \
+    --tool=helgrind
+
+PAUSE=1000 run2 100000 100000 \
+    --tool=helgrind
+
+PAUSE=1000 PLUGIN=./plugin-mock-v2.so run2 100000 100000 \
+    --tool=helgrind
+
 echo >&2 "=== PASSED ==="